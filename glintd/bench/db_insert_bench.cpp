@@ -0,0 +1,125 @@
+﻿// Chunk bookkeeping throughput. Each "rotation" is what a rolling session
+// does every segment: insert one chunk with its keyframe index and drop the
+// oldest chunk once the window is full.
+//   legacy  - rollback journal, synchronous=FULL, statement prepared per call,
+//             every write its own commit (how DB worked before WAL)
+//   wal     - DB with WAL + cached statements, one commit per call
+//   batched - DB with the rotation grouped into one transaction
+//
+// usage: glintd_db_bench [work_dir] [rotations]
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <filesystem>
+#include <format>
+#include <iostream>
+#include <vector>
+
+#include <sqlite3.h>
+
+#include "db.h"
+
+namespace {
+
+constexpr std::size_t kWindowChunks = 15;
+constexpr int kKeyframesPerChunk = 1;
+
+double legacyRotations(const std::filesystem::path& path, int rotations) {
+    std::filesystem::remove(path);
+    sqlite3* db = nullptr;
+    sqlite3_open(path.string().c_str(), &db);
+    sqlite3_exec(db, "PRAGMA journal_mode = DELETE; PRAGMA synchronous = FULL;", nullptr, nullptr, nullptr);
+    sqlite3_exec(db, "CREATE TABLE chunks(id INTEGER PRIMARY KEY AUTOINCREMENT, session_id INTEGER NOT NULL, "
+                     "path TEXT NOT NULL, start_ms INTEGER NOT NULL, end_ms INTEGER NOT NULL, keyframe_ms INTEGER);",
+                 nullptr, nullptr, nullptr);
+
+    std::deque<int64_t> window;
+    const auto started = std::chrono::steady_clock::now();
+    for (int i = 0; i < rotations; ++i) {
+        sqlite3_stmt* stmt = nullptr;
+        sqlite3_prepare_v2(db, "INSERT INTO chunks(session_id, path, start_ms, end_ms, keyframe_ms) VALUES(?,?,?,?,?);",
+                           -1, &stmt, nullptr);
+        const std::string chunkPath = std::format("/tmp/session/chunk_{:06}.mkv", i);
+        sqlite3_bind_int(stmt, 1, 1);
+        sqlite3_bind_text(stmt, 2, chunkPath.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int64(stmt, 3, i * 2000);
+        sqlite3_bind_int64(stmt, 4, i * 2000 + 1999);
+        sqlite3_bind_int64(stmt, 5, i * 2000);
+        sqlite3_step(stmt);
+        sqlite3_finalize(stmt);
+        window.push_back(sqlite3_last_insert_rowid(db));
+
+        if (window.size() > kWindowChunks) {
+            sqlite3_prepare_v2(db, "DELETE FROM chunks WHERE id=?;", -1, &stmt, nullptr);
+            sqlite3_bind_int64(stmt, 1, window.front());
+            sqlite3_step(stmt);
+            sqlite3_finalize(stmt);
+            window.pop_front();
+        }
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    sqlite3_close(db);
+    return rotations / seconds;
+}
+
+double dbRotations(int sessionId, int rotations, bool batched) {
+    DB& db = DB::instance();
+    std::deque<int64_t> window;
+    const auto started = std::chrono::steady_clock::now();
+    for (int i = 0; i < rotations; ++i) {
+        auto txn = batched ? db.transaction() : glint::unexpected(std::string{"unbatched"});
+        if (window.size() >= kWindowChunks) {
+            db.removeChunk(window.front());
+            window.pop_front();
+        }
+        const int64_t startMs = static_cast<int64_t>(i) * 2000;
+        auto id = db.insertChunk(sessionId, std::format("/tmp/session/chunk_{:06}.mkv", i), startMs, startMs + 1999, startMs);
+        if (!id) {
+            std::cerr << id.error() << "\n";
+            return 0.0;
+        }
+        window.push_back(id.value());
+        std::vector<KeyframeRecord> keyframes;
+        for (int k = 0; k < kKeyframesPerChunk; ++k) {
+            keyframes.push_back(KeyframeRecord{startMs + k * 2000, 4096});
+        }
+        db.insertKeyframes(id.value(), keyframes);
+        if (txn) {
+            txn.value().commit();
+        }
+    }
+    return rotations / std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const std::filesystem::path dir = argc > 1 ? argv[1] : std::filesystem::temp_directory_path() / "glintd_db_bench";
+    const int rotations = argc > 2 ? std::atoi(argv[2]) : 2000;
+    std::filesystem::create_directories(dir);
+
+    const double legacy = legacyRotations(dir / "legacy.db", rotations);
+
+    for (const char* name : {"glintd.db", "glintd.db-wal", "glintd.db-shm"}) {
+        std::filesystem::remove(dir / name);
+    }
+    DB::instance().setCustomPath(dir / "glintd.db");
+    if (auto res = DB::instance().open(); !res) {
+        std::cerr << res.error() << "\n";
+        return 1;
+    }
+    auto session = DB::instance().createSession("bench", 0, "matroska");
+    if (!session) {
+        std::cerr << session.error() << "\n";
+        return 1;
+    }
+    const int sessionId = static_cast<int>(session.value());
+    const double wal = dbRotations(sessionId, rotations, false);
+    const double batched = dbRotations(sessionId, rotations, true);
+
+    std::cout << "mode,rotations_per_s\n";
+    std::cout << std::format("legacy,{:.0f}\nwal,{:.0f}\nbatched,{:.0f}\n", legacy, wal, batched);
+    return 0;
+}
@@ -0,0 +1,151 @@
+﻿// Export latency vs. segment length. Writes synthetic segments of growing
+// length through MuxerAvFormat, then cuts the last few seconds out of each
+// with ConcatRemuxer three ways:
+//   indexed - byte seek from the write-side keyframe index
+//   seek    - timestamp seek through the demuxer's own index
+//   scan    - read from the first keyframe (what an exporter without any
+//             index has to do)
+// The indexed column should stay flat as segments get longer.
+//
+// usage: glintd_export_bench [work_dir] [max_segment_seconds]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <iostream>
+#include <vector>
+
+extern "C" {
+#include <libavutil/log.h>
+}
+
+#include "ff/concat_remuxer.h"
+#include "ff/muxer_avformat.h"
+
+namespace {
+
+constexpr int kFps = 30;
+constexpr int kGopFrames = 2 * kFps;
+constexpr std::size_t kKeyframeBytes = 60 * 1024;
+constexpr std::size_t kFrameBytes = 6 * 1024;
+constexpr int64_t kClipMs = 5000;
+constexpr int kRuns = 5;
+
+struct Segment {
+    std::filesystem::path path;
+    int64_t start_ms{0};
+    int64_t end_ms{0};
+    uint64_t bytes{0};
+    std::vector<KeyframeIndexEntry> keyframes;
+};
+
+Segment writeSegment(const std::filesystem::path& path, int seconds) {
+    MuxerConfig cfg;
+    cfg.container = "matroska";
+    cfg.path = path;
+    cfg.two_audio_tracks = false;
+
+    EncoderStreamInfo video;
+    video.type = EncodedStreamType::Video;
+    video.codec_name = "mpeg4";
+    video.width = 1280;
+    video.height = 720;
+    video.fps = kFps;
+
+    MuxerAvFormat muxer;
+    Segment seg;
+    seg.path = path;
+    if (!muxer.open(cfg, video, {}, {})) {
+        return seg;
+    }
+
+    // No start codes in the payload, so nothing tries to parse it.
+    const std::vector<uint8_t> keyframeBytes(kKeyframeBytes, 0xA5);
+    const std::vector<uint8_t> frameBytes(kFrameBytes, 0x5A);
+    const auto keyframe = PacketBuffer::copyOf(keyframeBytes.data(), keyframeBytes.size());
+    const auto frame = PacketBuffer::copyOf(frameBytes.data(), frameBytes.size());
+    const int frames = seconds * kFps;
+    for (int i = 0; i < frames; ++i) {
+        EncodedPacket pkt;
+        pkt.type = EncodedStreamType::Video;
+        pkt.pts = pkt.dts = 1000 + static_cast<int64_t>(i) * 1000 / kFps;
+        pkt.keyframe = i % kGopFrames == 0;
+        pkt.data = pkt.keyframe ? keyframe : frame;
+        muxer.write(pkt);
+        seg.end_ms = pkt.pts;
+    }
+    muxer.close();
+
+    seg.start_ms = 1000;
+    seg.keyframes = muxer.keyframeIndex();
+    std::error_code ec;
+    seg.bytes = std::filesystem::file_size(path, ec);
+    return seg;
+}
+
+enum class Mode { Indexed, Seek, Scan };
+
+double exportMs(const Segment& seg, Mode mode, const std::filesystem::path& out) {
+    const int64_t from = seg.end_ms - kClipMs;
+    auto keyframe = std::find_if(seg.keyframes.rbegin(), seg.keyframes.rend(),
+                                 [&](const KeyframeIndexEntry& k) { return k.pts_ms <= from; });
+
+    RemuxInput input{seg.path};
+    switch (mode) {
+    case Mode::Indexed:
+        input.from_ms = keyframe->pts_ms - seg.start_ms;
+        input.from_byte = keyframe->byte_offset;
+        break;
+    case Mode::Seek:
+        input.from_ms = from - seg.start_ms;
+        break;
+    case Mode::Scan:
+        input.from_ms = keyframe->pts_ms - seg.start_ms;
+        input.from_byte = seg.keyframes.front().byte_offset;
+        break;
+    }
+
+    std::vector<double> samples;
+    for (int run = 0; run < kRuns; ++run) {
+        ConcatRemuxer remuxer;
+        const auto started = std::chrono::steady_clock::now();
+        if (!remuxer.remux(std::vector<RemuxInput>{input}, out)) {
+            return -1.0;
+        }
+        samples.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count());
+    }
+    std::sort(samples.begin(), samples.end());
+    return samples[samples.size() / 2];
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const std::filesystem::path dir = argc > 1 ? argv[1] : std::filesystem::temp_directory_path() / "glintd_export_bench";
+    const int maxSeconds = argc > 2 ? std::atoi(argv[2]) : 600;
+    std::filesystem::create_directories(dir);
+    av_log_set_level(AV_LOG_ERROR);
+
+    std::cout << "segment_s,size_mb,keyframes,indexed_ms,seek_ms,scan_ms\n";
+    for (int seconds : {10, 30, 60, 120, 300, 600, 1200}) {
+        if (seconds > maxSeconds) {
+            break;
+        }
+        const Segment seg = writeSegment(dir / std::format("segment_{}s.mkv", seconds), seconds);
+        if (seg.keyframes.empty()) {
+            std::cerr << "failed to write " << seg.path.string() << "\n";
+            return 1;
+        }
+        const auto out = dir / "clip.mkv";
+        std::cout << std::format("{},{:.1f},{},{:.2f},{:.2f},{:.2f}\n", seconds,
+                                 static_cast<double>(seg.bytes) / (1024.0 * 1024.0), seg.keyframes.size(),
+                                 exportMs(seg, Mode::Indexed, out), exportMs(seg, Mode::Seek, out),
+                                 exportMs(seg, Mode::Scan, out));
+        std::filesystem::remove(seg.path);
+    }
+    std::filesystem::remove(dir / "clip.mkv");
+    return 0;
+}
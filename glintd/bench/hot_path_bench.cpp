@@ -0,0 +1,293 @@
+﻿// Per-call cost of the functions on the per-frame and per-packet paths, each
+// swept over the parameter that drives it:
+//   convert   - FFmpegEncoder::prepareVideoFrame, from its own
+//               glint_encode_convert_us timer, per resolution
+//   audio     - FFmpegEncoder::pushAudioF32 (resample, FIFO, AAC), per
+//               samples pushed at once
+//   mux_write - MuxerAvFormat::write, per video bitrate
+//   extradata - MuxerAvFormat::extractH264ExtradataFromAnnexB on one
+//               keyframe, per video bitrate
+//   db_insert - DB::insertChunk, per rows in one transaction (time per row)
+//   rpc       - rpc::handle_command parse and dispatch, per command
+//
+// usage: glintd_micro_bench [work_dir] [case]
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "db.h"
+#include "ff/encoder_ffmpeg.h"
+#include "ff/muxer_avformat.h"
+#include "logger.h"
+#include "metrics.h"
+#include "replay_buffer.h"
+#include "rpc/handlers.h"
+
+namespace {
+
+struct Resolution {
+    int width;
+    int height;
+};
+
+constexpr Resolution kResolutions[] = {{1280, 720}, {1920, 1080}, {2560, 1440}, {3840, 2160}};
+constexpr int kBitratesKbps[] = {6000, 12000, 24000, 50000};
+constexpr int kAudioBatches[] = {128, 480, 1024, 4800};
+constexpr int kDbBatches[] = {1, 16, 256};
+constexpr int kFps = 60;
+constexpr int kGopFrames = 2 * kFps;
+constexpr int kSampleRate = 48000;
+constexpr int kChannels = 2;
+
+constexpr int kConvertFrames = 120;
+constexpr int kAudioSeconds = 10;
+constexpr int kMuxPackets = 10 * kFps;
+constexpr int kExtradataRuns = 2000;
+constexpr int kDbRows = 4096;
+constexpr int kRpcCalls = 20000;
+
+using Clock = std::chrono::steady_clock;
+
+// Latencies are recorded in nanoseconds and printed in microseconds.
+void printRow(std::string_view name, const std::string& param, const HistogramSnapshot& h) {
+    const double mean = h.count ? static_cast<double>(h.sum) / h.count : 0.0;
+    std::cout << std::format("{},{},{},{:.3f},{:.3f},{:.3f}\n", name, param, h.count, mean / 1000.0,
+                             h.quantile(0.50) / 1000.0, h.quantile(0.99) / 1000.0);
+}
+
+uint64_t elapsedNs(Clock::time_point since) {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - since).count());
+}
+
+// BGRX noise, so neither the converter nor the encoder sees flat input.
+std::vector<uint8_t> noiseFrame(int width, int height) {
+    std::vector<uint8_t> pixels(static_cast<std::size_t>(width) * height * 4);
+    uint32_t state = 0x9E3779B9u;
+    for (std::size_t i = 0; i < pixels.size(); ++i) {
+        state = state * 1664525u + 1013904223u;
+        pixels[i] = static_cast<uint8_t>(state >> 24);
+    }
+    return pixels;
+}
+
+std::string resolutionName(const Resolution& r) {
+    return std::format("{}x{}", r.width, r.height);
+}
+
+void benchConvert(const std::string& codec) {
+    Histogram& convert = MetricsRegistry::instance().histogram("glint_encode_convert_us");
+    for (const auto& res : kResolutions) {
+        FFmpegEncoder encoder;
+        if (!encoder.initVideo(codec, res.width, res.height, kFps, 12000) || !encoder.open()) {
+            std::cerr << std::format("convert: cannot open {} at {}\n", codec, resolutionName(res));
+            continue;
+        }
+        const auto pixels = noiseFrame(res.width, res.height);
+        std::vector<EncodedPacket> packets;
+        const HistogramSnapshot before = convert.snapshot();
+        for (int i = 0; i < kConvertFrames; ++i) {
+            encoder.pushVideo(pixels.data(), PixelFormat::BGRX, res.width, res.height, res.width * 4,
+                              static_cast<uint64_t>(i) * 1000 / kFps);
+            encoder.pull(packets);
+            packets.clear();
+        }
+        // The encoder's own timer counts microseconds.
+        const HistogramSnapshot delta = convert.snapshot().since(before);
+        const double mean = delta.count ? static_cast<double>(delta.sum) / delta.count : 0.0;
+        std::cout << std::format("convert,{},{},{:.3f},{},{}\n", resolutionName(res), delta.count, mean,
+                                 delta.quantile(0.50), delta.quantile(0.99));
+        encoder.close();
+    }
+}
+
+void benchAudio() {
+    for (const int batch : kAudioBatches) {
+        FFmpegEncoder encoder;
+        if (!encoder.initAudio("aac", kSampleRate, kChannels, 192, false) || !encoder.open()) {
+            std::cerr << "audio: cannot open aac\n";
+            return;
+        }
+        std::vector<float> samples(static_cast<std::size_t>(batch) * kChannels);
+        for (int i = 0; i < batch; ++i) {
+            const float v = 0.25f * static_cast<float>(std::sin(2.0 * 3.14159265358979 * 440.0 * i / kSampleRate));
+            samples[static_cast<std::size_t>(i) * kChannels] = v;
+            samples[static_cast<std::size_t>(i) * kChannels + 1] = v;
+        }
+        auto timings = std::make_unique<Histogram>();
+        std::vector<EncodedPacket> packets;
+        const int calls = kAudioSeconds * kSampleRate / batch;
+        for (int i = 0; i < calls; ++i) {
+            const auto started = Clock::now();
+            encoder.pushAudioF32(samples.data(), batch, kSampleRate, kChannels,
+                                 static_cast<uint64_t>(i) * batch * 1000 / kSampleRate, false);
+            encoder.pull(packets);
+            timings->record(elapsedNs(started));
+            packets.clear();
+        }
+        printRow("audio", std::to_string(batch), timings->snapshot());
+        encoder.close();
+    }
+}
+
+// Packet sizes for the bitrate, with a keyframe every kGopFrames worth ten
+// delta frames.
+std::pair<std::size_t, std::size_t> packetSizes(int bitrateKbps) {
+    const std::size_t gopBytes = static_cast<std::size_t>(bitrateKbps) * 1000 / 8 * kGopFrames / kFps;
+    const std::size_t frame = gopBytes / (kGopFrames - 1 + 10);
+    return {frame * 10, frame};
+}
+
+void benchMuxWrite(const std::filesystem::path& dir) {
+    for (const int bitrate : kBitratesKbps) {
+        MuxerConfig cfg;
+        cfg.container = "matroska";
+        cfg.path = dir / std::format("mux_{}.mkv", bitrate);
+        cfg.two_audio_tracks = false;
+
+        EncoderStreamInfo video;
+        video.type = EncodedStreamType::Video;
+        video.codec_name = "mpeg4";
+        video.width = 1920;
+        video.height = 1080;
+        video.fps = kFps;
+
+        MuxerAvFormat muxer;
+        if (!muxer.open(cfg, video, {}, {})) {
+            std::cerr << "mux_write: cannot open muxer\n";
+            return;
+        }
+        // No start codes in the payload, so nothing tries to parse it.
+        const auto [keyframeBytes, frameBytes] = packetSizes(bitrate);
+        const std::vector<uint8_t> keyPayload(keyframeBytes, 0xA5);
+        const std::vector<uint8_t> framePayload(frameBytes, 0x5A);
+        const auto keyframe = PacketBuffer::copyOf(keyPayload.data(), keyPayload.size());
+        const auto frame = PacketBuffer::copyOf(framePayload.data(), framePayload.size());
+
+        auto timings = std::make_unique<Histogram>();
+        for (int i = 0; i < kMuxPackets; ++i) {
+            EncodedPacket pkt;
+            pkt.type = EncodedStreamType::Video;
+            pkt.pts = pkt.dts = static_cast<int64_t>(i) * 1000 / kFps;
+            pkt.keyframe = i % kGopFrames == 0;
+            pkt.data = pkt.keyframe ? keyframe : frame;
+            const auto started = Clock::now();
+            muxer.write(pkt);
+            timings->record(elapsedNs(started));
+        }
+        muxer.close();
+        printRow("mux_write", std::to_string(bitrate), timings->snapshot());
+    }
+}
+
+void benchExtradata() {
+    static constexpr uint8_t kSps[] = {0x00, 0x00, 0x00, 0x01, 0x67, 0x64, 0x00, 0x28, 0xAC, 0xD9, 0x40, 0x78,
+                                       0x02, 0x27, 0xE5, 0xC0, 0x44, 0x00, 0x00, 0x03, 0x00, 0x04, 0x00, 0x00,
+                                       0x03, 0x00, 0xF1, 0x83, 0x19, 0x60};
+    static constexpr uint8_t kPps[] = {0x00, 0x00, 0x00, 0x01, 0x68, 0xEB, 0xE3, 0xCB, 0x22, 0xC0};
+    static constexpr uint8_t kIdr[] = {0x00, 0x00, 0x00, 0x01, 0x65};
+    for (const int bitrate : kBitratesKbps) {
+        std::vector<uint8_t> keyframe(std::begin(kSps), std::end(kSps));
+        keyframe.insert(keyframe.end(), std::begin(kPps), std::end(kPps));
+        keyframe.insert(keyframe.end(), std::begin(kIdr), std::end(kIdr));
+        keyframe.resize(keyframe.size() + packetSizes(bitrate).first, 0xA5);
+
+        auto timings = std::make_unique<Histogram>();
+        std::size_t found = 0;
+        for (int i = 0; i < kExtradataRuns; ++i) {
+            const auto started = Clock::now();
+            found += MuxerAvFormat::extractH264ExtradataFromAnnexB(keyframe.data(), static_cast<int>(keyframe.size())).size();
+            timings->record(elapsedNs(started));
+        }
+        if (found == 0) {
+            std::cerr << "extradata: SPS/PPS not found\n";
+        }
+        printRow("extradata", std::to_string(bitrate), timings->snapshot());
+    }
+}
+
+void benchDbInsert() {
+    DB& db = DB::instance();
+    auto session = db.createSession("bench", 0, "matroska");
+    if (!session) {
+        std::cerr << std::format("db_insert: {}\n", session.error());
+        return;
+    }
+    const int sessionId = static_cast<int>(session.value());
+    int64_t next = 0;
+    for (const int batch : kDbBatches) {
+        auto timings = std::make_unique<Histogram>();
+        for (int done = 0; done < kDbRows; done += batch) {
+            const auto started = Clock::now();
+            auto txn = db.transaction();
+            for (int i = 0; i < batch; ++i, ++next) {
+                const int64_t startMs = next * 2000;
+                db.insertChunk(sessionId, std::format("/tmp/session/chunk_{:06}.mkv", next), startMs,
+                               startMs + 1999, startMs);
+            }
+            if (txn) {
+                txn.value().commit();
+            }
+            timings->record(elapsedNs(started) / static_cast<uint64_t>(batch));
+        }
+        printRow("db_insert", std::to_string(batch), timings->snapshot());
+    }
+}
+
+void benchRpc() {
+    ReplayBuffer replay;
+    const glintd::rpc::Context ctx{&replay};
+    const std::pair<const char*, const char*> commands[] = {
+        {"version", R"({"cmd":"version"})"},
+        {"status", R"({"cmd":"status"})"},
+        {"clip_status", R"({"cmd":"clip_status","job":42})"},
+        {"stats", R"({"cmd":"stats"})"},
+        {"list_sessions", R"({"cmd":"list_sessions"})"},
+    };
+    for (const auto& [name, line] : commands) {
+        const std::string request = line;
+        auto timings = std::make_unique<Histogram>();
+        for (int i = 0; i < kRpcCalls; ++i) {
+            const auto started = Clock::now();
+            glintd::rpc::handle_command(request, ctx);
+            timings->record(elapsedNs(started));
+        }
+        printRow("rpc", name, timings->snapshot());
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const std::filesystem::path dir = argc > 1 ? argv[1] : std::filesystem::temp_directory_path() / "glintd_micro_bench";
+    const std::string only = argc > 2 ? argv[2] : "";
+    std::filesystem::create_directories(dir);
+    Logger::instance().setLevel(LogLevel::Warn);
+    for (const char* name : {"micro.db", "micro.db-wal", "micro.db-shm"}) {
+        std::filesystem::remove(dir / name);
+    }
+    DB::instance().setCustomPath(dir / "micro.db");
+    if (auto res = DB::instance().open(); !res) {
+        std::cerr << res.error() << "\n";
+        return 1;
+    }
+
+    auto selected = [&](std::string_view name) { return only.empty() || only == name; };
+    std::cout << "case,param,iterations,mean_us,p50_us,p99_us\n";
+    if (selected("convert")) benchConvert("libx264");
+    if (selected("audio")) benchAudio();
+    if (selected("mux_write")) benchMuxWrite(dir);
+    if (selected("extradata")) benchExtradata();
+    if (selected("db_insert")) benchDbInsert();
+    // Last: list_sessions reads the DB the insert case filled.
+    if (selected("rpc")) benchRpc();
+    return 0;
+}
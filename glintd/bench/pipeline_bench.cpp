@@ -0,0 +1,416 @@
+﻿// End-to-end recording pipeline: synthetic capture -> FFmpegEncoder ->
+// MuxerAvFormat -> Recorder segment rotation -> DB chunk rows -> one clip
+// export, wired the way glintd wires it (CaptureBase + ReplayBuffer).
+//
+// After a warm-up the run is measured for a fixed time. It reports sustained
+// fps, p50/p99 of every pipeline stage histogram over the measured window,
+// process CPU and operator-new calls per encoded frame, and the muxer bytes
+// written in that window. The report is printed as JSON and compared against
+// a baseline: fps may not drop, and every other metric may not grow, by more
+// than the baseline's tolerance. The exit code is 1 on a regression or a
+// failed clip export, 2 when the baseline was recorded with another workload.
+// No baseline is shipped: record bench/pipeline_baseline.json with
+// --update-baseline on the reference machine. A missing baseline, or metrics
+// it has no value for, are reported as such; with --check (the CI gate) that
+// exits with 3, so an unrecorded baseline never passes.
+//
+// usage: glintd_bench [--work-dir DIR] [--seconds N] [--warmup N] [--size WxH]
+//                     [--fps N] [--bitrate KBPS] [--codec NAME] [--motion F]
+//                     [--unthrottled] [--baseline FILE] [--update-baseline]
+//                     [--check] [--out FILE]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#if defined(GLINT_WINDOWS)
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "capture_base.h"
+#include "db.h"
+#include "ff/encoder_ffmpeg.h"
+#include "ff/muxer_avformat.h"
+#include "logger.h"
+#include "metrics.h"
+#include "replay_buffer.h"
+
+namespace {
+
+std::atomic<uint64_t> g_allocations{0};
+
+} // namespace
+
+// Counts heap allocations made through operator new; FFmpeg's av_malloc
+// bypasses it, so this tracks our own per-frame allocations only.
+void* operator new(std::size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+namespace {
+
+constexpr auto kSegmentLength = std::chrono::milliseconds(2000);
+constexpr int64_t kClipMs = 5000;
+constexpr auto kClipTimeout = std::chrono::seconds(60);
+constexpr double kDefaultTolerance = 0.10;
+
+struct Workload {
+    int width{1920};
+    int height{1080};
+    int fps{60};
+    int bitrate_kbps{12000};
+    std::string codec{"libx264"};
+    double motion{0.25};
+    bool realtime{true};
+    int seconds{20};
+    int warmup{2};
+
+    [[nodiscard]] nlohmann::json toJson() const {
+        return {{"width", width}, {"height", height}, {"fps", fps}, {"bitrate_kbps", bitrate_kbps},
+                {"codec", codec}, {"motion", motion}, {"realtime", realtime}, {"seconds", seconds}};
+    }
+};
+
+// Stage name in the report -> histogram it is read from.
+constexpr std::pair<const char*, const char*> kStages[] = {
+    {"frame_wait", "glint_recorder_frame_wait_us"},
+    {"convert", "glint_encode_convert_us"},
+    {"encode", "glint_recorder_encode_us"},
+    {"packet_wait", "glint_recorder_packet_wait_us"},
+    {"mux_batch", "glint_recorder_mux_us"},
+    {"mux_write", "glint_mux_write_us"},
+    {"rotation", "glint_recorder_rotation_us"},
+    {"segment_finalize", "glint_recorder_segment_finalize_us"},
+    {"db_write", "glint_db_write_us"},
+    {"db_commit", "glint_db_commit_us"},
+};
+
+class BenchCapture : public CaptureBase {
+public:
+    using CaptureBase::CaptureBase;
+
+protected:
+    // Only the synthetic source is used, so the platform hooks stay empty.
+    std::unique_ptr<IVideoCapture> createVideoCapture(const CaptureInitOptions&) override { return nullptr; }
+    std::unique_ptr<IAudioCapture> createSystemAudioCapture(const CaptureInitOptions&) override { return nullptr; }
+    std::unique_ptr<IAudioCapture> createMicrophoneCapture(const CaptureInitOptions&) override { return nullptr; }
+    std::unique_ptr<IEncoder> createEncoder() override { return std::make_unique<FFmpegEncoder>(); }
+    std::unique_ptr<IMuxer> createMuxer() override { return std::make_unique<MuxerAvFormat>(); }
+};
+
+struct Sample {
+    std::chrono::steady_clock::time_point at;
+    double cpu_seconds{0.0};
+    uint64_t allocations{0};
+    uint64_t frames{0};
+    uint64_t dropped{0};
+    uint64_t segments{0};
+    uint64_t bytes_written{0};
+    std::vector<HistogramSnapshot> stages;
+};
+
+double processCpuSeconds() {
+#if defined(GLINT_WINDOWS)
+    FILETIME created, exited, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user)) {
+        return 0.0;
+    }
+    auto toSeconds = [](const FILETIME& ft) {
+        ULARGE_INTEGER v;
+        v.LowPart = ft.dwLowDateTime;
+        v.HighPart = ft.dwHighDateTime;
+        return static_cast<double>(v.QuadPart) / 1e7;
+    };
+    return toSeconds(kernel) + toSeconds(user);
+#else
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    auto toSeconds = [](const timeval& tv) { return static_cast<double>(tv.tv_sec) + tv.tv_usec / 1e6; };
+    return toSeconds(usage.ru_utime) + toSeconds(usage.ru_stime);
+#endif
+}
+
+Sample takeSample(const Recorder& recorder) {
+    auto& registry = MetricsRegistry::instance();
+    Sample sample;
+    sample.at = std::chrono::steady_clock::now();
+    sample.cpu_seconds = processCpuSeconds();
+    sample.allocations = g_allocations.load(std::memory_order_relaxed);
+    const RecorderPipelineStats stats = recorder.pipelineStats();
+    sample.frames = stats.encode.count;
+    sample.dropped = stats.video_frames_dropped;
+    sample.bytes_written = recorder.outputStats().bytes_written;
+    sample.segments = registry.counter("glint_recorder_segments_total").value();
+    for (const auto& [stage, metric] : kStages) {
+        sample.stages.push_back(registry.histogram(metric).snapshot());
+    }
+    return sample;
+}
+
+bool lowerIsBetter(std::string_view metric) {
+    return metric != "fps";
+}
+
+// Flattened "stage.p99_us"-style keys so the baseline stays a flat map.
+nlohmann::json flatten(const nlohmann::json& report) {
+    nlohmann::json flat = nlohmann::json::object();
+    for (const auto& [key, value] : report["metrics"].items()) {
+        flat[key] = value;
+    }
+    for (const auto& [stage, values] : report["stages"].items()) {
+        flat[stage + ".p50_us"] = values["p50_us"];
+        flat[stage + ".p99_us"] = values["p99_us"];
+    }
+    return flat;
+}
+
+constexpr int kExitNoBaseline = 3;
+
+// Returns the exit code: 0 within tolerance, 1 on a regression, 2 when the
+// baseline describes another workload, kExitNoBaseline under |check| when
+// some metric has no baseline value.
+int compareToBaseline(const nlohmann::json& report, const nlohmann::json& baseline,
+                      const std::filesystem::path& baselinePath, bool check) {
+    if (baseline.value("workload", nlohmann::json::object()) != report["workload"]) {
+        std::cerr << std::format("baseline workload {} does not match this run {}\n",
+                                 baseline.value("workload", nlohmann::json::object()).dump(),
+                                 report["workload"].dump());
+        return 2;
+    }
+    const double tolerance = baseline.value("tolerance", kDefaultTolerance);
+    const nlohmann::json current = flatten(report);
+    int regressions = 0;
+    std::size_t unrecorded = 0;
+    std::size_t compared = 0;
+    for (const auto& [key, expected] : baseline.value("metrics", nlohmann::json::object()).items()) {
+        if (!expected.is_number()) {
+            std::cerr << std::format("{:<28} NO BASELINE\n", key);
+            ++unrecorded;
+            continue;
+        }
+        if (!current.contains(key) || !current[key].is_number()) {
+            continue; // not measured in this run
+        }
+        ++compared;
+        const double base = expected.get<double>();
+        const double now = current[key].get<double>();
+        // Tiny latencies jitter by whole buckets; ignore anything under 1 us.
+        const double slack = std::max(std::abs(base) * tolerance, 1.0);
+        const bool worse = lowerIsBetter(key) ? now > base + slack : now < base - slack;
+        std::cerr << std::format("{:<28} baseline {:>12.2f}  now {:>12.2f}  {}\n", key, base, now,
+                                 worse ? "REGRESSION" : "ok");
+        regressions += worse ? 1 : 0;
+    }
+    if (unrecorded > 0 || compared == 0) {
+        std::cerr << std::format("NO BASELINE: {} metric(s) in {} have no recorded value, {} compared; "
+                                 "record them with --update-baseline on the reference machine\n",
+                                 unrecorded, baselinePath.string(), compared);
+        if (check && regressions == 0) {
+            return kExitNoBaseline;
+        }
+    }
+    return regressions > 0 ? 1 : 0;
+}
+
+nlohmann::json makeBaseline(const nlohmann::json& report, double tolerance) {
+    return {{"workload", report["workload"]}, {"tolerance", tolerance}, {"metrics", flatten(report)}};
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / "glintd_bench";
+    std::filesystem::path baselinePath = std::filesystem::path(GLINT_BENCH_SOURCE_DIR) / "pipeline_baseline.json";
+    std::filesystem::path outPath;
+    bool updateBaseline = false;
+    bool check = false;
+    Workload workload;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+        const char* next = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (arg == "--unthrottled") {
+            workload.realtime = false;
+        } else if (arg == "--update-baseline") {
+            updateBaseline = true;
+        } else if (arg == "--check") {
+            check = true;
+        } else if (next == nullptr) {
+            std::cerr << std::format("missing value for {}\n", arg);
+            return 2;
+        } else if (arg == "--work-dir") {
+            dir = argv[++i];
+        } else if (arg == "--seconds") {
+            workload.seconds = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--warmup") {
+            workload.warmup = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--size") {
+            if (std::sscanf(argv[++i], "%dx%d", &workload.width, &workload.height) != 2) {
+                std::cerr << "--size expects WxH\n";
+                return 2;
+            }
+        } else if (arg == "--fps") {
+            workload.fps = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--bitrate") {
+            workload.bitrate_kbps = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--codec") {
+            workload.codec = argv[++i];
+        } else if (arg == "--motion") {
+            workload.motion = std::atof(argv[++i]);
+        } else if (arg == "--baseline") {
+            baselinePath = argv[++i];
+        } else if (arg == "--out") {
+            outPath = argv[++i];
+        } else {
+            std::cerr << std::format("unknown option {}\n", arg);
+            return 2;
+        }
+    }
+
+    Logger::instance().setLevel(LogLevel::Warn);
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+    DB::instance().setCustomPath(dir / "glintd.db");
+    if (auto res = DB::instance().open(); !res) {
+        std::cerr << res.error() << "\n";
+        return 1;
+    }
+
+    CaptureInitOptions options;
+    options.target_fps = workload.fps;
+    options.source = CaptureSource::Synthetic;
+    options.synthetic_motion = workload.motion;
+    options.source_realtime = workload.realtime;
+    options.recorder.width = workload.width;
+    options.recorder.height = workload.height;
+    options.recorder.fps = workload.fps;
+    options.recorder.video_bitrate_kbps = workload.bitrate_kbps;
+    options.recorder.video_codec = workload.codec;
+    options.recorder.enable_microphone_audio = false;
+    options.recorder.buffer_directory = dir / "buffer";
+    options.recorder.recordings_directory = dir / "recordings";
+    options.recorder.segment_length = kSegmentLength;
+
+    ReplayBuffer::Options bufferOptions;
+    bufferOptions.segment_root = options.recorder.buffer_directory;
+    bufferOptions.output_directory = options.recorder.recordings_directory;
+    bufferOptions.temp_directory = dir / "temp";
+
+    BenchCapture capture(options);
+    ReplayBuffer replay(bufferOptions);
+    if (!capture.init()) {
+        std::cerr << "capture init failed\n";
+        return 1;
+    }
+    replay.attachRecorder(&capture.recorder());
+    if (!replay.start_session("bench") || !capture.start()) {
+        std::cerr << "session start failed\n";
+        return 1;
+    }
+
+    std::this_thread::sleep_for(std::chrono::seconds(workload.warmup));
+    const Sample before = takeSample(capture.recorder());
+    std::this_thread::sleep_for(std::chrono::seconds(workload.seconds));
+    const Sample after = takeSample(capture.recorder());
+
+    // The clip covers the tail of the measured window and is cut from the
+    // chunk rows the session has written so far.
+    int64_t clipMs = -1;
+    if (auto ticket = replay.clip_that(kClipMs, 0, dir / "clip.mkv")) {
+        const auto deadline = std::chrono::steady_clock::now() + kClipTimeout;
+        while (std::chrono::steady_clock::now() < deadline) {
+            auto status = replay.clip_status(ticket->id);
+            if (status && status->state == ClipState::Done) {
+                clipMs = status->result.elapsed_ms;
+                break;
+            }
+            if (status && status->state == ClipState::Failed) {
+                std::cerr << std::format("clip export failed: {}\n", status->error);
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+    }
+    capture.stop();
+    const auto stopped = std::chrono::steady_clock::now();
+    replay.stop_session();
+    replay.waitForFinalize();
+    const auto finalizeMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - stopped).count();
+
+    const double elapsed = std::chrono::duration<double>(after.at - before.at).count();
+    const uint64_t frames = after.frames - before.frames;
+    const double perFrame = frames > 0 ? 1.0 / static_cast<double>(frames) : 0.0;
+
+    nlohmann::json stages = nlohmann::json::object();
+    for (std::size_t i = 0; i < std::size(kStages); ++i) {
+        const HistogramSnapshot delta = after.stages[i].since(before.stages[i]);
+        stages[kStages[i].first] = {{"count", delta.count},
+                                    {"p50_us", delta.quantile(0.50)},
+                                    {"p99_us", delta.quantile(0.99)}};
+    }
+
+    nlohmann::json report;
+    report["workload"] = workload.toJson();
+    report["metrics"] = {
+        {"fps", elapsed > 0.0 ? static_cast<double>(frames) / elapsed : 0.0},
+        {"dropped_frames", after.dropped - before.dropped},
+        {"cpu_us_per_frame", (after.cpu_seconds - before.cpu_seconds) * 1e6 * perFrame},
+        {"allocations_per_frame", static_cast<double>(after.allocations - before.allocations) * perFrame},
+        {"bytes_written", after.bytes_written - before.bytes_written},
+        {"segments", after.segments - before.segments},
+        {"clip_export_ms", clipMs},
+        {"finalize_ms", finalizeMs},
+    };
+    report["stages"] = stages;
+
+    std::cout << report.dump(2) << "\n";
+    if (!outPath.empty()) {
+        std::ofstream(outPath) << report.dump(2) << "\n";
+    }
+
+    if (clipMs < 0) {
+        return 1;
+    }
+    if (updateBaseline) {
+        const nlohmann::json previous = nlohmann::json::parse(std::ifstream(baselinePath), nullptr, false);
+        const double tolerance = previous.is_object() ? previous.value("tolerance", kDefaultTolerance) : kDefaultTolerance;
+        std::ofstream(baselinePath) << makeBaseline(report, tolerance).dump(2) << "\n";
+        std::cerr << std::format("baseline written to {}\n", baselinePath.string());
+        return 0;
+    }
+
+    const nlohmann::json baseline = nlohmann::json::parse(std::ifstream(baselinePath), nullptr, false);
+    if (!baseline.is_object()) {
+        std::cerr << std::format("NO BASELINE at {}; run with --update-baseline to record one\n", baselinePath.string());
+        return check ? kExitNoBaseline : 0;
+    }
+    return compareToBaseline(report, baseline, baselinePath, check);
+}
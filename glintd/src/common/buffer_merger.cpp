@@ -1,46 +1,12 @@
 ﻿#include "buffer_merger.h"
 
-#include <cstdlib>
+#include <chrono>
 #include <filesystem>
 #include <format>
-#include <fstream>
-#include <sstream>
 #include <string>
 
 #include "logger.h"
 
-BufferMerger::BufferMerger(std::filesystem::path tempDirectory)
-    : temp_directory_(std::move(tempDirectory)) {}
-
-namespace {
-std::string escapePath(const std::filesystem::path& path) {
-    std::string raw = path.string();
-    std::string escaped;
-    escaped.reserve(raw.size());
-    for (char ch : raw) {
-        if (ch == '\'') {
-            escaped += "'\\''";
-        } else {
-            escaped += ch;
-        }
-    }
-    return escaped;
-}
-}
-
-bool BufferMerger::writeConcatFile(const std::vector<SegmentInfo>& segments, const std::filesystem::path& listPath) const {
-    std::ofstream list(listPath, std::ios::trunc);
-    if (!list.is_open()) {
-        Logger::instance().error(std::format("BufferMerger: failed to open concat list {}", listPath.string()));
-        return false;
-    }
-    for (const auto& seg : segments) {
-        auto absPath = std::filesystem::absolute(seg.path);
-        list << "file '" << escapePath(absPath) << "'\n";
-    }
-    return true;
-}
-
 bool BufferMerger::merge(int sessionId, const std::vector<SegmentInfo>& segments, const std::filesystem::path& outputPath) const {
     if (segments.empty()) {
         Logger::instance().warn("BufferMerger: no segments to merge for session " + std::to_string(sessionId));
@@ -48,36 +14,29 @@ bool BufferMerger::merge(int sessionId, const std::vector<SegmentInfo>& segments
     }
 
     std::error_code ec;
-    std::filesystem::create_directories(temp_directory_, ec);
-    if (ec) {
-        Logger::instance().error(std::format("BufferMerger: failed to create temp directory: {}", ec.message()));
-        return false;
-    }
-
-    auto listPath = temp_directory_ / ("session_" + std::to_string(sessionId) + "_concat.txt");
-    if (!writeConcatFile(segments, listPath)) {
-        return false;
-    }
-
     std::filesystem::create_directories(outputPath.parent_path(), ec);
     if (ec) {
         Logger::instance().error(std::format("BufferMerger: failed to create output directory: {}", ec.message()));
-        std::filesystem::remove(listPath);
         return false;
     }
 
-    std::ostringstream cmd;
-    cmd << "ffmpeg -y -f concat -safe 0 -i "
-        << '"' << listPath.string() << '"'
-        << " -map 0 -c copy "
-        << '"' << outputPath.string() << '"';
+    std::vector<std::filesystem::path> inputs;
+    inputs.reserve(segments.size());
+    for (const auto& seg : segments) {
+        inputs.push_back(seg.path);
+    }
+
+    ConcatRemuxer remuxer;
+    remuxer.setProgressCallback(progress_cb_);
+    remuxer.setCancelFlag(cancel_);
 
-    Logger::instance().info(std::format("BufferMerger: executing {}", cmd.str()));
-    int result = std::system(cmd.str().c_str());
-    std::filesystem::remove(listPath, ec);
-    if (result != 0) {
-        Logger::instance().error(std::format("BufferMerger: ffmpeg returned code {}", result));
+    const auto started = std::chrono::steady_clock::now();
+    if (!remuxer.remux(inputs, outputPath)) {
+        Logger::instance().error(std::format("BufferMerger: session {} remux failed: {}", sessionId, remuxer.lastError()));
         return false;
     }
+    const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started);
+    Logger::instance().info(std::format("BufferMerger: remuxed {} segments into {} in {} ms",
+                                        segments.size(), outputPath.string(), elapsed.count()));
     return true;
 }
\ No newline at end of file
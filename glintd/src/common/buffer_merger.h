@@ -1,18 +1,24 @@
 ﻿#pragma once
 
+#include <atomic>
 #include <filesystem>
 #include <vector>
 
+#include "ff/concat_remuxer.h"
 #include "recorder.h"
 
 class BufferMerger {
 public:
-    explicit BufferMerger(std::filesystem::path tempDirectory);
+    using ProgressCallback = ConcatRemuxer::ProgressCallback;
+
+    BufferMerger() = default;
+
+    void setProgressCallback(ProgressCallback cb) { progress_cb_ = std::move(cb); }
+    void setCancelFlag(const std::atomic<bool>* cancel) { cancel_ = cancel; }
 
     bool merge(int sessionId, const std::vector<SegmentInfo>& segments, const std::filesystem::path& outputPath) const;
 
 private:
-    bool writeConcatFile(const std::vector<SegmentInfo>& segments, const std::filesystem::path& listPath) const;
-
-    std::filesystem::path temp_directory_;
+    ProgressCallback progress_cb_{};
+    const std::atomic<bool>* cancel_{nullptr};
 };
\ No newline at end of file
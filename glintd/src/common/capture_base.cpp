@@ -1,6 +1,16 @@
 ﻿#include "capture_base.h"
 
+#include <algorithm>
+
+#include "ff/audio_capture_ffmpeg.h"
+#include "ff/file_replay_capture.h"
 #include "logger.h"
+#include "synthetic_capture.h"
+
+namespace {
+constexpr double kSystemToneHz = 440.0;
+constexpr double kMicrophoneToneHz = 880.0;
+}
 
 CaptureBase::CaptureBase(CaptureInitOptions options)
     : options_(std::move(options)) {}
@@ -12,7 +22,12 @@ CaptureBase::~CaptureBase() {
 bool CaptureBase::init() {
     std::scoped_lock lock(recorder_mutex_);
     if (!video_) {
-        video_ = createVideoCapture(options_);
+        // Queued frames keep their pool buffers, so the pool has to cover the
+        // whole queue plus the frame being encoded and the one being captured.
+        CaptureInitOptions videoOptions = options_;
+        videoOptions.frame_pool_size = std::max(videoOptions.frame_pool_size,
+                                                videoOptions.recorder.video_queue_depth + 2);
+        video_ = createVideoSource(videoOptions);
         if (!video_) {
             Logger::instance().error("CaptureBase: failed to create video capture");
             return false;
@@ -20,7 +35,7 @@ bool CaptureBase::init() {
     }
     if (options_.recorder.enable_system_audio) {
         if (!system_audio_) {
-            system_audio_ = createSystemAudioCapture(options_);
+            system_audio_ = createAudioSource(options_, false);
             if (!system_audio_) {
                 Logger::instance().error("CaptureBase: failed to create system audio capture");
                 return false;
@@ -31,7 +46,7 @@ bool CaptureBase::init() {
     }
     if (options_.recorder.enable_microphone_audio) {
         if (!mic_audio_) {
-            mic_audio_ = createMicrophoneCapture(options_);
+            mic_audio_ = createAudioSource(options_, true);
             if (!mic_audio_) {
                 Logger::instance().warn("CaptureBase: failed to create microphone capture");
             }
@@ -41,7 +56,7 @@ bool CaptureBase::init() {
     }
 
     if (!recorder_) {
-        recorder_ = std::make_unique<Recorder>(createEncoder(), createMuxer());
+        recorder_ = std::make_unique<Recorder>(createEncoder(), createMuxer(), [this] { return createMuxer(); });
         if (!recorder_->initialize(options_.recorder)) {
             Logger::instance().error("CaptureBase: failed to initialize recorder");
             recorder_.reset();
@@ -57,7 +72,7 @@ bool CaptureBase::start() {
         return true;
     }
 
-    if (!recorder_) {
+    if (!recorder_ || !video_) {
         if (!init()) {
             running_ = false;
             return false;
@@ -126,12 +141,28 @@ void CaptureBase::setRecorderConfig(const RecorderConfig& config) {
 
 void CaptureBase::setCaptureOptions(const CaptureInitOptions& options) {
     std::scoped_lock lock(recorder_mutex_);
+    const bool sourceChanged = options.source != options_.source || options.source_file != options_.source_file ||
+                               options.source_realtime != options_.source_realtime;
     options_ = options;
+    if (!running_) {
+        video_.reset();
+        // A generated or replayed video source comes back with a new
+        // timeline, and its audio sources have to follow that one.
+        if (sourceChanged || options_.source != CaptureSource::Screen) {
+            system_audio_.reset();
+            mic_audio_.reset();
+        }
+    }
     if (recorder_) {
         recorder_->initialize(options_.recorder);
     }
 }
 
+CaptureInitOptions CaptureBase::captureOptions() {
+    std::scoped_lock lock(recorder_mutex_);
+    return options_;
+}
+
 void CaptureBase::applyRuntimeOptions(const CaptureRuntimeOptions& opts) {
     std::scoped_lock lock(recorder_mutex_);
     runtime_ = opts;
@@ -143,21 +174,64 @@ void CaptureBase::applyRuntimeOptions(const CaptureRuntimeOptions& opts) {
 Recorder& CaptureBase::recorder() {
     std::scoped_lock lock(recorder_mutex_);
     if (!recorder_) {
-        recorder_ = std::make_unique<Recorder>(createEncoder(), createMuxer());
+        recorder_ = std::make_unique<Recorder>(createEncoder(), createMuxer(), [this] { return createMuxer(); });
         recorder_->initialize(options_.recorder);
     }
     return *recorder_;
 }
 
+std::unique_ptr<IVideoCapture> CaptureBase::createVideoSource(const CaptureInitOptions& options) {
+    if (options.source == CaptureSource::Screen) {
+        timeline_.reset();
+        return createVideoCapture(options);
+    }
+    // Audio sources are created after this and share the timeline.
+    timeline_ = std::make_shared<CaptureTimeline>(options.source_realtime);
+    if (options.source == CaptureSource::File) {
+        FileReplayOptions replay;
+        replay.path = options.source_file;
+        replay.pool_size = options.frame_pool_size;
+        return std::make_unique<FileReplayVideoCapture>(std::move(replay), timeline_);
+    }
+    SyntheticVideoOptions synthetic;
+    synthetic.width = options.recorder.width;
+    synthetic.height = options.recorder.height;
+    synthetic.fps = options.recorder.fps;
+    synthetic.motion = options.synthetic_motion;
+    synthetic.pool_size = options.frame_pool_size;
+    return std::make_unique<SyntheticVideoCapture>(synthetic, timeline_);
+}
+
+std::unique_ptr<IAudioCapture> CaptureBase::createAudioSource(const CaptureInitOptions& options, bool isMic) {
+    if (options.source == CaptureSource::Screen || !timeline_) {
+        return isMic ? createMicrophoneCapture(options) : createSystemAudioCapture(options);
+    }
+    // A replayed file provides the system track; the microphone track is a tone.
+    if (options.source == CaptureSource::File && !isMic) {
+        FFmpegAudioCaptureOptions replay;
+        replay.device_candidates = {options.source_file.string()};
+        replay.sample_rate = options.recorder.audio_sample_rate;
+        replay.channels = options.recorder.audio_channels;
+        replay.is_microphone = false;
+        replay.log_prefix = "FileReplayAudio";
+        replay.timeline = timeline_;
+        replay.loop = true;
+        return std::make_unique<FFmpegAudioCapture>(std::move(replay));
+    }
+    return std::make_unique<SyntheticAudioCapture>(isMic, options.recorder.audio_sample_rate,
+                                                   options.recorder.audio_channels,
+                                                   isMic ? kMicrophoneToneHz : kSystemToneHz, timeline_);
+}
+
+// Capture callbacks run lock-free: recorder_ is only replaced while capture is
+// stopped, and Recorder::push* never block.
 void CaptureBase::onVideoFrame(const VideoFrame& frame) {
-    std::scoped_lock lock(recorder_mutex_);
     if (recorder_) {
         recorder_->pushVideoFrame(frame);
     }
 }
 
 void CaptureBase::onAudioFrame(const AudioFrame& frame, bool isMic) {
-    std::scoped_lock lock(recorder_mutex_);
     if (recorder_) {
         recorder_->pushAudioFrame(frame, isMic);
     }
@@ -2,6 +2,7 @@
 
 #include <atomic>
 #include <cstdint>
+#include <filesystem>
 #include <functional>
 #include <memory>
 #include <mutex>
@@ -9,6 +10,7 @@
 #include <string>
 #include <vector>
 
+#include "capture_timeline.h"
 #include "frame_types.h"
 #include "recorder.h"
 
@@ -33,9 +35,22 @@ struct CaptureRuntimeOptions {
     bool rolling_buffer_enabled{true};
 };
 
+enum class CaptureSource {
+    Screen,    // the platform's screen and audio capture
+    Synthetic, // generated test pattern and tones, see SyntheticVideoCapture
+    File       // a media file replayed as capture input
+};
+
 struct CaptureInitOptions {
     int target_fps{60};
     bool capture_cursor{true};
+    bool use_shared_memory{true}; // X11: MIT-SHM readback, falls back to XGetImage
+    bool use_damage{true};        // X11: XDamage, unchanged frames are repeated without a readback
+    int frame_pool_size{8};       // preallocated VideoFrame buffers per capture source
+    CaptureSource source{CaptureSource::Screen};
+    std::filesystem::path source_file; // CaptureSource::File
+    double synthetic_motion{0.25};     // CaptureSource::Synthetic, share of the picture that moves
+    bool source_realtime{true};        // Synthetic/File: pace at capture rate, or run flat out
     RecorderConfig recorder;
 };
 
@@ -51,6 +66,7 @@ public:
     void applyRuntimeOptions(const CaptureRuntimeOptions& opts);
     void setRecorderConfig(const RecorderConfig& config);
     void setCaptureOptions(const CaptureInitOptions& options);
+    CaptureInitOptions captureOptions();
     bool isRunning() const { return running_.load(); }
 
     Recorder& recorder();
@@ -63,6 +79,8 @@ protected:
     virtual std::unique_ptr<IMuxer> createMuxer() = 0;
 
 private:
+    std::unique_ptr<IVideoCapture> createVideoSource(const CaptureInitOptions& options);
+    std::unique_ptr<IAudioCapture> createAudioSource(const CaptureInitOptions& options, bool isMic);
     void onVideoFrame(const VideoFrame& frame);
     void onAudioFrame(const AudioFrame& frame, bool isMic);
 
@@ -71,6 +89,7 @@ private:
     std::unique_ptr<IVideoCapture> video_;
     std::unique_ptr<IAudioCapture> system_audio_;
     std::unique_ptr<IAudioCapture> mic_audio_;
+    std::shared_ptr<CaptureTimeline> timeline_; // generated and replayed sources only
     std::unique_ptr<Recorder> recorder_;
     std::mutex recorder_mutex_;
     std::atomic<bool> running_{false};
@@ -0,0 +1,61 @@
+﻿#include "capture_timeline.h"
+
+#include <algorithm>
+#include <thread>
+
+namespace {
+constexpr auto kFollowPoll = std::chrono::milliseconds(50);
+
+int64_t steadyMs(std::chrono::steady_clock::time_point tp) {
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(tp.time_since_epoch()).count();
+}
+}
+
+CaptureTimeline::CaptureTimeline(bool realtime)
+    : realtime_(realtime) {
+    restart();
+}
+
+void CaptureTimeline::restart() {
+    std::scoped_lock lock(mutex_);
+    base_ = std::chrono::steady_clock::now();
+    base_ms_ = steadyMs(base_);
+    video_ms_ = 0;
+    stopped_ = false;
+}
+
+void CaptureTimeline::stop() {
+    {
+        std::scoped_lock lock(mutex_);
+        stopped_ = true;
+    }
+    cv_.notify_all();
+}
+
+uint64_t CaptureTimeline::ptsAt(int64_t offsetMs) const noexcept {
+    return static_cast<uint64_t>(base_ms_ + offsetMs);
+}
+
+void CaptureTimeline::pace(int64_t offsetMs) {
+    if (realtime_) {
+        std::this_thread::sleep_until(base_ + std::chrono::milliseconds(offsetMs));
+    }
+    {
+        std::scoped_lock lock(mutex_);
+        video_ms_ = std::max(video_ms_, offsetMs);
+    }
+    cv_.notify_all();
+}
+
+bool CaptureTimeline::follow(int64_t offsetMs, const std::atomic<bool>& running) {
+    if (realtime_) {
+        std::this_thread::sleep_until(base_ + std::chrono::milliseconds(offsetMs));
+        return running.load();
+    }
+    std::unique_lock lock(mutex_);
+    while (!stopped_ && running.load() && video_ms_ < offsetMs) {
+        cv_.wait_for(lock, kFollowPoll);
+    }
+    return !stopped_ && running.load();
+}
@@ -0,0 +1,39 @@
+﻿#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+// Timeline shared by the generated or replayed sources of one capture.
+// Timestamps are exact multiples of the frame/sample period from the moment
+// the video source started, never read from a clock. In real time the sources
+// sleep until each timestamp is due; unthrottled, video runs as fast as the
+// pipeline takes frames and audio follows the video position.
+class CaptureTimeline {
+public:
+    explicit CaptureTimeline(bool realtime);
+
+    // Called by the video source on start; offsets count from here.
+    void restart();
+    void stop();
+
+    [[nodiscard]] bool realtime() const noexcept { return realtime_; }
+    [[nodiscard]] uint64_t ptsAt(int64_t offsetMs) const noexcept;
+
+    // Video: waits until offsetMs is due (real time) and publishes it.
+    void pace(int64_t offsetMs);
+    // Audio: waits until offsetMs is due or video got that far. False once
+    // the timeline is stopped.
+    bool follow(int64_t offsetMs, const std::atomic<bool>& running);
+
+private:
+    const bool realtime_;
+    std::chrono::steady_clock::time_point base_{};
+    int64_t base_ms_{0};
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    int64_t video_ms_{0};
+    bool stopped_{false};
+};
@@ -0,0 +1,288 @@
+﻿#include "clip_exporter.h"
+
+#include <algorithm>
+#include <format>
+#include <system_error>
+
+#include "event_bus.h"
+#include "ff/concat_remuxer.h"
+#include "logger.h"
+
+namespace {
+// How long to wait past to_ms for the covering chunk to be closed.
+constexpr auto kCoverageGrace = std::chrono::seconds(10);
+constexpr auto kCoveragePoll = std::chrono::milliseconds(100);
+constexpr std::size_t kMaxFinishedJobs = 64;
+}
+
+int64_t clipClockNowMs() {
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+ClipExporter::ClipExporter()
+    : ClipExporter([](int sessionId) { return DB::instance().chunksForSession(sessionId); },
+                   [](int64_t chunkId, int64_t ptsMs) { return DB::instance().keyframeAtOrBefore(chunkId, ptsMs); }) {}
+
+ClipExporter::ClipExporter(ChunkSource source, KeyframeLookup keyframes)
+    : source_(std::move(source)), keyframes_(std::move(keyframes)) {}
+
+ClipExporter::~ClipExporter() {
+    {
+        std::scoped_lock lock(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+}
+
+glint::Expected<ClipResult, std::string> ClipExporter::exportClip(const ClipRequest& request,
+                                                                 const ProgressCallback& progress) const {
+    return exportChunks(request, {}, progress);
+}
+
+glint::Expected<ClipResult, std::string> ClipExporter::exportChunks(const ClipRequest& request,
+                                                                    const std::vector<ChunkRecord>& known,
+                                                                    const ProgressCallback& progress) const {
+    const auto started = std::chrono::steady_clock::now();
+    if (request.to_ms <= request.from_ms) {
+        return glint::unexpected(std::string("empty clip range"));
+    }
+
+    const std::vector<ChunkRecord> covering = coveringChunks(request, known);
+    if (covering.empty()) {
+        return glint::unexpected(std::format("no chunks cover {}..{} in session {}",
+                                             request.from_ms, request.to_ms, request.session_id));
+    }
+
+    // Pruning leaves pinned chunks alone until the export is done. One that
+    // went before the pin fails the clip instead of leaving a gap in it.
+    std::vector<std::filesystem::path> paths;
+    paths.reserve(covering.size());
+    for (const auto& chunk : covering) {
+        paths.emplace_back(chunk.path);
+    }
+    const SegmentPins::Pin pin = SegmentPins::instance().pin(paths);
+    for (const auto& path : paths) {
+        std::error_code ec;
+        if (!std::filesystem::exists(path, ec)) {
+            return glint::unexpected(std::format("segment {} was removed before the export", path.string()));
+        }
+    }
+
+    std::vector<RemuxInput> inputs;
+    inputs.reserve(covering.size());
+    for (const auto& chunk : covering) {
+        RemuxInput input{chunk.path};
+        if (request.from_ms > chunk.start_ms) {
+            input.from_ms = request.from_ms - chunk.start_ms;
+            // With an index the cut point is known up front and the remuxer
+            // can jump straight to its GOP.
+            if (keyframes_) {
+                if (auto keyframe = keyframes_(chunk.id, request.from_ms); keyframe && keyframe->byte_offset >= 0) {
+                    if (keyframe->pts_ms > chunk.start_ms) {
+                        input.from_ms = keyframe->pts_ms - chunk.start_ms;
+                        input.from_byte = keyframe->byte_offset;
+                    } else {
+                        input.from_ms.reset();
+                    }
+                }
+            }
+        }
+        if (request.to_ms < chunk.end_ms) {
+            input.to_ms = request.to_ms - chunk.start_ms;
+        }
+        inputs.push_back(std::move(input));
+    }
+
+    std::error_code ec;
+    std::filesystem::create_directories(request.output.parent_path(), ec);
+
+    ConcatRemuxer remuxer;
+    remuxer.setRequireAllInputs(true);
+    if (progress) {
+        remuxer.setProgressCallback([&](const RemuxProgress& p) { progress(p.fraction()); });
+    }
+    if (!remuxer.remux(inputs, request.output)) {
+        return glint::unexpected(remuxer.lastError());
+    }
+
+    ClipResult result;
+    result.path = request.output;
+    result.start_ms = covering.front().start_ms + remuxer.snappedStartMs();
+    result.end_ms = std::min(request.to_ms, covering.back().end_ms);
+    result.segments = covering.size();
+    result.elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - started).count();
+    Logger::instance().info(std::format("ClipExporter: {} ms clip from {} segment(s) -> {} in {} ms",
+                                        result.end_ms - result.start_ms, result.segments,
+                                        result.path.string(), result.elapsed_ms));
+    return result;
+}
+
+std::vector<ChunkRecord> ClipExporter::coveringChunks(const ClipRequest& request,
+                                                      const std::vector<ChunkRecord>& known) const {
+    std::vector<ChunkRecord> covering;
+    auto add = [&](ChunkRecord chunk) {
+        const bool listed = std::any_of(covering.begin(), covering.end(),
+                                        [&](const ChunkRecord& other) { return other.id == chunk.id; });
+        if (!listed && chunk.end_ms >= request.from_ms && chunk.start_ms <= request.to_ms) {
+            covering.push_back(std::move(chunk));
+        }
+    };
+    for (const auto& chunk : known) {
+        add(chunk);
+    }
+    for (auto& chunk : source_(request.session_id)) {
+        add(std::move(chunk));
+    }
+    std::sort(covering.begin(), covering.end(),
+              [](const ChunkRecord& a, const ChunkRecord& b) { return a.start_ms < b.start_ms; });
+    return covering;
+}
+
+uint64_t ClipExporter::submit(ClipRequest request) {
+    WaitingJob job;
+    job.due = Clock::now() + std::chrono::milliseconds(std::max<int64_t>(0, request.to_ms - clipClockNowMs()));
+    job.next_check = job.due;
+    if (!request.from_memory) {
+        job.chunks = coveringChunks(request);
+        std::vector<std::filesystem::path> paths;
+        for (const auto& chunk : job.chunks) {
+            paths.emplace_back(chunk.path);
+        }
+        job.pin = SegmentPins::instance().pin(paths);
+    }
+
+    std::scoped_lock lock(mutex_);
+    const uint64_t id = next_id_++;
+    ClipStatus status;
+    status.request = std::move(request);
+    jobs_.emplace(id, std::move(status));
+    waiting_.emplace(id, std::move(job));
+
+    // Keep a bounded history of finished jobs for status queries.
+    for (auto it = jobs_.begin(); it != jobs_.end() && jobs_.size() > kMaxFinishedJobs;) {
+        it = it->second.state == ClipState::Pending ? std::next(it) : jobs_.erase(it);
+    }
+
+    if (!worker_.joinable()) {
+        worker_ = std::thread(&ClipExporter::workerLoop, this);
+    }
+    cv_.notify_all();
+    return id;
+}
+
+std::optional<ClipStatus> ClipExporter::status(uint64_t id) const {
+    std::scoped_lock lock(mutex_);
+    auto it = jobs_.find(id);
+    if (it == jobs_.end()) {
+        return std::nullopt;
+    }
+    return it->second;
+}
+
+bool ClipExporter::isCovered(const ClipRequest& request) const {
+    const auto chunks = source_(request.session_id);
+    return std::any_of(chunks.begin(), chunks.end(), [&](const ChunkRecord& chunk) {
+        return chunk.end_ms >= request.to_ms;
+    });
+}
+
+// Jobs whose range is not recorded yet stay in waiting_ and are looked at
+// again later, so one long post-roll does not hold up the clips behind it.
+void ClipExporter::workerLoop() {
+    std::unique_lock lock(mutex_);
+    for (;;) {
+        if (stopping_) {
+            return;
+        }
+        const auto now = Clock::now();
+        auto wake = Clock::time_point::max();
+        auto next = waiting_.end();
+        for (auto it = waiting_.begin(); it != waiting_.end(); ++it) {
+            if (it->second.next_check <= now) {
+                next = it;
+                break;
+            }
+            wake = std::min(wake, it->second.next_check);
+        }
+        if (next == waiting_.end()) {
+            if (wake == Clock::time_point::max()) {
+                cv_.wait(lock);
+            } else {
+                cv_.wait_until(lock, wake);
+            }
+            continue;
+        }
+
+        const uint64_t id = next->first;
+        const ClipRequest request = jobs_[id].request;
+        const bool graceOver = now >= next->second.due + kCoverageGrace;
+        lock.unlock();
+        const bool ready = request.from_memory || graceOver || isCovered(request);
+        lock.lock();
+        // Only this thread removes from waiting_, so |next| is still valid.
+        if (!ready) {
+            next->second.next_check = Clock::now() + kCoveragePoll;
+            continue;
+        }
+        SegmentPins::Pin pin = std::move(next->second.pin);
+        const std::vector<ChunkRecord> known = std::move(next->second.chunks);
+        waiting_.erase(next);
+        lock.unlock();
+
+        ClipStatus done = runJob(id, request, known);
+        pin.reset();
+
+        lock.lock();
+        done.request = request;
+        jobs_[id] = std::move(done);
+    }
+}
+
+ClipStatus ClipExporter::runJob(uint64_t id, const ClipRequest& request,
+                                const std::vector<ChunkRecord>& known) const {
+    ClipStatus done;
+    if (request.from_memory) {
+        const auto window = std::chrono::milliseconds(request.to_ms - request.from_ms);
+        if (request.from_memory(request.output, window)) {
+            done.state = ClipState::Done;
+            done.result.path = request.output;
+            done.result.start_ms = request.from_ms;
+            done.result.end_ms = request.to_ms;
+        } else {
+            done.state = ClipState::Failed;
+            done.error = "memory buffer export failed";
+        }
+    } else if (auto res = exportChunks(request, known, [id, lastDecile = -1](double fraction) mutable {
+                   const int decile = static_cast<int>(fraction * 10.0);
+                   if (decile != lastDecile && EventBus::instance().hasSubscribers()) {
+                       lastDecile = decile;
+                       EventBus::instance().publish("clip_progress", {{"job", id}, {"percent", decile * 10}});
+                   }
+               })) {
+        done.state = ClipState::Done;
+        done.result = res.value();
+    } else {
+        done.state = ClipState::Failed;
+        done.error = res.error();
+        Logger::instance().error(std::format("ClipExporter: clip {} failed: {}", id, done.error));
+    }
+
+    if (EventBus::instance().hasSubscribers()) {
+        if (done.state == ClipState::Done) {
+            EventBus::instance().publish("clip_done", {{"job", id},
+                                                       {"path", done.result.path.string()},
+                                                       {"start_ms", done.result.start_ms},
+                                                       {"end_ms", done.result.end_ms},
+                                                       {"segments", done.result.segments},
+                                                       {"elapsed_ms", done.result.elapsed_ms}});
+        } else {
+            EventBus::instance().publish("clip_failed", {{"job", id}, {"error", done.error}});
+        }
+    }
+    return done;
+}
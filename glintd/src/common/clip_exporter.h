@@ -0,0 +1,113 @@
+﻿#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "db.h"
+#include "expected.h"
+#include "segment_pins.h"
+
+// Cuts [from_ms, to_ms] (capture clock, see clipClockNowMs) out of the
+// recorded chunks with stream copy. The start snaps back to the nearest
+// preceding keyframe, so a clip can begin slightly earlier than asked.
+struct ClipRequest {
+    int session_id{-1};
+    int64_t from_ms{0};
+    int64_t to_ms{0};
+    std::filesystem::path output;
+    // Memory-buffered sessions have no chunks; when set, this writes the
+    // window ending now to the given path instead.
+    std::function<bool(const std::filesystem::path&, std::chrono::milliseconds)> from_memory{};
+};
+
+struct ClipResult {
+    std::filesystem::path path;
+    int64_t start_ms{0}; // after keyframe snapping
+    int64_t end_ms{0};
+    std::size_t segments{0};
+    int64_t elapsed_ms{0};
+};
+
+enum class ClipState {
+    Pending,
+    Done,
+    Failed
+};
+
+struct ClipStatus {
+    ClipState state{ClipState::Pending};
+    ClipRequest request{};
+    ClipResult result{};
+    std::string error;
+};
+
+// Same clock the capture sources stamp video frames with.
+int64_t clipClockNowMs();
+
+class ClipExporter {
+public:
+    using ChunkSource = std::function<std::vector<ChunkRecord>(int sessionId)>;
+    // Last indexed keyframe at or before ptsMs in a chunk, if any.
+    using KeyframeLookup = std::function<std::optional<KeyframeRecord>(int64_t chunkId, int64_t ptsMs)>;
+    // Fraction of the input bytes copied so far.
+    using ProgressCallback = std::function<void(double fraction)>;
+
+    ClipExporter();
+    explicit ClipExporter(ChunkSource source, KeyframeLookup keyframes = {});
+    ~ClipExporter();
+
+    ClipExporter(const ClipExporter&) = delete;
+    ClipExporter& operator=(const ClipExporter&) = delete;
+
+    // Exports synchronously from whatever chunks exist right now.
+    glint::Expected<ClipResult, std::string> exportClip(const ClipRequest& request,
+                                                        const ProgressCallback& progress = {}) const;
+
+    // Queues a clip. It is cut once the recording has passed to_ms and the
+    // chunk covering it has been closed (or a grace period ran out); jobs
+    // still waiting for that don't hold up the others. The chunks a job
+    // covers are pinned from here until its export is done.
+    uint64_t submit(ClipRequest request);
+    std::optional<ClipStatus> status(uint64_t id) const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct WaitingJob {
+        Clock::time_point due;        // the recording passes to_ms
+        Clock::time_point next_check; // coverage is polled from due on
+        // Chunks that existed at submit, pinned. Their rows can be pruned
+        // while the job waits; the files stay until the pin goes.
+        std::vector<ChunkRecord> chunks;
+        SegmentPins::Pin pin;
+    };
+
+    // |known| is merged with what the source lists now.
+    std::vector<ChunkRecord> coveringChunks(const ClipRequest& request,
+                                            const std::vector<ChunkRecord>& known = {}) const;
+    bool isCovered(const ClipRequest& request) const;
+    glint::Expected<ClipResult, std::string> exportChunks(const ClipRequest& request,
+                                                          const std::vector<ChunkRecord>& known,
+                                                          const ProgressCallback& progress) const;
+    ClipStatus runJob(uint64_t id, const ClipRequest& request, const std::vector<ChunkRecord>& known) const;
+    void workerLoop();
+
+    ChunkSource source_;
+    KeyframeLookup keyframes_;
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::map<uint64_t, WaitingJob> waiting_; // by id, so the oldest ready job runs first
+    std::map<uint64_t, ClipStatus> jobs_;
+    uint64_t next_id_{1};
+    bool stopping_{false};
+    std::thread worker_;
+};
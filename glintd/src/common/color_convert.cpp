@@ -0,0 +1,442 @@
+﻿#include "color_convert.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define GLINT_CC_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define GLINT_TARGET_SSE41
+#define GLINT_TARGET_AVX2
+#else
+#define GLINT_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define GLINT_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64) || defined(__ARM_NEON)
+#define GLINT_CC_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace {
+// BT.709, full-range RGB in, limited-range YCbCr out, Q15.
+// V's green term is rounded so that grey maps exactly to 128.
+constexpr int kYR = 5983;
+constexpr int kYG = 20127;
+constexpr int kYB = 2032;
+constexpr int kUR = -3298;
+constexpr int kUG = -11094;
+constexpr int kUB = 14392;
+constexpr int kVR = 14392;
+constexpr int kVG = -13072;
+constexpr int kVB = -1320;
+
+constexpr int kYOffset = (16 << 15) + (1 << 14);
+// Chroma is computed from the sum of a 2x2 block, hence the extra 2 bits.
+constexpr int kCOffset = (128 << 17) + (1 << 16);
+
+struct ChromaRow {
+    uint8_t* u{nullptr};
+    uint8_t* v{nullptr};
+    int step{1};           // 2 for NV12 (interleaved), 1 for planar
+    bool interleaved{false};
+};
+
+inline uint8_t clampByte(int value) {
+    return static_cast<uint8_t>(std::clamp(value, 0, 255));
+}
+
+inline uint8_t lumaOf(const uint8_t* px) {
+    return clampByte((kYR * px[2] + kYG * px[1] + kYB * px[0] + kYOffset) >> 15);
+}
+
+// Reference implementation; also handles the tail columns of the SIMD kernels.
+void rowPairScalar(const uint8_t* r0, const uint8_t* r1, uint8_t* y0, uint8_t* y1,
+                   const ChromaRow& c, int x, int width) {
+    for (; x < width; x += 2) {
+        const int x1 = std::min(x + 1, width - 1);
+        const uint8_t* a0 = r0 + x * 4;
+        const uint8_t* a1 = r0 + x1 * 4;
+        const uint8_t* b0 = r1 + x * 4;
+        const uint8_t* b1 = r1 + x1 * 4;
+
+        y0[x] = lumaOf(a0);
+        if (x1 != x) y0[x1] = lumaOf(a1);
+        if (y1) {
+            y1[x] = lumaOf(b0);
+            if (x1 != x) y1[x1] = lumaOf(b1);
+        }
+
+        const int sb = a0[0] + a1[0] + b0[0] + b1[0];
+        const int sg = a0[1] + a1[1] + b0[1] + b1[1];
+        const int sr = a0[2] + a1[2] + b0[2] + b1[2];
+        const int cx = (x / 2) * c.step;
+        c.u[cx] = clampByte((kUR * sr + kUG * sg + kUB * sb + kCOffset) >> 17);
+        c.v[cx] = clampByte((kVR * sr + kVG * sg + kVB * sb + kCOffset) >> 17);
+    }
+}
+
+#if defined(GLINT_CC_X86)
+// 8 pixels per iteration. Pixels are widened to 16 bit so that pmaddwd folds
+// B*cb + G*cg and R*cr + A*0; two horizontal adds then give one value per
+// pixel (luma) or per 2x2 block (chroma, after summing both rows).
+GLINT_TARGET_SSE41 int rowPairSse41(const uint8_t* r0, const uint8_t* r1, uint8_t* y0, uint8_t* y1,
+                                    const ChromaRow& c, int width) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i cY = _mm_setr_epi16(kYB, kYG, kYR, 0, kYB, kYG, kYR, 0);
+    const __m128i cU = _mm_setr_epi16(kUB, kUG, kUR, 0, kUB, kUG, kUR, 0);
+    const __m128i cV = _mm_setr_epi16(kVB, kVG, kVR, 0, kVB, kVG, kVR, 0);
+    const __m128i yOff = _mm_set1_epi32(kYOffset);
+    const __m128i cOff = _mm_set1_epi32(kCOffset);
+    const __m128i uvInterleave = _mm_setr_epi8(0, 4, 1, 5, 2, 6, 3, 7, 8, 12, 9, 13, 10, 14, 11, 15);
+
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        const __m128i a0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r0 + x * 4));
+        const __m128i a1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r0 + x * 4 + 16));
+        const __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r1 + x * 4));
+        const __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r1 + x * 4 + 16));
+
+        const __m128i a0l = _mm_cvtepu8_epi16(a0);
+        const __m128i a0h = _mm_unpackhi_epi8(a0, zero);
+        const __m128i a1l = _mm_cvtepu8_epi16(a1);
+        const __m128i a1h = _mm_unpackhi_epi8(a1, zero);
+        const __m128i b0l = _mm_cvtepu8_epi16(b0);
+        const __m128i b0h = _mm_unpackhi_epi8(b0, zero);
+        const __m128i b1l = _mm_cvtepu8_epi16(b1);
+        const __m128i b1h = _mm_unpackhi_epi8(b1, zero);
+
+        {
+            __m128i lo = _mm_hadd_epi32(_mm_madd_epi16(a0l, cY), _mm_madd_epi16(a0h, cY));
+            __m128i hi = _mm_hadd_epi32(_mm_madd_epi16(a1l, cY), _mm_madd_epi16(a1h, cY));
+            lo = _mm_srai_epi32(_mm_add_epi32(lo, yOff), 15);
+            hi = _mm_srai_epi32(_mm_add_epi32(hi, yOff), 15);
+            const __m128i packed = _mm_packs_epi32(lo, hi);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(y0 + x), _mm_packus_epi16(packed, packed));
+        }
+        if (y1) {
+            __m128i lo = _mm_hadd_epi32(_mm_madd_epi16(b0l, cY), _mm_madd_epi16(b0h, cY));
+            __m128i hi = _mm_hadd_epi32(_mm_madd_epi16(b1l, cY), _mm_madd_epi16(b1h, cY));
+            lo = _mm_srai_epi32(_mm_add_epi32(lo, yOff), 15);
+            hi = _mm_srai_epi32(_mm_add_epi32(hi, yOff), 15);
+            const __m128i packed = _mm_packs_epi32(lo, hi);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(y1 + x), _mm_packus_epi16(packed, packed));
+        }
+
+        const __m128i s0l = _mm_add_epi16(a0l, b0l);
+        const __m128i s0h = _mm_add_epi16(a0h, b0h);
+        const __m128i s1l = _mm_add_epi16(a1l, b1l);
+        const __m128i s1h = _mm_add_epi16(a1h, b1h);
+
+        __m128i u = _mm_hadd_epi32(
+            _mm_hadd_epi32(_mm_madd_epi16(s0l, cU), _mm_madd_epi16(s0h, cU)),
+            _mm_hadd_epi32(_mm_madd_epi16(s1l, cU), _mm_madd_epi16(s1h, cU)));
+        __m128i v = _mm_hadd_epi32(
+            _mm_hadd_epi32(_mm_madd_epi16(s0l, cV), _mm_madd_epi16(s0h, cV)),
+            _mm_hadd_epi32(_mm_madd_epi16(s1l, cV), _mm_madd_epi16(s1h, cV)));
+        u = _mm_srai_epi32(_mm_add_epi32(u, cOff), 17);
+        v = _mm_srai_epi32(_mm_add_epi32(v, cOff), 17);
+        const __m128i uv16 = _mm_packs_epi32(u, v);
+        const __m128i uv8 = _mm_packus_epi16(uv16, uv16); // u0..u3 v0..v3
+
+        if (c.interleaved) {
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(c.u + x), _mm_shuffle_epi8(uv8, uvInterleave));
+        } else {
+            const int u32 = _mm_cvtsi128_si32(uv8);
+            const int v32 = _mm_cvtsi128_si32(_mm_srli_si128(uv8, 4));
+            std::memcpy(c.u + x / 2, &u32, 4);
+            std::memcpy(c.v + x / 2, &v32, 4);
+        }
+    }
+    return x;
+}
+
+// 16 pixels per iteration. Same arithmetic as the SSE4.1 kernel; the in-lane
+// horizontal adds leave values lane-interleaved, which the permutes undo.
+GLINT_TARGET_AVX2 int rowPairAvx2(const uint8_t* r0, const uint8_t* r1, uint8_t* y0, uint8_t* y1,
+                                  const ChromaRow& c, int width) {
+    const __m256i cY = _mm256_setr_epi16(kYB, kYG, kYR, 0, kYB, kYG, kYR, 0,
+                                         kYB, kYG, kYR, 0, kYB, kYG, kYR, 0);
+    const __m256i cU = _mm256_setr_epi16(kUB, kUG, kUR, 0, kUB, kUG, kUR, 0,
+                                         kUB, kUG, kUR, 0, kUB, kUG, kUR, 0);
+    const __m256i cV = _mm256_setr_epi16(kVB, kVG, kVR, 0, kVB, kVG, kVR, 0,
+                                         kVB, kVG, kVR, 0, kVB, kVG, kVR, 0);
+    const __m256i yOff = _mm256_set1_epi32(kYOffset);
+    const __m256i cOff = _mm256_set1_epi32(kCOffset);
+    const __m256i lumaOrder = _mm256_setr_epi32(0, 1, 4, 5, 2, 3, 6, 7);
+    const __m256i chromaOrder = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    const __m128i uvInterleave = _mm_setr_epi8(0, 8, 1, 9, 2, 10, 3, 11, 4, 12, 5, 13, 6, 14, 7, 15);
+
+    auto luma16 = [&](const __m256i* p, uint8_t* dst) GLINT_TARGET_AVX2 {
+        __m256i lo = _mm256_hadd_epi32(_mm256_madd_epi16(p[0], cY), _mm256_madd_epi16(p[1], cY));
+        __m256i hi = _mm256_hadd_epi32(_mm256_madd_epi16(p[2], cY), _mm256_madd_epi16(p[3], cY));
+        lo = _mm256_srai_epi32(_mm256_add_epi32(_mm256_permutevar8x32_epi32(lo, lumaOrder), yOff), 15);
+        hi = _mm256_srai_epi32(_mm256_add_epi32(_mm256_permutevar8x32_epi32(hi, lumaOrder), yOff), 15);
+        const __m128i p0 = _mm_packs_epi32(_mm256_castsi256_si128(lo), _mm256_extracti128_si256(lo, 1));
+        const __m128i p1 = _mm_packs_epi32(_mm256_castsi256_si128(hi), _mm256_extracti128_si256(hi, 1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_packus_epi16(p0, p1));
+    };
+
+    auto chroma8 = [&](const __m256i* s, const __m256i& coeff) GLINT_TARGET_AVX2 {
+        const __m256i h0 = _mm256_hadd_epi32(_mm256_madd_epi16(s[0], coeff), _mm256_madd_epi16(s[1], coeff));
+        const __m256i h1 = _mm256_hadd_epi32(_mm256_madd_epi16(s[2], coeff), _mm256_madd_epi16(s[3], coeff));
+        __m256i sum = _mm256_permutevar8x32_epi32(_mm256_hadd_epi32(h0, h1), chromaOrder);
+        sum = _mm256_srai_epi32(_mm256_add_epi32(sum, cOff), 17);
+        return _mm_packs_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    };
+
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m256i a[4];
+        __m256i b[4];
+        __m256i s[4];
+        for (int k = 0; k < 4; ++k) {
+            a[k] = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(r0 + x * 4 + k * 16)));
+            b[k] = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(r1 + x * 4 + k * 16)));
+            s[k] = _mm256_add_epi16(a[k], b[k]);
+        }
+
+        luma16(a, y0 + x);
+        if (y1) {
+            luma16(b, y1 + x);
+        }
+
+        const __m128i uv8 = _mm_packus_epi16(chroma8(s, cU), chroma8(s, cV)); // u0..u7 v0..v7
+        if (c.interleaved) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(c.u + x), _mm_shuffle_epi8(uv8, uvInterleave));
+        } else {
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(c.u + x / 2), uv8);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(c.v + x / 2), _mm_srli_si128(uv8, 8));
+        }
+    }
+    return x;
+}
+#endif
+
+#if defined(GLINT_CC_NEON)
+inline uint8x8_t lumaNeon(uint8x8_t b, uint8x8_t g, uint8x8_t r) {
+    const int16x8_t bw = vreinterpretq_s16_u16(vmovl_u8(b));
+    const int16x8_t gw = vreinterpretq_s16_u16(vmovl_u8(g));
+    const int16x8_t rw = vreinterpretq_s16_u16(vmovl_u8(r));
+    const int32x4_t off = vdupq_n_s32(kYOffset);
+    int32x4_t lo = vmlal_n_s16(vmlal_n_s16(vmull_n_s16(vget_low_s16(rw), kYR), vget_low_s16(gw), kYG), vget_low_s16(bw), kYB);
+    int32x4_t hi = vmlal_n_s16(vmlal_n_s16(vmull_n_s16(vget_high_s16(rw), kYR), vget_high_s16(gw), kYG), vget_high_s16(bw), kYB);
+    lo = vaddq_s32(lo, off);
+    hi = vaddq_s32(hi, off);
+    return vqmovun_s16(vcombine_s16(vshrn_n_s32(lo, 15), vshrn_n_s32(hi, 15)));
+}
+
+inline uint8x8_t chromaNeon(int16x8_t sb, int16x8_t sg, int16x8_t sr, int16_t cb, int16_t cg, int16_t cr) {
+    const int32x4_t off = vdupq_n_s32(kCOffset);
+    int32x4_t lo = vmlal_n_s16(vmlal_n_s16(vmull_n_s16(vget_low_s16(sr), cr), vget_low_s16(sg), cg), vget_low_s16(sb), cb);
+    int32x4_t hi = vmlal_n_s16(vmlal_n_s16(vmull_n_s16(vget_high_s16(sr), cr), vget_high_s16(sg), cg), vget_high_s16(sb), cb);
+    lo = vshrq_n_s32(vaddq_s32(lo, off), 17);
+    hi = vshrq_n_s32(vaddq_s32(hi, off), 17);
+    return vqmovun_s16(vcombine_s16(vmovn_s32(lo), vmovn_s32(hi)));
+}
+
+// 16 pixels per iteration; vld4 de-interleaves BGRA into per-channel vectors.
+int rowPairNeon(const uint8_t* r0, const uint8_t* r1, uint8_t* y0, uint8_t* y1,
+                const ChromaRow& c, int width) {
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        const uint8x16x4_t a = vld4q_u8(r0 + x * 4);
+        const uint8x16x4_t b = vld4q_u8(r1 + x * 4);
+
+        vst1q_u8(y0 + x, vcombine_u8(lumaNeon(vget_low_u8(a.val[0]), vget_low_u8(a.val[1]), vget_low_u8(a.val[2])),
+                                     lumaNeon(vget_high_u8(a.val[0]), vget_high_u8(a.val[1]), vget_high_u8(a.val[2]))));
+        if (y1) {
+            vst1q_u8(y1 + x, vcombine_u8(lumaNeon(vget_low_u8(b.val[0]), vget_low_u8(b.val[1]), vget_low_u8(b.val[2])),
+                                         lumaNeon(vget_high_u8(b.val[0]), vget_high_u8(b.val[1]), vget_high_u8(b.val[2]))));
+        }
+
+        const int16x8_t sb = vreinterpretq_s16_u16(vaddq_u16(vpaddlq_u8(a.val[0]), vpaddlq_u8(b.val[0])));
+        const int16x8_t sg = vreinterpretq_s16_u16(vaddq_u16(vpaddlq_u8(a.val[1]), vpaddlq_u8(b.val[1])));
+        const int16x8_t sr = vreinterpretq_s16_u16(vaddq_u16(vpaddlq_u8(a.val[2]), vpaddlq_u8(b.val[2])));
+        const uint8x8_t u = chromaNeon(sb, sg, sr, kUB, kUG, kUR);
+        const uint8x8_t v = chromaNeon(sb, sg, sr, kVB, kVG, kVR);
+        if (c.interleaved) {
+            vst2_u8(c.u + x, uint8x8x2_t{{u, v}});
+        } else {
+            vst1_u8(c.u + x / 2, u);
+            vst1_u8(c.v + x / 2, v);
+        }
+    }
+    return x;
+}
+#endif
+} // namespace
+
+ColorConvertIsa detectColorConvertIsa() noexcept {
+#if defined(GLINT_CC_X86)
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4]{};
+    __cpuid(info, 0);
+    const int maxLeaf = info[0];
+    __cpuid(info, 1);
+    const bool sse41 = (info[2] & (1 << 19)) != 0;
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx = (info[2] & (1 << 28)) != 0;
+    bool avx2 = false;
+    if (maxLeaf >= 7 && osxsave && avx && (_xgetbv(0) & 0x6) == 0x6) {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+    }
+#else
+    __builtin_cpu_init();
+    const bool sse41 = __builtin_cpu_supports("sse4.1");
+    const bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+    if (avx2) return ColorConvertIsa::AVX2;
+    if (sse41) return ColorConvertIsa::SSE41;
+    return ColorConvertIsa::Scalar;
+#elif defined(GLINT_CC_NEON)
+    return ColorConvertIsa::NEON;
+#else
+    return ColorConvertIsa::Scalar;
+#endif
+}
+
+const char* colorConvertIsaName(ColorConvertIsa isa) noexcept {
+    switch (isa) {
+        case ColorConvertIsa::Scalar: return "scalar";
+        case ColorConvertIsa::SSE41: return "sse4.1";
+        case ColorConvertIsa::AVX2: return "avx2";
+        case ColorConvertIsa::NEON: return "neon";
+    }
+    return "unknown";
+}
+
+void convertBgraToYuvRows(ColorConvertIsa isa,
+                          const uint8_t* bgra, int stride, int width, int height,
+                          int y_begin, int y_end,
+                          const YuvPlanes& dst, YuvLayout layout) noexcept {
+    const bool interleaved = layout == YuvLayout::NV12;
+    for (int y = y_begin; y < y_end; y += 2) {
+        const bool hasSecondRow = y + 1 < height;
+        const uint8_t* r0 = bgra + static_cast<std::ptrdiff_t>(y) * stride;
+        const uint8_t* r1 = hasSecondRow ? r0 + stride : r0;
+        uint8_t* y0 = dst.data[0] + static_cast<std::ptrdiff_t>(y) * dst.linesize[0];
+        uint8_t* y1 = hasSecondRow ? y0 + dst.linesize[0] : nullptr;
+
+        ChromaRow c;
+        c.interleaved = interleaved;
+        c.u = dst.data[1] + static_cast<std::ptrdiff_t>(y / 2) * dst.linesize[1];
+        if (interleaved) {
+            c.v = c.u + 1;
+            c.step = 2;
+        } else {
+            c.v = dst.data[2] + static_cast<std::ptrdiff_t>(y / 2) * dst.linesize[2];
+            c.step = 1;
+        }
+
+        int x = 0;
+        switch (isa) {
+#if defined(GLINT_CC_X86)
+            case ColorConvertIsa::AVX2: x = rowPairAvx2(r0, r1, y0, y1, c, width); break;
+            case ColorConvertIsa::SSE41: x = rowPairSse41(r0, r1, y0, y1, c, width); break;
+#endif
+#if defined(GLINT_CC_NEON)
+            case ColorConvertIsa::NEON: x = rowPairNeon(r0, r1, y0, y1, c, width); break;
+#endif
+            default: break;
+        }
+        rowPairScalar(r0, r1, y0, y1, c, x, width);
+    }
+}
+
+namespace {
+// Below this many rows per slice the wake-up cost outweighs the parallelism.
+constexpr int kMinRowsPerSlice = 64;
+}
+
+ColorConverter::ColorConverter(int threads, ColorConvertIsa isa)
+    : isa_(isa) {
+    if (threads <= 0) {
+        const int hw = static_cast<int>(std::thread::hardware_concurrency());
+        threads = std::clamp(hw / 2, 1, 4);
+    }
+    for (int i = 1; i < threads; ++i) {
+        workers_.emplace_back(&ColorConverter::workerLoop, this, i);
+    }
+}
+
+ColorConverter::~ColorConverter() {
+    {
+        std::scoped_lock lock(mutex_);
+        stopping_ = true;
+    }
+    job_cv_.notify_all();
+    for (auto& worker : workers_) {
+        if (worker.joinable()) worker.join();
+    }
+}
+
+void ColorConverter::runSlice(const Job& job, int index) const noexcept {
+    if (index >= job.slices) {
+        return;
+    }
+    const int pairs = (job.height + 1) / 2;
+    const int pairsPerSlice = (pairs + job.slices - 1) / job.slices;
+    const int yBegin = 2 * std::min(pairs, index * pairsPerSlice);
+    const int yEnd = std::min(job.height, 2 * std::min(pairs, (index + 1) * pairsPerSlice));
+    if (yBegin < yEnd) {
+        convertBgraToYuvRows(isa_, job.bgra, job.stride, job.width, job.height, yBegin, yEnd, job.dst, job.layout);
+    }
+}
+
+void ColorConverter::convert(const uint8_t* bgra, int stride, int width, int height,
+                             const YuvPlanes& dst, YuvLayout layout) {
+    Job job;
+    job.bgra = bgra;
+    job.stride = stride;
+    job.width = width;
+    job.height = height;
+    job.dst = dst;
+    job.layout = layout;
+    job.slices = std::clamp(height / kMinRowsPerSlice, 1, threadCount());
+
+    if (job.slices == 1) {
+        runSlice(job, 0);
+        return;
+    }
+
+    {
+        std::scoped_lock lock(mutex_);
+        job_ = job;
+        pending_ = static_cast<int>(workers_.size());
+        ++generation_;
+    }
+    job_cv_.notify_all();
+
+    runSlice(job, 0);
+
+    std::unique_lock lock(mutex_);
+    done_cv_.wait(lock, [this] { return pending_ == 0; });
+}
+
+void ColorConverter::workerLoop(int index) {
+    uint64_t seen = 0;
+    for (;;) {
+        Job job;
+        {
+            std::unique_lock lock(mutex_);
+            job_cv_.wait(lock, [&] { return stopping_ || generation_ != seen; });
+            if (stopping_) {
+                return;
+            }
+            seen = generation_;
+            job = job_;
+        }
+
+        runSlice(job, index);
+
+        {
+            std::scoped_lock lock(mutex_);
+            if (--pending_ == 0) {
+                done_cv_.notify_one();
+            }
+        }
+    }
+}
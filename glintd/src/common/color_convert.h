@@ -0,0 +1,79 @@
+﻿#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Packed 32-bit BGRA or BGRX (full range, the fourth byte is never read) ->
+// 8-bit 4:2:0 BT.709 limited range.
+// Same-size conversion only; scaling stays with swscale.
+
+enum class YuvLayout {
+    NV12,    // Y plane + interleaved UV plane
+    YUV420P  // Y, U and V planes
+};
+
+enum class ColorConvertIsa {
+    Scalar,
+    SSE41,
+    AVX2,
+    NEON
+};
+
+struct YuvPlanes {
+    uint8_t* data[3]{};
+    int linesize[3]{};
+};
+
+[[nodiscard]] ColorConvertIsa detectColorConvertIsa() noexcept;
+[[nodiscard]] const char* colorConvertIsaName(ColorConvertIsa isa) noexcept;
+
+// Converts source rows [y_begin, y_end). y_begin must be even; y_end is either
+// even or the frame height.
+void convertBgraToYuvRows(ColorConvertIsa isa,
+                          const uint8_t* bgra, int stride, int width, int height,
+                          int y_begin, int y_end,
+                          const YuvPlanes& dst, YuvLayout layout) noexcept;
+
+// Splits a frame into row slices and converts them on a small set of
+// persistent workers plus the calling thread.
+class ColorConverter {
+public:
+    explicit ColorConverter(int threads = 0, ColorConvertIsa isa = detectColorConvertIsa());
+    ~ColorConverter();
+
+    ColorConverter(const ColorConverter&) = delete;
+    ColorConverter& operator=(const ColorConverter&) = delete;
+
+    void convert(const uint8_t* bgra, int stride, int width, int height,
+                 const YuvPlanes& dst, YuvLayout layout);
+
+    [[nodiscard]] ColorConvertIsa isa() const noexcept { return isa_; }
+    [[nodiscard]] int threadCount() const noexcept { return static_cast<int>(workers_.size()) + 1; }
+
+private:
+    struct Job {
+        const uint8_t* bgra{nullptr};
+        int stride{0};
+        int width{0};
+        int height{0};
+        YuvPlanes dst{};
+        YuvLayout layout{YuvLayout::NV12};
+        int slices{1};
+    };
+
+    void runSlice(const Job& job, int index) const noexcept;
+    void workerLoop(int index);
+
+    ColorConvertIsa isa_{ColorConvertIsa::Scalar};
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable job_cv_;
+    std::condition_variable done_cv_;
+    Job job_{};
+    uint64_t generation_{0};
+    int pending_{0};
+    bool stopping_{false};
+};
@@ -35,6 +35,14 @@ AppConfig make_default_config() {
     base.video.bitrate_kbps = 18000;
     base.video.codec = "h264";
     base.video.encoder = "auto";
+    base.video.use_shared_memory = true;
+    base.video.use_damage = true;
+    base.video.frame_queue_depth = 4;
+    base.video.frame_drop_policy = "drop_newest";
+    base.video.keep_encoder_warm = true;
+    base.video.source = "screen";
+    base.video.synthetic_motion = 0.25;
+    base.video.source_realtime = true;
 
     base.audio.sample_rate = 48000;
     base.audio.channels = 2;
@@ -48,17 +56,22 @@ AppConfig make_default_config() {
     base.buffer.enabled = true;
     base.buffer.rolling_mode = true;
     base.buffer.size_limit_bytes = 100ull * 1024ull * 1024ull;
+    base.buffer.retention_seconds = 120;
     base.buffer.segment_directory = "buffer";
     base.buffer.output_directory = "recordings";
     base.buffer.segment_prefix = "seg_";
     base.buffer.segment_extension = ".mkv";
     base.buffer.container = "matroska";
+    base.buffer.storage = "disk";
+    base.buffer.memory_seconds = 30;
 
     cfg.general.temp_path = "temp";
     cfg.general.db_path = "glintd.db";
     cfg.general.log_path = "glintd.log";
     cfg.general.file_logging = true;
     cfg.general.log_level = "info";
+    cfg.general.log_max_bytes = 10ull * 1024ull * 1024ull;
+    cfg.general.log_max_files = 5;
 
     cfg.profiles["default"] = base;
 
@@ -86,7 +99,16 @@ json profile_to_json(const ProfileConfig& profile) {
         {"fps", profile.video.fps},
         {"bitrate_kbps", profile.video.bitrate_kbps},
         {"codec", profile.video.codec},
-        {"encoder", profile.video.encoder}
+        {"encoder", profile.video.encoder},
+        {"use_shared_memory", profile.video.use_shared_memory},
+        {"use_damage", profile.video.use_damage},
+        {"frame_queue_depth", profile.video.frame_queue_depth},
+        {"frame_drop_policy", profile.video.frame_drop_policy},
+        {"keep_encoder_warm", profile.video.keep_encoder_warm},
+        {"source", profile.video.source},
+        {"source_file", profile.video.source_file},
+        {"synthetic_motion", profile.video.synthetic_motion},
+        {"source_realtime", profile.video.source_realtime}
     };
 
     j["audio"] = {
@@ -104,11 +126,14 @@ json profile_to_json(const ProfileConfig& profile) {
         {"enabled", profile.buffer.enabled},
         {"rolling_mode", profile.buffer.rolling_mode},
         {"size_limit_bytes", profile.buffer.size_limit_bytes},
+        {"retention_seconds", profile.buffer.retention_seconds},
         {"segment_directory", profile.buffer.segment_directory.string()},
         {"output_directory", profile.buffer.output_directory.string()},
         {"segment_prefix", profile.buffer.segment_prefix},
         {"segment_extension", profile.buffer.segment_extension},
-        {"container", profile.buffer.container}
+        {"container", profile.buffer.container},
+        {"storage", profile.buffer.storage},
+        {"memory_seconds", profile.buffer.memory_seconds}
     };
     return j;
 }
@@ -123,6 +148,15 @@ ProfileConfig json_to_profile(const json& j, const ProfileConfig& fallback) {
         profile.video.bitrate_kbps = v.value("bitrate_kbps", profile.video.bitrate_kbps);
         profile.video.codec = v.value("codec", profile.video.codec);
         profile.video.encoder = v.value("encoder", profile.video.encoder);
+        profile.video.use_shared_memory = v.value("use_shared_memory", profile.video.use_shared_memory);
+        profile.video.use_damage = v.value("use_damage", profile.video.use_damage);
+        profile.video.frame_queue_depth = v.value("frame_queue_depth", profile.video.frame_queue_depth);
+        profile.video.frame_drop_policy = v.value("frame_drop_policy", profile.video.frame_drop_policy);
+        profile.video.keep_encoder_warm = v.value("keep_encoder_warm", profile.video.keep_encoder_warm);
+        profile.video.source = v.value("source", profile.video.source);
+        profile.video.source_file = v.value("source_file", profile.video.source_file);
+        profile.video.synthetic_motion = v.value("synthetic_motion", profile.video.synthetic_motion);
+        profile.video.source_realtime = v.value("source_realtime", profile.video.source_realtime);
     }
     if (j.contains("audio")) {
         const auto& a = j["audio"];
@@ -144,6 +178,7 @@ ProfileConfig json_to_profile(const json& j, const ProfileConfig& fallback) {
         profile.buffer.enabled = b.value("enabled", profile.buffer.enabled);
         profile.buffer.rolling_mode = b.value("rolling_mode", profile.buffer.rolling_mode);
         profile.buffer.size_limit_bytes = b.value("size_limit_bytes", profile.buffer.size_limit_bytes);
+        profile.buffer.retention_seconds = b.value("retention_seconds", profile.buffer.retention_seconds);
         if (b.contains("segment_directory")) {
             profile.buffer.segment_directory = b.at("segment_directory").get<std::string>();
         }
@@ -153,6 +188,8 @@ ProfileConfig json_to_profile(const json& j, const ProfileConfig& fallback) {
         profile.buffer.segment_prefix = b.value("segment_prefix", profile.buffer.segment_prefix);
         profile.buffer.segment_extension = b.value("segment_extension", profile.buffer.segment_extension);
         profile.buffer.container = b.value("container", profile.buffer.container);
+        profile.buffer.storage = b.value("storage", profile.buffer.storage);
+        profile.buffer.memory_seconds = b.value("memory_seconds", profile.buffer.memory_seconds);
     }
     return profile;
 }
@@ -170,7 +207,9 @@ json config_to_json(const AppConfig& config) {
         {"db_path", config.general.db_path.string()},
         {"log_path", config.general.log_path.string()},
         {"file_logging", config.general.file_logging},
-        {"log_level", config.general.log_level}
+        {"log_level", config.general.log_level},
+        {"log_max_bytes", config.general.log_max_bytes},
+        {"log_max_files", config.general.log_max_files}
     };
     return j;
 }
@@ -184,6 +223,8 @@ AppConfig json_to_config(const json& j) {
         if (g.contains("log_path")) cfg.general.log_path = g.at("log_path").get<std::string>();
         cfg.general.file_logging = g.value("file_logging", cfg.general.file_logging);
         cfg.general.log_level = g.value("log_level", cfg.general.log_level);
+        cfg.general.log_max_bytes = g.value("log_max_bytes", cfg.general.log_max_bytes);
+        cfg.general.log_max_files = g.value("log_max_files", cfg.general.log_max_files);
     }
     cfg.active_profile = j.value("active_profile", cfg.active_profile);
     if (j.contains("profiles") && j["profiles"].is_object()) {
@@ -18,6 +18,15 @@ struct VideoSettings {
     int bitrate_kbps{18000};
     std::string codec{"h264"};
     std::string encoder{"software"}; // "auto" | "nvenc" | "vaapi" | "software"
+    bool use_shared_memory{true};    // X11 MIT-SHM capture
+    bool use_damage{true};           // X11: repeat unchanged frames, read back only damaged areas
+    int frame_queue_depth{4};        // captured frames waiting for the encoder
+    std::string frame_drop_policy{"drop_newest"}; // "drop_newest" | "drop_oldest"
+    bool keep_encoder_warm{true};    // hold the encoder open between sessions
+    std::string source{"screen"};    // "screen" | "synthetic" | "file"
+    std::string source_file;         // "file": media file replayed as capture input
+    double synthetic_motion{0.25};   // "synthetic": share of the picture that moves
+    bool source_realtime{true};      // synthetic/file: pace at fps, or run unthrottled
 };
 
 struct AudioSettings {
@@ -34,12 +43,15 @@ struct AudioSettings {
 struct BufferSettings {
     bool enabled{true};
     bool rolling_mode{false};
-    uint64_t size_limit_bytes{100ull * 1024ull * 1024ull};
+    uint64_t size_limit_bytes{100ull * 1024ull * 1024ull}; // 0 = no byte limit
+    int retention_seconds{120};                            // rolling window on disk, 0 = bytes only
     std::filesystem::path segment_directory{"buffer"};
     std::filesystem::path output_directory{"recordings"};
     std::string segment_prefix{"seg_"};
     std::string segment_extension{".mkv"};
     std::string container{"matroska"};
+    std::string storage{"disk"};       // "disk" | "memory" (rolling mode keeps the window in RAM)
+    int memory_seconds{30};
 };
 
 struct GeneralSettings {
@@ -48,6 +60,8 @@ struct GeneralSettings {
     std::filesystem::path log_path{"glintd.log"};
     bool file_logging{true};
     std::string log_level{"info"};
+    uint64_t log_max_bytes{10ull * 1024ull * 1024ull}; // rotate past this size, 0 = never
+    int log_max_files{5};
 };
 
 struct ProfileConfig {
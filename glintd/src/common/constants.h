@@ -14,6 +14,13 @@ namespace glintd::consts {
         if (xdg) return std::string(xdg) + "/glintd.sock";
         return "/run/user/" + std::to_string(getuid()) + "/glintd.sock";
     }
+
+    // Текстовые метрики для скрейпера
+    inline std::string default_metrics_socket_path() {
+        const char* xdg = std::getenv("XDG_RUNTIME_DIR");
+        if (xdg) return std::string(xdg) + "/glintd.metrics.sock";
+        return "/run/user/" + std::to_string(getuid()) + "/glintd.metrics.sock";
+    }
 #endif
 
     // Файлы экспорта
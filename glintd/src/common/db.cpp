@@ -1,12 +1,15 @@
 ﻿#include "db.h"
 
+#include <chrono>
 #include <cstdlib>
 #include <cstring>
 #include <format>
 #include <string_view>
 #include <system_error>
+#include <utility>
 
 #include "logger.h"
+#include "metrics.h"
 
 #ifdef _WIN32
 #include <ShlObj.h>
@@ -25,6 +28,16 @@ struct StatementDeleter {
 
 using StatementPtr = std::unique_ptr<sqlite3_stmt, StatementDeleter>;
 
+struct DbMetrics {
+    Histogram& write_us = MetricsRegistry::instance().histogram("glint_db_write_us", "One write call, excluding lock wait, microseconds");
+    Histogram& commit_us = MetricsRegistry::instance().histogram("glint_db_commit_us", "Top-level transaction commit, microseconds");
+};
+
+DbMetrics& metrics() {
+    static DbMetrics m;
+    return m;
+}
+
 [[nodiscard]] std::string sqliteMessage(sqlite3* handle, std::string_view context) {
     const char* raw = handle ? sqlite3_errmsg(handle) : nullptr;
     return std::format("{}: {}", context, raw ? raw : "unknown error");
@@ -46,10 +59,88 @@ glint::Expected<void, std::string> bindChecked(sqlite3* handle, int rc, std::str
     return {};
 }
 
+// Resets a cached statement when the call using it returns, so the next user
+// starts clean and a finished read does not keep a WAL snapshot open.
+class StatementScope {
+public:
+    explicit StatementScope(sqlite3_stmt* stmt) noexcept : stmt_(stmt) {}
+    ~StatementScope() {
+        sqlite3_reset(stmt_);
+        sqlite3_clear_bindings(stmt_);
+    }
+    StatementScope(const StatementScope&) = delete;
+    StatementScope& operator=(const StatementScope&) = delete;
+
+    [[nodiscard]] sqlite3_stmt* get() const noexcept { return stmt_; }
+
+private:
+    sqlite3_stmt* stmt_;
+};
+
+glint::Expected<void, std::string> exec(sqlite3* handle, const char* sql, std::string_view context) {
+    char* err = nullptr;
+    if (sqlite3_exec(handle, sql, nullptr, nullptr, &err) != SQLITE_OK) {
+        std::string message = std::format("{}: {}", context, err ? err : "unknown error");
+        sqlite3_free(err);
+        return glint::unexpected(message);
+    }
+    return {};
+}
+
 } // namespace
 
 DB::DB() = default;
-DB::~DB() = default;
+
+DB::~DB() {
+    finalizeStatements();
+}
+
+DB::Transaction::Transaction(DB* db, std::unique_lock<std::recursive_mutex> lock, int depth)
+    : db_(db), lock_(std::move(lock)), depth_(depth) {}
+
+DB::Transaction::Transaction(Transaction&& other) noexcept
+    : db_(std::exchange(other.db_, nullptr)), lock_(std::move(other.lock_)), depth_(other.depth_) {}
+
+DB::Transaction::~Transaction() {
+    rollback();
+}
+
+glint::Expected<void, std::string> DB::Transaction::commit() {
+    if (!db_) {
+        return glint::unexpected(std::string{"transaction already finished"});
+    }
+    const std::string sql = depth_ == 1 ? std::string{"COMMIT;"} : std::format("RELEASE glint_{};", depth_);
+    const auto started = std::chrono::steady_clock::now();
+    auto res = exec(db_->db_.get(), sql.c_str(), "transaction.commit");
+    if (depth_ == 1) {
+        metrics().commit_us.record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - started).count()));
+    }
+    if (!res) {
+        Logger::instance().error(std::format("DB: {}", res.error()));
+        rollback();
+        return res;
+    }
+    --db_->transaction_depth_;
+    db_ = nullptr;
+    lock_ = {};
+    return {};
+}
+
+void DB::Transaction::rollback() noexcept {
+    if (!db_) {
+        return;
+    }
+    if (depth_ == 1) {
+        sqlite3_exec(db_->db_.get(), "ROLLBACK;", nullptr, nullptr, nullptr);
+    } else {
+        const std::string sql = std::format("ROLLBACK TO glint_{0}; RELEASE glint_{0};", depth_);
+        sqlite3_exec(db_->db_.get(), sql.c_str(), nullptr, nullptr, nullptr);
+    }
+    --db_->transaction_depth_;
+    db_ = nullptr;
+    lock_ = {};
+}
 
 DB& DB::instance() {
     static DB inst;
@@ -104,6 +195,7 @@ std::filesystem::path DB::getPath() const {
 }
 
 glint::Expected<void, std::string> DB::open() {
+    std::scoped_lock lock(mutex_);
     if (db_) {
         return {};
     }
@@ -132,7 +224,9 @@ glint::Expected<void, std::string> DB::open() {
     }
 
     db_.reset(handle);
-    sqlite3_exec(db_.get(), "PRAGMA foreign_keys = ON;", nullptr, nullptr, nullptr);
+    if (auto configured = configureConnection(); !configured) {
+        Logger::instance().warn(std::format("DB: {}", configured.error()));
+    }
 
     if (auto schema = initSchema(); !schema) {
         Logger::instance().error(std::format("DB: {}", schema.error()));
@@ -143,6 +237,66 @@ glint::Expected<void, std::string> DB::open() {
     return {};
 }
 
+glint::Expected<void, std::string> DB::configureConnection() {
+    // WAL turns every commit into an append; with synchronous=NORMAL it is
+    // only fsynced at checkpoints. A power cut can lose the last few chunk
+    // rows but never corrupts the file.
+    sqlite3_busy_timeout(db_.get(), 5000);
+    sqlite3_exec(db_.get(), "PRAGMA foreign_keys = ON;", nullptr, nullptr, nullptr);
+
+    auto stmtRes = prepare(db_.get(), "PRAGMA journal_mode = WAL;", "configure.journal_mode");
+    if (!stmtRes) {
+        return glint::unexpected(stmtRes.error());
+    }
+    std::string mode;
+    if (sqlite3_step(stmtRes.value().get()) == SQLITE_ROW) {
+        const unsigned char* text = sqlite3_column_text(stmtRes.value().get(), 0);
+        mode = text ? reinterpret_cast<const char*>(text) : "";
+    }
+    stmtRes.value().reset();
+    if (mode != "wal") {
+        Logger::instance().warn(std::format("DB: WAL unavailable, journal_mode={}", mode));
+    }
+    return exec(db_.get(), "PRAGMA synchronous = NORMAL;", "configure.synchronous");
+}
+
+glint::Expected<sqlite3_stmt*, std::string> DB::cached(Statement id, const char* sql, std::string_view context) const {
+    sqlite3_stmt*& slot = statements_[static_cast<std::size_t>(id)];
+    if (!slot) {
+        if (sqlite3_prepare_v3(db_.get(), sql, -1, SQLITE_PREPARE_PERSISTENT, &slot, nullptr) != SQLITE_OK) {
+            slot = nullptr;
+            return glint::unexpected(sqliteMessage(db_.get(), context));
+        }
+    }
+    return slot;
+}
+
+void DB::finalizeStatements() noexcept {
+    for (auto& stmt : statements_) {
+        if (stmt) {
+            sqlite3_finalize(stmt);
+            stmt = nullptr;
+        }
+    }
+}
+
+glint::Expected<DB::Transaction, std::string> DB::transaction() {
+    std::unique_lock lock(mutex_);
+    if (!db_) {
+        return glint::unexpected(std::string{"database not open"});
+    }
+    const int depth = transaction_depth_ + 1;
+    // IMMEDIATE takes the write lock up front so a commit cannot fail with
+    // SQLITE_BUSY halfway through a batch.
+    const std::string sql = depth == 1 ? std::string{"BEGIN IMMEDIATE;"} : std::format("SAVEPOINT glint_{};", depth);
+    if (auto res = exec(db_.get(), sql.c_str(), "transaction.begin"); !res) {
+        Logger::instance().error(std::format("DB: {}", res.error()));
+        return glint::unexpected(res.error());
+    }
+    transaction_depth_ = depth;
+    return Transaction(this, std::move(lock), depth);
+}
+
 glint::Expected<void, std::string> DB::initSchema() {
     if (!db_) {
         return glint::unexpected(std::string{"database not open"});
@@ -179,6 +333,15 @@ CREATE TABLE IF NOT EXISTS markers(
     post INTEGER NOT NULL,
     FOREIGN KEY(session_id) REFERENCES sessions(id) ON DELETE CASCADE
 );
+)SQL",
+        R"SQL(
+CREATE TABLE IF NOT EXISTS keyframes(
+    chunk_id INTEGER NOT NULL,
+    pts_ms INTEGER NOT NULL,
+    byte_offset INTEGER NOT NULL,
+    PRIMARY KEY(chunk_id, pts_ms),
+    FOREIGN KEY(chunk_id) REFERENCES chunks(id) ON DELETE CASCADE
+) WITHOUT ROWID;
 )SQL"
     };
 
@@ -197,18 +360,20 @@ CREATE TABLE IF NOT EXISTS markers(
 glint::Expected<int64_t, std::string> DB::createSession(const std::string& game,
                                                         int64_t startedAt,
                                                         const std::string& container) {
+    std::scoped_lock lock(mutex_);
+    ScopedTimer timer(metrics().write_us);
     if (auto openRes = open(); !openRes) {
         return glint::unexpected(openRes.error());
     }
 
     constexpr auto sql = "INSERT INTO sessions(game, started_at, container) VALUES(?,?,?);";
-    auto stmtRes = prepare(db_.get(), sql, "createSession.prepare");
+    auto stmtRes = cached(Statement::CreateSession, sql, "createSession.prepare");
     if (!stmtRes) {
         Logger::instance().error(std::format("DB: {}", stmtRes.error()));
         return glint::unexpected(stmtRes.error());
     }
 
-    StatementPtr stmt = std::move(stmtRes.value());
+    StatementScope stmt(stmtRes.value());
     if (auto rc = bindChecked(db_.get(), sqlite3_bind_text(stmt.get(), 1, game.c_str(), -1, SQLITE_TRANSIENT),
                               "createSession.bind(game)"); !rc) {
         Logger::instance().error(std::format("DB: {}", rc.error()));
@@ -237,18 +402,20 @@ glint::Expected<int64_t, std::string> DB::createSession(const std::string& game,
 glint::Expected<void, std::string> DB::finalizeSession(int64_t sessionId,
                                                        int64_t stoppedAt,
                                                        const std::string& outputMp4) {
+    std::scoped_lock lock(mutex_);
+    ScopedTimer timer(metrics().write_us);
     if (!db_) {
         return glint::unexpected(std::string{"database not open"});
     }
 
     constexpr auto sql = "UPDATE sessions SET stopped_at=?, output_mp4=? WHERE id=?;";
-    auto stmtRes = prepare(db_.get(), sql, "finalizeSession.prepare");
+    auto stmtRes = cached(Statement::FinalizeSession, sql, "finalizeSession.prepare");
     if (!stmtRes) {
         Logger::instance().error(std::format("DB: {}", stmtRes.error()));
         return glint::unexpected(stmtRes.error());
     }
-    StatementPtr stmt = std::move(stmtRes.value());
 
+    StatementScope stmt(stmtRes.value());
     if (auto rc = bindChecked(db_.get(), sqlite3_bind_int64(stmt.get(), 1, stoppedAt),
                               "finalizeSession.bind(stopped_at)"); !rc) {
         Logger::instance().error(std::format("DB: {}", rc.error()));
@@ -278,18 +445,20 @@ glint::Expected<int64_t, std::string> DB::insertChunk(int sessionId,
                                                       int64_t startMs,
                                                       int64_t endMs,
                                                       std::optional<int64_t> keyframeMs) {
+    std::scoped_lock lock(mutex_);
+    ScopedTimer timer(metrics().write_us);
     if (!db_) {
         return glint::unexpected(std::string{"database not open"});
     }
 
     constexpr auto sql = "INSERT INTO chunks(session_id, path, start_ms, end_ms, keyframe_ms) VALUES(?,?,?,?,?);";
-    auto stmtRes = prepare(db_.get(), sql, "insertChunk.prepare");
+    auto stmtRes = cached(Statement::InsertChunk, sql, "insertChunk.prepare");
     if (!stmtRes) {
         Logger::instance().error(std::format("DB: {}", stmtRes.error()));
         return glint::unexpected(stmtRes.error());
     }
-    StatementPtr stmt = std::move(stmtRes.value());
 
+    StatementScope stmt(stmtRes.value());
     if (auto rc = bindChecked(db_.get(), sqlite3_bind_int(stmt.get(), 1, sessionId),
                               "insertChunk.bind(session_id)"); !rc) {
         Logger::instance().error(std::format("DB: {}", rc.error()));
@@ -333,20 +502,50 @@ glint::Expected<int64_t, std::string> DB::insertChunk(int sessionId,
     return sqlite3_last_insert_rowid(db_.get());
 }
 
+std::vector<SessionRecord> DB::unfinishedSessions() const {
+    std::scoped_lock lock(mutex_);
+    std::vector<SessionRecord> records;
+    if (!db_) {
+        return records;
+    }
+
+    constexpr auto sql = "SELECT id, game, started_at FROM sessions WHERE stopped_at IS NULL ORDER BY id ASC;";
+    auto stmtRes = cached(Statement::UnfinishedSessions, sql, "unfinishedSessions.prepare");
+    if (!stmtRes) {
+        Logger::instance().error(stmtRes.error());
+        return records;
+    }
+
+    StatementScope guard(stmtRes.value());
+    sqlite3_stmt* stmt = guard.get();
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        SessionRecord rec{};
+        rec.id = sqlite3_column_int64(stmt, 0);
+        const unsigned char* text = sqlite3_column_text(stmt, 1);
+        rec.game = text ? reinterpret_cast<const char*>(text) : "";
+        rec.started_at = sqlite3_column_int64(stmt, 2);
+        records.push_back(std::move(rec));
+    }
+
+    return records;
+}
+
 std::vector<ChunkRecord> DB::chunksForSession(int sessionId) const {
+    std::scoped_lock lock(mutex_);
     std::vector<ChunkRecord> records;
     if (!db_) {
         return records;
     }
 
     constexpr auto sql = "SELECT id, session_id, path, start_ms, end_ms, keyframe_ms FROM chunks WHERE session_id=? ORDER BY start_ms ASC;";
-    sqlite3_stmt* stmt = nullptr;
-    if (sqlite3_prepare_v2(db_.get(), sql, -1, &stmt, nullptr) != SQLITE_OK) {
-        Logger::instance().error(sqliteMessage(db_.get(), "chunksForSession.prepare"));
+    auto stmtRes = cached(Statement::ChunksForSession, sql, "chunksForSession.prepare");
+    if (!stmtRes) {
+        Logger::instance().error(stmtRes.error());
         return records;
     }
 
-    StatementPtr guard(stmt);
+    StatementScope guard(stmtRes.value());
+    sqlite3_stmt* stmt = guard.get();
     if (sqlite3_bind_int(stmt, 1, sessionId) != SQLITE_OK) {
         Logger::instance().error(sqliteMessage(db_.get(), "chunksForSession.bind"));
         return records;
@@ -369,19 +568,99 @@ std::vector<ChunkRecord> DB::chunksForSession(int sessionId) const {
     return records;
 }
 
+glint::Expected<void, std::string> DB::insertKeyframes(int64_t chunkId, const std::vector<KeyframeRecord>& keyframes) {
+    std::scoped_lock lock(mutex_);
+    ScopedTimer timer(metrics().write_us);
+    if (!db_) {
+        return glint::unexpected(std::string{"database not open"});
+    }
+    if (keyframes.empty()) {
+        return {};
+    }
+
+    constexpr auto sql = "INSERT OR REPLACE INTO keyframes(chunk_id, pts_ms, byte_offset) VALUES(?,?,?);";
+    auto stmtRes = cached(Statement::InsertKeyframe, sql, "insertKeyframes.prepare");
+    if (!stmtRes) {
+        Logger::instance().error(std::format("DB: {}", stmtRes.error()));
+        return glint::unexpected(stmtRes.error());
+    }
+
+    // One transaction per chunk; a segment can carry hundreds of keyframes.
+    auto txn = transaction();
+    if (!txn) {
+        return glint::unexpected(txn.error());
+    }
+    StatementScope stmt(stmtRes.value());
+    for (const auto& keyframe : keyframes) {
+        sqlite3_reset(stmt.get());
+        if (auto rc = bindChecked(db_.get(), sqlite3_bind_int64(stmt.get(), 1, chunkId),
+                                  "insertKeyframes.bind(chunk_id)"); !rc) {
+            Logger::instance().error(std::format("DB: {}", rc.error()));
+            return glint::unexpected(rc.error());
+        }
+        if (auto rc = bindChecked(db_.get(), sqlite3_bind_int64(stmt.get(), 2, keyframe.pts_ms),
+                                  "insertKeyframes.bind(pts_ms)"); !rc) {
+            Logger::instance().error(std::format("DB: {}", rc.error()));
+            return glint::unexpected(rc.error());
+        }
+        if (auto rc = bindChecked(db_.get(), sqlite3_bind_int64(stmt.get(), 3, keyframe.byte_offset),
+                                  "insertKeyframes.bind(byte_offset)"); !rc) {
+            Logger::instance().error(std::format("DB: {}", rc.error()));
+            return glint::unexpected(rc.error());
+        }
+        if (sqlite3_step(stmt.get()) != SQLITE_DONE) {
+            const std::string message = sqliteMessage(db_.get(), "insertKeyframes.step");
+            Logger::instance().error(std::format("DB: {}", message));
+            return glint::unexpected(message);
+        }
+    }
+    return txn.value().commit();
+}
+
+std::optional<KeyframeRecord> DB::keyframeAtOrBefore(int64_t chunkId, int64_t ptsMs) const {
+    std::scoped_lock lock(mutex_);
+    if (!db_) {
+        return std::nullopt;
+    }
+
+    constexpr auto sql = "SELECT pts_ms, byte_offset FROM keyframes WHERE chunk_id=? AND pts_ms<=? ORDER BY pts_ms DESC LIMIT 1;";
+    auto stmtRes = cached(Statement::KeyframeAtOrBefore, sql, "keyframeAtOrBefore.prepare");
+    if (!stmtRes) {
+        Logger::instance().error(stmtRes.error());
+        return std::nullopt;
+    }
+
+    StatementScope guard(stmtRes.value());
+    sqlite3_stmt* stmt = guard.get();
+    if (sqlite3_bind_int64(stmt, 1, chunkId) != SQLITE_OK || sqlite3_bind_int64(stmt, 2, ptsMs) != SQLITE_OK) {
+        Logger::instance().error(sqliteMessage(db_.get(), "keyframeAtOrBefore.bind"));
+        return std::nullopt;
+    }
+
+    if (sqlite3_step(stmt) != SQLITE_ROW) {
+        return std::nullopt;
+    }
+    KeyframeRecord rec{};
+    rec.pts_ms = sqlite3_column_int64(stmt, 0);
+    rec.byte_offset = sqlite3_column_int64(stmt, 1);
+    return rec;
+}
+
 glint::Expected<void, std::string> DB::removeChunk(int64_t chunkId) {
+    std::scoped_lock lock(mutex_);
+    ScopedTimer timer(metrics().write_us);
     if (!db_) {
         return glint::unexpected(std::string{"database not open"});
     }
 
     constexpr auto sql = "DELETE FROM chunks WHERE id=?;";
-    auto stmtRes = prepare(db_.get(), sql, "removeChunk.prepare");
+    auto stmtRes = cached(Statement::RemoveChunk, sql, "removeChunk.prepare");
     if (!stmtRes) {
         Logger::instance().error(std::format("DB: {}", stmtRes.error()));
         return glint::unexpected(stmtRes.error());
     }
-    StatementPtr stmt = std::move(stmtRes.value());
 
+    StatementScope stmt(stmtRes.value());
     if (auto rc = bindChecked(db_.get(), sqlite3_bind_int64(stmt.get(), 1, chunkId),
                               "removeChunk.bind(id)"); !rc) {
         Logger::instance().error(std::format("DB: {}", rc.error()));
@@ -397,18 +676,20 @@ glint::Expected<void, std::string> DB::removeChunk(int64_t chunkId) {
 }
 
 glint::Expected<void, std::string> DB::removeChunksForSession(int sessionId) {
+    std::scoped_lock lock(mutex_);
+    ScopedTimer timer(metrics().write_us);
     if (!db_) {
         return glint::unexpected(std::string{"database not open"});
     }
 
     constexpr auto sql = "DELETE FROM chunks WHERE session_id=?;";
-    auto stmtRes = prepare(db_.get(), sql, "removeChunksForSession.prepare");
+    auto stmtRes = cached(Statement::RemoveChunksForSession, sql, "removeChunksForSession.prepare");
     if (!stmtRes) {
         Logger::instance().error(std::format("DB: {}", stmtRes.error()));
         return glint::unexpected(stmtRes.error());
     }
-    StatementPtr stmt = std::move(stmtRes.value());
 
+    StatementScope stmt(stmtRes.value());
     if (auto rc = bindChecked(db_.get(), sqlite3_bind_int(stmt.get(), 1, sessionId),
                               "removeChunksForSession.bind(session_id)"); !rc) {
         Logger::instance().error(std::format("DB: {}", rc.error()));
@@ -424,6 +705,7 @@ glint::Expected<void, std::string> DB::removeChunksForSession(int sessionId) {
 }
 
 bool DB::columnExists(const char* table, const char* column) const {
+    std::scoped_lock lock(mutex_);
     if (!db_) {
         return false;
     }
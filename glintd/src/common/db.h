@@ -1,13 +1,22 @@
 ﻿#pragma once
+#include <array>
 #include <filesystem>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <sqlite3.h>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "expected.h"
 
+struct SessionRecord {
+    int64_t id{0};
+    std::string game;
+    int64_t started_at{0};
+};
+
 struct ChunkRecord {
     int64_t id{0};
     int64_t session_id{0};
@@ -17,17 +26,52 @@ struct ChunkRecord {
     std::optional<int64_t> keyframe_ms;
 };
 
+// One video keyframe inside a chunk. byte_offset is a position at or before
+// the keyframe's data, so seeking there and reading forward finds it.
+struct KeyframeRecord {
+    int64_t pts_ms{0};
+    int64_t byte_offset{-1};
+};
+
 class DB {
 public:
+    // Groups writes into one commit. A transaction opened while another is
+    // active on the same thread becomes a savepoint inside it. Holds the DB
+    // lock until committed or destroyed; rolls back unless commit() succeeded.
+    class Transaction {
+    public:
+        Transaction(Transaction&& other) noexcept;
+        Transaction& operator=(Transaction&&) = delete;
+        Transaction(const Transaction&) = delete;
+        Transaction& operator=(const Transaction&) = delete;
+        ~Transaction();
+
+        glint::Expected<void, std::string> commit();
+
+    private:
+        friend class DB;
+        Transaction(DB* db, std::unique_lock<std::recursive_mutex> lock, int depth);
+        void rollback() noexcept;
+
+        DB* db_{nullptr};
+        std::unique_lock<std::recursive_mutex> lock_;
+        int depth_{0};
+    };
+
     static DB& instance();
 
     void setCustomPath(const std::filesystem::path& path);
     glint::Expected<void, std::string> open();
+    glint::Expected<Transaction, std::string> transaction();
 
     glint::Expected<int64_t, std::string> createSession(const std::string& game, int64_t startedAt, const std::string& container);
     glint::Expected<void, std::string> finalizeSession(int64_t sessionId, int64_t stoppedAt, const std::string& outputMp4);
+    // Sessions never marked stopped, i.e. the daemon died while recording.
+    std::vector<SessionRecord> unfinishedSessions() const;
     glint::Expected<int64_t, std::string> insertChunk(int sessionId, const std::string& path, int64_t startMs, int64_t endMs, std::optional<int64_t> keyframeMs);
     std::vector<ChunkRecord> chunksForSession(int sessionId) const;
+    glint::Expected<void, std::string> insertKeyframes(int64_t chunkId, const std::vector<KeyframeRecord>& keyframes);
+    std::optional<KeyframeRecord> keyframeAtOrBefore(int64_t chunkId, int64_t ptsMs) const;
     glint::Expected<void, std::string> removeChunk(int64_t chunkId);
     glint::Expected<void, std::string> removeChunksForSession(int sessionId);
 
@@ -44,7 +88,27 @@ private:
         void operator()(sqlite3* handle) const noexcept { if (handle) sqlite3_close(handle); }
     };
 
+    enum class Statement : std::size_t {
+        CreateSession,
+        FinalizeSession,
+        UnfinishedSessions,
+        InsertChunk,
+        ChunksForSession,
+        RemoveChunk,
+        RemoveChunksForSession,
+        InsertKeyframe,
+        KeyframeAtOrBefore,
+        Count
+    };
+
+    glint::Expected<sqlite3_stmt*, std::string> cached(Statement id, const char* sql, std::string_view context) const;
+    void finalizeStatements() noexcept;
+    glint::Expected<void, std::string> configureConnection();
+
+    mutable std::recursive_mutex mutex_;
     std::unique_ptr<sqlite3, SqliteDeleter> db_{};
+    mutable std::array<sqlite3_stmt*, static_cast<std::size_t>(Statement::Count)> statements_{};
+    int transaction_depth_{0};
     std::optional<std::filesystem::path> custom_path_{};
     std::filesystem::path getPath() const;
 };
\ No newline at end of file
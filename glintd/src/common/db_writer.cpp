@@ -0,0 +1,189 @@
+﻿#include "db_writer.h"
+
+#include <algorithm>
+#include <format>
+
+#include "logger.h"
+
+DbWriter::DbWriter(std::size_t capacity)
+    : capacity_(std::max<std::size_t>(1, capacity)) {
+    worker_ = std::thread(&DbWriter::workerLoop, this);
+}
+
+DbWriter::~DbWriter() {
+    {
+        std::scoped_lock lock(mutex_);
+        stopping_ = true;
+    }
+    work_cv_.notify_all();
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+}
+
+DbWriter::Ticket DbWriter::insertChunk(ChunkWrite chunk) {
+    std::unique_lock lock(mutex_);
+    Command command;
+    command.kind = CommandKind::Insert;
+    command.ticket = next_ticket_++;
+    command.chunk = std::move(chunk);
+    const Ticket ticket = command.ticket;
+    enqueue(std::move(command), lock);
+    return ticket;
+}
+
+void DbWriter::removeChunk(Ticket ticket) {
+    removeChunks({ticket});
+}
+
+void DbWriter::removeChunks(const std::vector<Ticket>& tickets) {
+    std::unique_lock lock(mutex_);
+    bool coalesced = false;
+    for (const Ticket ticket : tickets) {
+        if (ticket == 0) {
+            continue;
+        }
+        // Pruned before it was ever written: forget both.
+        auto pending = std::find_if(queue_.rbegin(), queue_.rend(), [&](const Command& command) {
+            return command.kind == CommandKind::Insert && command.ticket == ticket;
+        });
+        if (pending != queue_.rend()) {
+            queue_.erase(std::next(pending).base());
+            ++stats_.coalesced;
+            coalesced = true;
+            continue;
+        }
+
+        Command command;
+        command.kind = CommandKind::Remove;
+        command.ticket = ticket;
+        enqueue(std::move(command), lock);
+    }
+    if (coalesced) {
+        done_cv_.notify_all();
+    }
+}
+
+void DbWriter::enqueue(Command command, std::unique_lock<std::mutex>& lock) {
+    if (queue_.size() >= capacity_) {
+        Logger::instance().warn(std::format("DbWriter: {} writes pending, waiting for the database", queue_.size()));
+        done_cv_.wait(lock, [this] { return queue_.size() < capacity_ || stopping_; });
+    }
+    command.seq = next_seq_++;
+    queue_.push_back(std::move(command));
+    work_cv_.notify_one();
+}
+
+void DbWriter::flush() {
+    std::unique_lock lock(mutex_);
+    if (queue_.empty() && !busy_) {
+        return;
+    }
+    const uint64_t target = queue_.empty() ? inflight_seq_ : queue_.back().seq;
+    done_cv_.wait(lock, [&] { return applied_seq_ >= target || (queue_.empty() && !busy_); });
+}
+
+std::optional<int64_t> DbWriter::chunkId(Ticket ticket) const {
+    std::scoped_lock lock(mutex_);
+    auto it = chunk_ids_.find(ticket);
+    if (it == chunk_ids_.end()) {
+        return std::nullopt;
+    }
+    return it->second;
+}
+
+DbWriter::Stats DbWriter::stats() const {
+    std::scoped_lock lock(mutex_);
+    Stats stats = stats_;
+    stats.queued = queue_.size();
+    return stats;
+}
+
+void DbWriter::workerLoop() {
+    std::unique_lock lock(mutex_);
+    for (;;) {
+        work_cv_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+        if (queue_.empty()) {
+            return; // stopping with nothing left
+        }
+        std::vector<Command> batch(std::make_move_iterator(queue_.begin()), std::make_move_iterator(queue_.end()));
+        queue_.clear();
+        busy_ = true;
+        inflight_seq_ = batch.back().seq;
+        done_cv_.notify_all(); // queue space
+        lock.unlock();
+
+        apply(batch);
+
+        lock.lock();
+        busy_ = false;
+        applied_seq_ = inflight_seq_;
+        done_cv_.notify_all();
+    }
+}
+
+void DbWriter::apply(std::vector<Command>& batch) {
+    DB& db = DB::instance();
+    auto txn = db.transaction();
+    if (!txn) {
+        Logger::instance().warn(std::format("DbWriter: writing {} commands without a transaction: {}", batch.size(), txn.error()));
+    }
+
+    // Row ids are published only after the commit.
+    std::vector<std::pair<Ticket, int64_t>> inserted;
+    std::vector<Ticket> removed;
+    uint64_t failed = 0;
+    for (auto& command : batch) {
+        if (command.kind == CommandKind::Insert) {
+            const auto& chunk = command.chunk;
+            auto chunkRes = db.insertChunk(chunk.session_id, chunk.path, chunk.start_ms, chunk.end_ms, chunk.keyframe_ms);
+            if (!chunkRes) {
+                ++failed;
+                Logger::instance().warn(std::format("DbWriter: failed to record chunk {}: {}", chunk.path, chunkRes.error()));
+                continue;
+            }
+            if (auto indexRes = db.insertKeyframes(chunkRes.value(), chunk.keyframes); !indexRes) {
+                Logger::instance().warn(std::format("DbWriter: keyframe index for {} not stored: {}", chunk.path, indexRes.error()));
+            }
+            inserted.emplace_back(command.ticket, chunkRes.value());
+            continue;
+        }
+
+        int64_t rowId = -1;
+        if (auto it = std::find_if(inserted.begin(), inserted.end(), [&](const auto& entry) { return entry.first == command.ticket; });
+            it != inserted.end()) {
+            rowId = it->second;
+        } else if (auto id = chunkId(command.ticket)) {
+            rowId = *id;
+        }
+        if (rowId < 0) {
+            continue; // its insert failed
+        }
+        if (auto res = db.removeChunk(rowId); !res) {
+            ++failed;
+            Logger::instance().warn(std::format("DbWriter: failed to remove chunk {}: {}", rowId, res.error()));
+            continue;
+        }
+        removed.push_back(command.ticket);
+    }
+
+    if (txn) {
+        if (auto res = txn.value().commit(); !res) {
+            Logger::instance().error(std::format("DbWriter: commit of {} commands failed: {}", batch.size(), res.error()));
+            std::scoped_lock lock(mutex_);
+            stats_.failed += batch.size();
+            return;
+        }
+    }
+
+    std::scoped_lock lock(mutex_);
+    for (const auto& [ticket, id] : inserted) {
+        chunk_ids_[ticket] = id;
+    }
+    for (const Ticket ticket : removed) {
+        chunk_ids_.erase(ticket);
+    }
+    stats_.inserted += inserted.size();
+    stats_.removed += removed.size();
+    stats_.failed += failed;
+}
@@ -0,0 +1,91 @@
+﻿#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "db.h"
+
+// Applies chunk bookkeeping on its own thread so segment callbacks never wait
+// on SQLite. An insert is known by its ticket until the worker has written
+// it; removing a ticket whose insert is still queued drops both without
+// touching the database. Everything drained in one pass is one transaction.
+class DbWriter {
+public:
+    using Ticket = uint64_t;
+    static constexpr std::size_t kDefaultCapacity = 1024;
+
+    struct ChunkWrite {
+        int session_id{-1};
+        std::string path;
+        int64_t start_ms{0};
+        int64_t end_ms{0};
+        std::optional<int64_t> keyframe_ms;
+        std::vector<KeyframeRecord> keyframes;
+    };
+
+    struct Stats {
+        uint64_t inserted{0};
+        uint64_t removed{0};
+        uint64_t coalesced{0};
+        uint64_t failed{0};
+        std::size_t queued{0};
+    };
+
+    explicit DbWriter(std::size_t capacity = kDefaultCapacity);
+    // Writes out whatever is still queued.
+    ~DbWriter();
+
+    DbWriter(const DbWriter&) = delete;
+    DbWriter& operator=(const DbWriter&) = delete;
+
+    // Only blocks when |capacity| commands are already waiting, i.e. the
+    // database has been stalled for a long time; metadata is never dropped.
+    Ticket insertChunk(ChunkWrite chunk);
+    void removeChunk(Ticket ticket);
+    // One lock and one wake-up for a whole prune.
+    void removeChunks(const std::vector<Ticket>& tickets);
+    // Returns once every command queued before the call has been committed.
+    void flush();
+
+    [[nodiscard]] std::optional<int64_t> chunkId(Ticket ticket) const;
+    [[nodiscard]] Stats stats() const;
+
+private:
+    enum class CommandKind {
+        Insert,
+        Remove
+    };
+
+    struct Command {
+        CommandKind kind{CommandKind::Insert};
+        Ticket ticket{0};
+        uint64_t seq{0};
+        ChunkWrite chunk{};
+    };
+
+    void enqueue(Command command, std::unique_lock<std::mutex>& lock);
+    void workerLoop();
+    void apply(std::vector<Command>& batch);
+
+    mutable std::mutex mutex_;
+    std::condition_variable work_cv_;
+    std::condition_variable done_cv_;
+    std::deque<Command> queue_;
+    std::size_t capacity_;
+    Ticket next_ticket_{1};
+    uint64_t next_seq_{1};
+    uint64_t inflight_seq_{0}; // last seq of the batch being written
+    uint64_t applied_seq_{0};
+    bool busy_{false};
+    bool stopping_{false};
+    std::unordered_map<Ticket, int64_t> chunk_ids_;
+    Stats stats_{};
+    std::thread worker_;
+};
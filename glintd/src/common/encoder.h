@@ -5,6 +5,9 @@
 #include <limits>
 #include <vector>
 
+#include "frame_types.h"
+#include "packet_buffer.h"
+
 constexpr int64_t GLINT_NOPTS_VALUE = (std::numeric_limits<int64_t>::min)();
 
 enum class EncodedStreamType {
@@ -16,7 +19,7 @@ enum class EncodedStreamType {
 struct EncodedPacket {
     EncodedStreamType type{EncodedStreamType::Video};
     bool keyframe{false};
-    std::vector<uint8_t> data;
+    PacketBuffer data; // shared, never copied
     int64_t dts {GLINT_NOPTS_VALUE};
     int64_t pts{0}; // milliseconds
 };
@@ -40,10 +43,16 @@ public:
     virtual bool initVideo(const std::string& codec, int w, int h, int fps, int bitrate_kbps) = 0;
     virtual bool initAudio(const std::string& codec, int sr, int ch, int bitrate_kbps, bool mic) = 0;
     virtual bool open() = 0;
-    virtual bool pushVideoRGBA(const uint8_t* rgba, int w, int h, int stride, uint64_t pts_ms) = 0;
+    virtual bool pushVideo(const uint8_t* pixels, PixelFormat format, int w, int h, int stride, uint64_t pts_ms) = 0;
+    // Encodes the last pushed picture again at a new timestamp, skipping the
+    // conversion. Returns false if there is no picture to repeat.
+    virtual bool repeatVideo(uint64_t pts_ms) = 0;
     virtual bool pushAudioF32(const float* interleaved, int samples, int sr, int ch, uint64_t pts_ms, bool mic) = 0;
     virtual bool pull(std::vector<EncodedPacket>& out) = 0;
     virtual void flush(std::vector<EncodedPacket>& out) = 0;
+    // Readies a flushed encoder for a new stream without closing it; the
+    // next packet is a keyframe. Returns false if it has to be reopened.
+    virtual bool reset() = 0;
     virtual void close() = 0;
     virtual EncoderStreamInfo videoStream() const = 0;
     virtual EncoderStreamInfo audioStream(bool mic) const = 0;
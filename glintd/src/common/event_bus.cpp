@@ -0,0 +1,102 @@
+﻿#include "event_bus.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace {
+int64_t wallClockMs() {
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+}
+}
+
+EventSubscription::EventSubscription(std::vector<std::string> types, std::size_t capacity)
+    : types_(std::move(types)), capacity_(std::max<std::size_t>(1, capacity)) {}
+
+bool EventSubscription::wants(std::string_view type) const {
+    return types_.empty() || std::find(types_.begin(), types_.end(), type) != types_.end();
+}
+
+void EventSubscription::push(std::string line) {
+    if (closed()) {
+        return;
+    }
+    std::scoped_lock lock(mutex_);
+    if (lines_.size() >= capacity_) {
+        lines_.pop_front();
+        ++dropped_;
+    }
+    const bool wasEmpty = lines_.empty();
+    lines_.push_back(std::move(line));
+    // The reader drains everything on each notification, so only the first
+    // line after a drain needs to wake it. Called under the lock so that
+    // setNotifier({}) cannot return while a notification is in flight.
+    if (wasEmpty && notify_) {
+        notify_();
+    }
+}
+
+void EventSubscription::drain(std::string& out) {
+    std::scoped_lock lock(mutex_);
+    if (dropped_ > 0) {
+        out += nlohmann::json{{"event", "dropped"}, {"count", dropped_}}.dump();
+        out += '\n';
+        dropped_ = 0;
+    }
+    for (auto& line : lines_) {
+        out += line;
+        out += '\n';
+    }
+    lines_.clear();
+}
+
+void EventSubscription::setNotifier(std::function<void()> notify) {
+    std::scoped_lock lock(mutex_);
+    notify_ = std::move(notify);
+}
+
+void EventSubscription::close() {
+    closed_.store(true, std::memory_order_release);
+    std::scoped_lock lock(mutex_);
+    notify_ = nullptr;
+    lines_.clear();
+}
+
+EventBus& EventBus::instance() {
+    static EventBus bus;
+    return bus;
+}
+
+std::shared_ptr<EventSubscription> EventBus::subscribe(std::vector<std::string> types, std::size_t capacity) {
+    auto subscription = std::make_shared<EventSubscription>(std::move(types), capacity);
+    std::scoped_lock lock(mutex_);
+    subscribers_.push_back(subscription);
+    subscriber_count_.store(subscribers_.size(), std::memory_order_relaxed);
+    return subscription;
+}
+
+void EventBus::publish(std::string_view type, nlohmann::json fields) {
+    if (!hasSubscribers()) {
+        return;
+    }
+    if (!fields.is_object()) {
+        fields = nlohmann::json::object();
+    }
+    fields["event"] = type;
+    fields["ts_ms"] = wallClockMs();
+    // Paths are not guaranteed to be valid UTF-8.
+    const std::string line = fields.dump(-1, ' ', false, nlohmann::json::error_handler_t::replace);
+
+    std::scoped_lock lock(mutex_);
+    std::erase_if(subscribers_, [&](const std::weak_ptr<EventSubscription>& weak) {
+        auto subscription = weak.lock();
+        if (!subscription || subscription->closed()) {
+            return true;
+        }
+        if (subscription->wants(type)) {
+            subscription->push(line);
+        }
+        return false;
+    });
+    subscriber_count_.store(subscribers_.size(), std::memory_order_relaxed);
+}
@@ -0,0 +1,73 @@
+﻿#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "ipc_server.h"
+
+// One subscriber's queue of serialized event lines. It is bounded: when full
+// the oldest line is discarded and the loss is reported in-band with a
+// {"event":"dropped","count":N} line on the next drain, so a slow reader
+// never holds up the publishers.
+class EventSubscription : public IpcStream {
+public:
+    // An empty |types| list subscribes to everything.
+    EventSubscription(std::vector<std::string> types, std::size_t capacity);
+
+    [[nodiscard]] bool wants(std::string_view type) const;
+    [[nodiscard]] bool closed() const noexcept { return closed_.load(std::memory_order_acquire); }
+    void push(std::string line);
+
+    void drain(std::string& out) override;
+    void setNotifier(std::function<void()> notify) override;
+    void close() override;
+
+private:
+    const std::vector<std::string> types_;
+    const std::size_t capacity_;
+    std::mutex mutex_;
+    std::deque<std::string> lines_;
+    uint64_t dropped_{0}; // since the last drain
+    std::function<void()> notify_;
+    std::atomic<bool> closed_{false};
+};
+
+// Process-wide fan-out of daemon events to subscribers (see the "subscribe"
+// RPC). Publishing never blocks on a subscriber.
+class EventBus {
+public:
+    static constexpr std::size_t kDefaultCapacity = 256;
+
+    static EventBus& instance();
+
+    std::shared_ptr<EventSubscription> subscribe(std::vector<std::string> types = {},
+                                                 std::size_t capacity = kDefaultCapacity);
+
+    // Lets publishers skip building the payload when nobody listens.
+    [[nodiscard]] bool hasSubscribers() const noexcept {
+        return subscriber_count_.load(std::memory_order_relaxed) > 0;
+    }
+
+    // Sends {"event":type,"ts_ms":<wall clock>,...fields} to every matching
+    // subscriber.
+    void publish(std::string_view type, nlohmann::json fields = nlohmann::json::object());
+
+private:
+    EventBus() = default;
+    EventBus(const EventBus&) = delete;
+    EventBus& operator=(const EventBus&) = delete;
+
+    std::mutex mutex_;
+    std::vector<std::weak_ptr<EventSubscription>> subscribers_;
+    std::atomic<std::size_t> subscriber_count_{0};
+};
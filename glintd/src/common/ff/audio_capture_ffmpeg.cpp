@@ -78,8 +78,9 @@ bool FFmpegAudioCapture::openDevice(const std::string& device) {
     closeDevice();
     ff_init();
 
-    const AVInputFormat* input = av_find_input_format(options_.input_format.c_str());
-    if (!input) {
+    const AVInputFormat* input = options_.input_format.empty() ? nullptr
+                                                               : av_find_input_format(options_.input_format.c_str());
+    if (!input && !options_.input_format.empty()) {
         Logger::instance().error("FFmpegAudioCapture: unknown input format " + options_.input_format);
         return false;
     }
@@ -218,6 +219,10 @@ void FFmpegAudioCapture::captureLoop(AudioCallback cb) {
             std::this_thread::sleep_for(std::chrono::milliseconds(5));
             continue;
         }
+        if (ret == AVERROR_EOF && options_.loop && av_seek_frame(format_ctx_, -1, 0, AVSEEK_FLAG_BACKWARD) >= 0) {
+            avcodec_flush_buffers(codec_ctx_);
+            continue;
+        }
         if (ret == AVERROR_EOF) {
             draining = true;
             ret = avcodec_send_packet(codec_ctx_, nullptr);
@@ -262,7 +267,17 @@ void FFmpegAudioCapture::captureLoop(AudioCallback cb) {
             out.channels = options_.channels;
             out.samples = converted;
             const int sample_rate = options_.sample_rate > 0 ? options_.sample_rate : 1;
-            out.pts_ms = static_cast<uint64_t>((samples_captured_ * 1000) / sample_rate);
+            const int64_t offset_ms = (samples_captured_ * 1000) / sample_rate;
+            if (options_.timeline) {
+                if (!options_.timeline->follow(offset_ms, running_)) {
+                    av_frame_unref(frame_);
+                    running_ = false;
+                    break;
+                }
+                out.pts_ms = options_.timeline->ptsAt(offset_ms);
+            } else {
+                out.pts_ms = static_cast<uint64_t>(offset_ms);
+            }
             samples_captured_ += converted;
             out.interleaved.assign(buffer_.begin(),
                                    buffer_.begin() + static_cast<size_t>(converted) * options_.channels);
@@ -1,20 +1,26 @@
 ﻿#pragma once
 
 #include "../capture_base.h"
+#include "../capture_timeline.h"
 #include "../ffmpeg_common.h"
 
 #include <atomic>
+#include <memory>
 #include <string>
 #include <thread>
 #include <vector>
 
 struct FFmpegAudioCaptureOptions {
-    std::string input_format;
+    std::string input_format; // empty: probe, e.g. a media file given as the device
     std::vector<std::string> device_candidates;
     int sample_rate{48000};
     int channels{2};
     bool is_microphone{true};
     std::string log_prefix;
+    // File replay: stamp and pace output on this timeline instead of counting
+    // from zero, and start over at the end of the input when loop is set.
+    std::shared_ptr<CaptureTimeline> timeline{};
+    bool loop{false};
 };
 
 class FFmpegAudioCapture : public IAudioCapture {
@@ -0,0 +1,314 @@
+﻿#include "concat_remuxer.h"
+
+#include <algorithm>
+#include <format>
+#include <numeric>
+#include <system_error>
+
+#include "logger.h"
+
+namespace {
+constexpr uint64_t kProgressPacketInterval = 256;
+// Slack for ms rounding between the write-side index and the file timestamps.
+constexpr int64_t kIndexedKeyframeSlackUs = 2000;
+}
+
+void ConcatRemuxer::OutputDeleter::operator()(AVFormatContext* ctx) const noexcept {
+    if (!ctx) {
+        return;
+    }
+    if (ctx->oformat && !(ctx->oformat->flags & AVFMT_NOFILE) && ctx->pb) {
+        avio_closep(&ctx->pb);
+    }
+    avformat_free_context(ctx);
+}
+
+bool ConcatRemuxer::fail(std::string message, int err) {
+    if (err < 0) {
+        char buf[256];
+        av_strerror(err, buf, sizeof(buf));
+        message += std::format(": {}", buf);
+    }
+    last_error_ = std::move(message);
+    Logger::instance().error(std::format("ConcatRemuxer: {}", last_error_));
+    return false;
+}
+
+ConcatRemuxer::InputPtr ConcatRemuxer::openInput(const std::filesystem::path& path) {
+    AVFormatContext* raw = nullptr;
+    int rc = avformat_open_input(&raw, path.string().c_str(), nullptr, nullptr);
+    if (rc < 0) {
+        char buf[256];
+        av_strerror(rc, buf, sizeof(buf));
+        Logger::instance().warn(std::format("ConcatRemuxer: cannot open {}: {}", path.string(), buf));
+        return nullptr;
+    }
+    InputPtr input(raw);
+    rc = avformat_find_stream_info(input.get(), nullptr);
+    if (rc < 0) {
+        Logger::instance().warn(std::format("ConcatRemuxer: no stream info in {}", path.string()));
+        return nullptr;
+    }
+    return input;
+}
+
+bool ConcatRemuxer::openOutput(const AVFormatContext* first, const std::filesystem::path& output) {
+    AVFormatContext* raw = nullptr;
+    int rc = avformat_alloc_output_context2(&raw, nullptr, nullptr, output.string().c_str());
+    if (rc < 0 || !raw) {
+        return fail(std::format("cannot create output context for {}", output.string()), rc);
+    }
+    output_.reset(raw);
+
+    streams_.assign(first->nb_streams, OutputStream{});
+    for (unsigned i = 0; i < first->nb_streams; ++i) {
+        const AVStream* in = first->streams[i];
+        const auto type = in->codecpar->codec_type;
+        if (type != AVMEDIA_TYPE_VIDEO && type != AVMEDIA_TYPE_AUDIO) {
+            continue;
+        }
+        AVStream* out = avformat_new_stream(output_.get(), nullptr);
+        if (!out) {
+            return fail("cannot allocate output stream");
+        }
+        rc = avcodec_parameters_copy(out->codecpar, in->codecpar);
+        if (rc < 0) {
+            return fail("cannot copy codec parameters", rc);
+        }
+        // Tags are container specific (e.g. Matroska -> MP4).
+        out->codecpar->codec_tag = 0;
+        out->time_base = in->time_base;
+        streams_[i].stream = out;
+    }
+
+    if (!(output_->oformat->flags & AVFMT_NOFILE)) {
+        rc = avio_open(&output_->pb, output.string().c_str(), AVIO_FLAG_WRITE);
+        if (rc < 0) {
+            return fail(std::format("cannot open {}", output.string()), rc);
+        }
+    }
+    rc = avformat_write_header(output_.get(), nullptr);
+    if (rc < 0) {
+        return fail("cannot write header", rc);
+    }
+    return true;
+}
+
+bool ConcatRemuxer::copySegment(AVFormatContext* input, const RemuxInput& range, std::size_t index,
+                                RemuxProgress& progress) {
+    const AVRational usTb = av_get_time_base_q();
+    const int64_t fileStartUs = input->start_time != AV_NOPTS_VALUE ? input->start_time : 0;
+    const int videoIndex = av_find_best_stream(input, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    const std::optional<int64_t> toUs = range.to_ms
+        ? std::optional<int64_t>(fileStartUs + *range.to_ms * 1000)
+        : std::nullopt;
+
+    // Trimmed inputs start on the keyframe at or before from_ms; audio read
+    // before that keyframe is dropped.
+    bool waitForKeyframe = false;
+    int64_t minKeyframeUs = AV_NOPTS_VALUE;
+    if (range.from_ms && *range.from_ms > 0 && videoIndex >= 0) {
+        const int64_t fromUs = fileStartUs + *range.from_ms * 1000;
+        bool seeked = false;
+        if (range.from_byte && *range.from_byte > 0) {
+            // Indexed: land just before the keyframe and skip to it, instead
+            // of relying on the demuxer's own index.
+            seeked = av_seek_frame(input, -1, *range.from_byte, AVSEEK_FLAG_BYTE) >= 0;
+            if (seeked) {
+                minKeyframeUs = fromUs - kIndexedKeyframeSlackUs;
+            }
+        }
+        if (!seeked) {
+            const AVStream* video = input->streams[videoIndex];
+            const int64_t target = av_rescale_q(fromUs, usTb, video->time_base);
+            const int rc = av_seek_frame(input, videoIndex, target, AVSEEK_FLAG_BACKWARD);
+            if (rc < 0) {
+                Logger::instance().warn(std::format("ConcatRemuxer: seek failed in segment {}, copying from start", index));
+            }
+        }
+        waitForKeyframe = true;
+    }
+
+    // Everything in this segment moves by the same amount so that audio and
+    // video keep their relative offsets.
+    std::optional<int64_t> shiftUs;
+    int64_t baseUs = AV_NOPTS_VALUE;
+    if (!waitForKeyframe) {
+        baseUs = fileStartUs;
+        shiftUs = timeline_end_us_ - fileStartUs;
+    }
+    int64_t segmentEndUs = timeline_end_us_;
+    const uint64_t bytesBefore = progress.bytes_done;
+
+    PacketPtr pkt(av_packet_alloc());
+    if (!pkt) {
+        return fail("cannot allocate packet");
+    }
+
+    int rc = 0;
+    while ((rc = av_read_frame(input, pkt.get())) >= 0) {
+        if (cancelled()) {
+            av_packet_unref(pkt.get());
+            return fail("cancelled");
+        }
+        const int si = pkt->stream_index;
+        if (si < 0 || static_cast<std::size_t>(si) >= streams_.size() || !streams_[si].stream ||
+            static_cast<unsigned>(si) >= input->nb_streams) {
+            av_packet_unref(pkt.get());
+            continue;
+        }
+        if (pkt->dts == AV_NOPTS_VALUE) {
+            pkt->dts = pkt->pts;
+        }
+        if (pkt->dts == AV_NOPTS_VALUE) {
+            av_packet_unref(pkt.get());
+            continue;
+        }
+
+        const AVRational inTb = input->streams[si]->time_base;
+        const int64_t packetUs = av_rescale_q(pkt->dts, inTb, usTb);
+        if (waitForKeyframe) {
+            if (si != videoIndex || !(pkt->flags & AV_PKT_FLAG_KEY) ||
+                (minKeyframeUs != AV_NOPTS_VALUE && packetUs < minKeyframeUs)) {
+                av_packet_unref(pkt.get());
+                continue;
+            }
+            waitForKeyframe = false;
+            baseUs = av_rescale_q(pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts, inTb, usTb);
+            shiftUs = timeline_end_us_ - baseUs;
+        }
+        if (packetUs < baseUs) {
+            av_packet_unref(pkt.get());
+            continue;
+        }
+        if (toUs && packetUs > *toUs) {
+            av_packet_unref(pkt.get());
+            if (si == videoIndex || videoIndex < 0) {
+                break;
+            }
+            continue;
+        }
+        if (index == 0 && progress.packets_written == 0) {
+            snapped_start_ms_ = (baseUs - fileStartUs) / 1000;
+        }
+
+        auto& out = streams_[si];
+        const int64_t shift = av_rescale_q(*shiftUs, usTb, inTb);
+        pkt->dts += shift;
+        if (pkt->pts != AV_NOPTS_VALUE) {
+            pkt->pts += shift;
+        }
+        av_packet_rescale_ts(pkt.get(), inTb, out.stream->time_base);
+
+        if (out.last_dts != AV_NOPTS_VALUE && pkt->dts <= out.last_dts) {
+            pkt->dts = out.last_dts + 1;
+            if (pkt->pts != AV_NOPTS_VALUE) {
+                pkt->pts = std::max(pkt->pts, pkt->dts);
+            }
+        }
+        if (out.last_dts != AV_NOPTS_VALUE) {
+            out.last_delta = pkt->dts - out.last_dts;
+        }
+        out.last_dts = pkt->dts;
+
+        const int64_t ts = std::max(pkt->dts, pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts);
+        const int64_t duration = pkt->duration > 0 ? pkt->duration : out.last_delta;
+        segmentEndUs = std::max(segmentEndUs, av_rescale_q(ts + duration, out.stream->time_base, usTb));
+
+        pkt->stream_index = out.stream->index;
+        pkt->pos = -1;
+        rc = av_interleaved_write_frame(output_.get(), pkt.get());
+        if (rc < 0) {
+            return fail(std::format("write failed in segment {}", index), rc);
+        }
+
+        ++progress.packets_written;
+        if (progress_cb_ && progress.packets_written % kProgressPacketInterval == 0) {
+            const int64_t pos = input->pb ? avio_tell(input->pb) : 0;
+            progress.bytes_done = bytesBefore + static_cast<uint64_t>(std::max<int64_t>(0, pos));
+            progress_cb_(progress);
+        }
+    }
+    if (rc < 0 && rc != AVERROR_EOF) {
+        // A truncated last segment is normal after a crash; keep what was read.
+        char buf[256];
+        av_strerror(rc, buf, sizeof(buf));
+        Logger::instance().warn(std::format("ConcatRemuxer: segment {} ended early: {}", index, buf));
+    }
+
+    timeline_end_us_ = segmentEndUs;
+    return true;
+}
+
+bool ConcatRemuxer::remux(const std::vector<std::filesystem::path>& inputs, const std::filesystem::path& output) {
+    std::vector<RemuxInput> ranges;
+    ranges.reserve(inputs.size());
+    for (const auto& path : inputs) {
+        ranges.push_back(RemuxInput{path});
+    }
+    return remux(ranges, output);
+}
+
+bool ConcatRemuxer::remux(const std::vector<RemuxInput>& inputs, const std::filesystem::path& output) {
+    last_error_.clear();
+    snapped_start_ms_ = 0;
+    output_.reset();
+    streams_.clear();
+    timeline_end_us_ = 0;
+
+    if (inputs.empty()) {
+        return fail("no input segments");
+    }
+
+    RemuxProgress progress;
+    progress.segment_count = inputs.size();
+    std::vector<uint64_t> sizes(inputs.size(), 0);
+    for (std::size_t i = 0; i < inputs.size(); ++i) {
+        std::error_code ec;
+        sizes[i] = std::filesystem::file_size(inputs[i].path, ec);
+        if (ec) sizes[i] = 0;
+        progress.bytes_total += sizes[i];
+    }
+
+    bool ok = true;
+    for (std::size_t i = 0; i < inputs.size() && ok; ++i) {
+        if (cancelled()) {
+            ok = fail("cancelled");
+            break;
+        }
+        auto input = openInput(inputs[i].path);
+        if (input) {
+            if (!output_ && !openOutput(input.get(), output)) {
+                ok = false;
+                break;
+            }
+            ok = copySegment(input.get(), inputs[i], i, progress);
+        } else if (require_all_inputs_) {
+            ok = fail(std::format("cannot read segment {}", inputs[i].path.string()));
+            break;
+        }
+        progress.segment_index = i + 1;
+        progress.bytes_done = std::accumulate(sizes.begin(), sizes.begin() + static_cast<std::ptrdiff_t>(i + 1), uint64_t{0});
+        if (progress_cb_) {
+            progress_cb_(progress);
+        }
+    }
+
+    if (!output_) {
+        return ok ? fail("no readable segments") : false;
+    }
+    if (ok) {
+        const int rc = av_write_trailer(output_.get());
+        if (rc < 0) {
+            ok = fail("cannot write trailer", rc);
+        }
+    }
+    output_.reset();
+    streams_.clear();
+
+    if (!ok) {
+        std::error_code ec;
+        std::filesystem::remove(output, ec);
+    }
+    return ok;
+}
@@ -0,0 +1,100 @@
+﻿#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+struct RemuxProgress {
+    std::size_t segment_index{0};
+    std::size_t segment_count{0};
+    uint64_t bytes_done{0};
+    uint64_t bytes_total{0};
+    uint64_t packets_written{0};
+
+    [[nodiscard]] double fraction() const noexcept {
+        return bytes_total ? static_cast<double>(bytes_done) / static_cast<double>(bytes_total) : 0.0;
+    }
+};
+
+// Offsets are relative to the start of the file. A start offset snaps back
+// to the preceding video keyframe; the end offset is inclusive.
+struct RemuxInput {
+    std::filesystem::path path;
+    std::optional<int64_t> from_ms{};
+    std::optional<int64_t> to_ms{};
+    // When from_ms is a known keyframe, a file position at or before it
+    // (see KeyframeIndexEntry). Reading starts there instead of seeking by time.
+    std::optional<int64_t> from_byte{};
+};
+
+// Stream-copies a list of segments into one output file in-process. Streams
+// are matched by index, and each segment's timestamps are shifted to continue
+// from where the previous segment ended.
+class ConcatRemuxer {
+public:
+    using ProgressCallback = std::function<void(const RemuxProgress&)>;
+
+    ConcatRemuxer() = default;
+
+    void setProgressCallback(ProgressCallback cb) { progress_cb_ = std::move(cb); }
+    // Checked between packets; a cancelled run removes the partial output.
+    void setCancelFlag(const std::atomic<bool>* cancel) { cancel_ = cancel; }
+    // By default an input that cannot be opened is left out; when required,
+    // it fails the run instead.
+    void setRequireAllInputs(bool require) { require_all_inputs_ = require; }
+
+    bool remux(const std::vector<std::filesystem::path>& inputs, const std::filesystem::path& output);
+    bool remux(const std::vector<RemuxInput>& inputs, const std::filesystem::path& output);
+
+    [[nodiscard]] const std::string& lastError() const noexcept { return last_error_; }
+    // Where the first input actually started after keyframe snapping,
+    // relative to the start of that file.
+    [[nodiscard]] int64_t snappedStartMs() const noexcept { return snapped_start_ms_; }
+
+private:
+    struct InputDeleter {
+        void operator()(AVFormatContext* ctx) const noexcept { avformat_close_input(&ctx); }
+    };
+
+    struct OutputDeleter {
+        void operator()(AVFormatContext* ctx) const noexcept;
+    };
+
+    struct PacketDeleter {
+        void operator()(AVPacket* pkt) const noexcept { av_packet_free(&pkt); }
+    };
+
+    using InputPtr = std::unique_ptr<AVFormatContext, InputDeleter>;
+    using OutputPtr = std::unique_ptr<AVFormatContext, OutputDeleter>;
+    using PacketPtr = std::unique_ptr<AVPacket, PacketDeleter>;
+
+    struct OutputStream {
+        AVStream* stream{nullptr};
+        int64_t last_dts{AV_NOPTS_VALUE}; // output time base
+        int64_t last_delta{0};            // fallback duration for packets without one
+    };
+
+    InputPtr openInput(const std::filesystem::path& path);
+    bool openOutput(const AVFormatContext* first, const std::filesystem::path& output);
+    bool copySegment(AVFormatContext* input, const RemuxInput& range, std::size_t index, RemuxProgress& progress);
+    bool fail(std::string message, int err = 0);
+    [[nodiscard]] bool cancelled() const noexcept { return cancel_ && cancel_->load(std::memory_order_relaxed); }
+
+    OutputPtr output_{};
+    std::vector<OutputStream> streams_{};
+    int64_t timeline_end_us_{0}; // end of everything written so far
+    int64_t snapped_start_ms_{0};
+    ProgressCallback progress_cb_{};
+    const std::atomic<bool>* cancel_{nullptr};
+    bool require_all_inputs_{false};
+    std::string last_error_{};
+};
@@ -7,6 +7,7 @@
 #include <stdexcept>
 
 #include "logger.h"
+#include "metrics.h"
 
 extern "C" {
 #include <libavcodec/bsf.h>
@@ -14,6 +15,22 @@ extern "C" {
 }
 
 namespace {
+    struct EncoderMetrics {
+        Counter& video_frames = MetricsRegistry::instance().counter("glint_encode_video_frames_total", "Video frames submitted to the encoder");
+        Counter& video_repeats = MetricsRegistry::instance().counter("glint_encode_video_repeats_total", "Video frames re-sent from the previous conversion");
+        Counter& packets = MetricsRegistry::instance().counter("glint_encode_packets_total", "Packets produced by the encoders");
+        Counter& bytes = MetricsRegistry::instance().counter("glint_encode_bytes_total", "Encoded payload bytes");
+        Counter& errors = MetricsRegistry::instance().counter("glint_encode_errors_total", "Failed send/receive calls");
+        Histogram& convert_us = MetricsRegistry::instance().histogram("glint_encode_convert_us", "Packed RGB to YUV conversion per video frame, microseconds");
+        Histogram& video_send_us = MetricsRegistry::instance().histogram("glint_encode_video_send_us", "avcodec_send_frame for video, microseconds");
+        Histogram& audio_send_us = MetricsRegistry::instance().histogram("glint_encode_audio_send_us", "avcodec_send_frame for audio, microseconds");
+    };
+
+    EncoderMetrics& metrics() {
+        static EncoderMetrics m;
+        return m;
+    }
+
 #if LIBAVUTIL_VERSION_MAJOR >= 57
     bool copyDefaultLayout(AVChannelLayout &target, int channels) {
         AVChannelLayout layout{};
@@ -71,6 +88,15 @@ namespace {
         return codec->pix_fmts[0];
     }
 
+    AVPixelFormat toAvPixelFormat(PixelFormat format) {
+        switch (format) {
+            case PixelFormat::BGRA: return AV_PIX_FMT_BGRA;
+            case PixelFormat::BGRX: return AV_PIX_FMT_BGR0;
+            case PixelFormat::RGBX: return AV_PIX_FMT_RGB0;
+        }
+        return AV_PIX_FMT_BGRA;
+    }
+
     void copyExtradata(const AVCodecContext *ctx, EncoderStreamInfo &info) {
         if (ctx && ctx->extradata && ctx->extradata_size > 0) {
             info.extradata.assign(ctx->extradata, ctx->extradata + ctx->extradata_size);
@@ -227,6 +253,7 @@ bool FFmpegEncoder::initAudio(const std::string &codec, int sr, int ch, int br_k
     ctx->sample_fmt = chooseSampleFormat(avcodec);
     target.input_channels = ch;
     target.input_sample_rate = sr;
+    target.settings = AudioSettings{codec, sr, ch, br_kbps};
 
     target.enabled = true;
     return true;
@@ -253,109 +280,12 @@ bool FFmpegEncoder::open() {
             return false;
         }
         last_video_pts_ = GLINT_NOPTS_VALUE;
+        video_picture_ready_ = false;
         copyExtradata(video_ctx_.get(), video_stream_info_);
     }
 
-    auto setupAudio = [&](AudioEncoderState &state) {
-        if (!state.enabled || !state.ctx) {
-            return true;
-        }
-        if (avcodec_open2(state.ctx.get(), state.ctx->codec, nullptr) < 0) {
-            Logger::instance().warn("FFmpegEncoder: failed opening audio codec");
-            state.enabled = false;
-            return false;
-        }
-
-        state.frame.reset(av_frame_alloc());
-        if (!state.frame) {
-            state.enabled = false;
-            return false;
-        }
-        state.frame_samples = state.ctx->frame_size > 0 ? state.ctx->frame_size : 960;
-        state.frame->nb_samples = state.frame_samples;
-        state.frame->format = state.ctx->sample_fmt;
-#if LIBAVUTIL_VERSION_MAJOR >= 57
-        if (av_channel_layout_copy(&state.frame->ch_layout, &state.ctx->ch_layout) < 0) {
-            Logger::instance().warn("FFmpegEncoder: frame channel layout copy failed");
-            state.enabled = false;
-            return false;
-        }
-#else
-        state.frame->channel_layout = state.ctx->channel_layout;
-        state.frame->channels = state.ctx->channels;
-#endif
-        state.frame->sample_rate = state.ctx->sample_rate;
-        if (av_frame_get_buffer(state.frame.get(), 0) < 0) {
-            Logger::instance().warn("FFmpegEncoder: audio frame buffer failed");
-            state.enabled = false;
-            return false;
-        }
-
-#if LIBAVUTIL_VERSION_MAJOR >= 57
-        AVChannelLayout inputLayout{};
-        if (!copyDefaultLayout(inputLayout,
-                               state.input_channels > 0 ? state.input_channels : channelCount(state.ctx.get()))) {
-            Logger::instance().warn("FFmpegEncoder: input layout unavailable");
-            state.enabled = false;
-            return false;
-        }
-        SwrContext* resampler = nullptr;
-        if (swr_alloc_set_opts2(&resampler,
-                                &state.ctx->ch_layout,
-                                state.ctx->sample_fmt,
-                                state.ctx->sample_rate,
-                                &inputLayout,
-                                AV_SAMPLE_FMT_FLT,
-                                state.input_sample_rate > 0 ? state.input_sample_rate : state.ctx->sample_rate,
-                                0, nullptr) < 0) {
-            Logger::instance().warn("FFmpegEncoder: resampler allocation failed");
-            av_channel_layout_uninit(&inputLayout);
-            state.enabled = false;
-            return false;
-        }
-        av_channel_layout_uninit(&inputLayout);
-        state.resampler.reset(resampler);
-#else
-        uint64_t inputLayout = 0;
-        if (!copyDefaultLayout(inputLayout,
-                               state.input_channels > 0 ? state.input_channels : state.ctx->channels)) {
-            Logger::instance().warn("FFmpegEncoder: input layout unavailable");
-            state.enabled = false;
-            return false;
-        }
-        state.resampler.reset(swr_alloc_set_opts(nullptr,
-                                                 state.ctx->channel_layout,
-                                                 state.ctx->sample_fmt,
-                                                 state.ctx->sample_rate,
-                                                 inputLayout,
-                                                 AV_SAMPLE_FMT_FLT,
-                                                 state.input_sample_rate > 0 ? state.input_sample_rate : state.ctx->sample_rate,
-                                                 0, nullptr));
-#endif
-        if (!state.resampler || swr_init(state.resampler.get()) < 0) {
-            Logger::instance().warn("FFmpegEncoder: resampler init failed");
-            state.enabled = false;
-            return false;
-        }
-
-        state.fifo.reset(av_audio_fifo_alloc(state.ctx->sample_fmt,
-#if LIBAVUTIL_VERSION_MAJOR >= 57
-                                             state.ctx->ch_layout.nb_channels,
-#else
-                                             state.ctx->channels,
-#endif
-                                             state.frame_samples * 4));
-        if (!state.fifo) {
-            Logger::instance().warn("FFmpegEncoder: audio fifo alloc failed");
-            state.enabled = false;
-            return false;
-        }
-        state.samples_sent = 0;
-        return true;
-    };
-
-    setupAudio(system_audio_);
-    setupAudio(mic_audio_);
+    openAudio(system_audio_);
+    openAudio(mic_audio_);
 
     if (video_ctx_ && video_stream_info_.extradata.empty()) {
         FramePtr dummy(av_frame_alloc());
@@ -404,19 +334,149 @@ bool FFmpegEncoder::open() {
     return true;
 }
 
-bool FFmpegEncoder::prepareVideoFrame(const uint8_t *rgba, int w, int h, int stride, uint64_t pts_ms) {
+bool FFmpegEncoder::openAudio(AudioEncoderState &state) {
+    if (!state.enabled || !state.ctx) {
+        return true;
+    }
+    if (avcodec_open2(state.ctx.get(), state.ctx->codec, nullptr) < 0) {
+        Logger::instance().warn("FFmpegEncoder: failed opening audio codec");
+        state.enabled = false;
+        return false;
+    }
+
+    state.frame.reset(av_frame_alloc());
+    if (!state.frame) {
+        state.enabled = false;
+        return false;
+    }
+    state.frame_samples = state.ctx->frame_size > 0 ? state.ctx->frame_size : 960;
+    state.frame->nb_samples = state.frame_samples;
+    state.frame->format = state.ctx->sample_fmt;
+#if LIBAVUTIL_VERSION_MAJOR >= 57
+    if (av_channel_layout_copy(&state.frame->ch_layout, &state.ctx->ch_layout) < 0) {
+        Logger::instance().warn("FFmpegEncoder: frame channel layout copy failed");
+        state.enabled = false;
+        return false;
+    }
+#else
+    state.frame->channel_layout = state.ctx->channel_layout;
+    state.frame->channels = state.ctx->channels;
+#endif
+    state.frame->sample_rate = state.ctx->sample_rate;
+    if (av_frame_get_buffer(state.frame.get(), 0) < 0) {
+        Logger::instance().warn("FFmpegEncoder: audio frame buffer failed");
+        state.enabled = false;
+        return false;
+    }
+
+#if LIBAVUTIL_VERSION_MAJOR >= 57
+    AVChannelLayout inputLayout{};
+    if (!copyDefaultLayout(inputLayout,
+                           state.input_channels > 0 ? state.input_channels : channelCount(state.ctx.get()))) {
+        Logger::instance().warn("FFmpegEncoder: input layout unavailable");
+        state.enabled = false;
+        return false;
+    }
+    SwrContext* resampler = nullptr;
+    if (swr_alloc_set_opts2(&resampler,
+                            &state.ctx->ch_layout,
+                            state.ctx->sample_fmt,
+                            state.ctx->sample_rate,
+                            &inputLayout,
+                            AV_SAMPLE_FMT_FLT,
+                            state.input_sample_rate > 0 ? state.input_sample_rate : state.ctx->sample_rate,
+                            0, nullptr) < 0) {
+        Logger::instance().warn("FFmpegEncoder: resampler allocation failed");
+        av_channel_layout_uninit(&inputLayout);
+        state.enabled = false;
+        return false;
+    }
+    av_channel_layout_uninit(&inputLayout);
+    state.resampler.reset(resampler);
+#else
+    uint64_t inputLayout = 0;
+    if (!copyDefaultLayout(inputLayout,
+                           state.input_channels > 0 ? state.input_channels : state.ctx->channels)) {
+        Logger::instance().warn("FFmpegEncoder: input layout unavailable");
+        state.enabled = false;
+        return false;
+    }
+    state.resampler.reset(swr_alloc_set_opts(nullptr,
+                                             state.ctx->channel_layout,
+                                             state.ctx->sample_fmt,
+                                             state.ctx->sample_rate,
+                                             inputLayout,
+                                             AV_SAMPLE_FMT_FLT,
+                                             state.input_sample_rate > 0 ? state.input_sample_rate : state.ctx->sample_rate,
+                                             0, nullptr));
+#endif
+    if (!state.resampler || swr_init(state.resampler.get()) < 0) {
+        Logger::instance().warn("FFmpegEncoder: resampler init failed");
+        state.enabled = false;
+        return false;
+    }
+
+    state.fifo.reset(av_audio_fifo_alloc(state.ctx->sample_fmt,
+#if LIBAVUTIL_VERSION_MAJOR >= 57
+                                         state.ctx->ch_layout.nb_channels,
+#else
+                                         state.ctx->channels,
+#endif
+                                         state.frame_samples * 4));
+    if (!state.fifo) {
+        Logger::instance().warn("FFmpegEncoder: audio fifo alloc failed");
+        state.enabled = false;
+        return false;
+    }
+    state.samples_sent = 0;
+    return true;
+}
+
+bool FFmpegEncoder::prepareVideoFrame(const uint8_t *pixels, PixelFormat format, int w, int h, int stride,
+                                      uint64_t pts_ms) {
     if (!video_ctx_ || !video_frame_) {
         return false;
     }
 
-    const AVPixelFormat srcFmt = AV_PIX_FMT_BGRA;
+    ScopedTimer convertTimer(metrics().convert_us);
+    video_picture_ready_ = false;
+    const AVPixelFormat srcFmt = toAvPixelFormat(format);
     const int useStride = (stride > 0) ? stride : (w * 4);
+    const auto dstFmt = static_cast<AVPixelFormat>(video_frame_->format);
+
+    // Same-size 4:2:0 output from B, G, R byte order is by far the common
+    // case; convert it directly (the fourth byte is never read) and keep
+    // swscale for resizing and other layouts.
+    const bool directConvert = w == video_frame_->width && h == video_frame_->height &&
+                               format != PixelFormat::RGBX &&
+                               (dstFmt == AV_PIX_FMT_NV12 || dstFmt == AV_PIX_FMT_YUV420P);
+    if (directConvert) {
+        if (av_frame_make_writable(video_frame_.get()) < 0) {
+            Logger::instance().warn("FFmpegEncoder: video frame is not writable");
+            return false;
+        }
+        if (!converter_) {
+            converter_ = std::make_unique<ColorConverter>();
+            Logger::instance().info(std::format("FFmpegEncoder: color conversion uses {} with {} thread(s)",
+                                                colorConvertIsaName(converter_->isa()), converter_->threadCount()));
+        }
+        YuvPlanes planes;
+        for (int i = 0; i < 3; ++i) {
+            planes.data[i] = video_frame_->data[i];
+            planes.linesize[i] = video_frame_->linesize[i];
+        }
+        converter_->convert(pixels, useStride, w, h, planes,
+                            dstFmt == AV_PIX_FMT_NV12 ? YuvLayout::NV12 : YuvLayout::YUV420P);
+        setVideoFramePts(pts_ms);
+        video_picture_ready_ = true;
+        return true;
+    }
 
     SwsContext *newScaler = sws_getCachedContext(
         scaler_.get(),
         w, h, srcFmt,
         video_frame_->width, video_frame_->height,
-        static_cast<AVPixelFormat>(video_frame_->format),
+        dstFmt,
         SWS_BICUBIC, nullptr, nullptr, nullptr);
     if (!newScaler) {
         Logger::instance().warn("FFmpegEncoder: cannot create scaler");
@@ -445,7 +505,7 @@ bool FFmpegEncoder::prepareVideoFrame(const uint8_t *rgba, int w, int h, int str
         }
     }
 
-    const uint8_t *src[4] = {rgba, nullptr, nullptr, nullptr};
+    const uint8_t *src[4] = {pixels, nullptr, nullptr, nullptr};
     int srcStride[4] = {useStride, 0, 0, 0};
     int rc = sws_scale(scaler_.get(), src, srcStride, 0, h, video_frame_->data, video_frame_->linesize);
     if (rc <= 0) {
@@ -453,13 +513,18 @@ bool FFmpegEncoder::prepareVideoFrame(const uint8_t *rgba, int w, int h, int str
         return false;
     }
 
+    setVideoFramePts(pts_ms);
+    video_picture_ready_ = true;
+    return true;
+}
+
+void FFmpegEncoder::setVideoFramePts(uint64_t pts_ms) {
     int64_t scaled_pts = av_rescale_q(static_cast<int64_t>(pts_ms), AVRational{1, 1000}, video_ctx_->time_base);
     if (last_video_pts_ != GLINT_NOPTS_VALUE && scaled_pts <= last_video_pts_) {
         scaled_pts = last_video_pts_ + 1;
     }
     video_frame_->pts = scaled_pts;
     last_video_pts_ = scaled_pts;
-    return true;
 }
 
 bool FFmpegEncoder::encodeFrame(AVCodecContext *ctx, AVFrame *frame, EncodedStreamType type,
@@ -467,8 +532,14 @@ bool FFmpegEncoder::encodeFrame(AVCodecContext *ctx, AVFrame *frame, EncodedStre
     if (!ctx) {
         return true;
     }
-    const int send = avcodec_send_frame(ctx, frame);
+    auto& m = metrics();
+    int send = 0;
+    {
+        ScopedTimer timer(type == EncodedStreamType::Video ? m.video_send_us : m.audio_send_us);
+        send = avcodec_send_frame(ctx, frame);
+    }
     if (send < 0 && send != AVERROR_EOF) {
+        m.errors.add();
         Logger::instance().warn(std::format("FFmpegEncoder: avcodec_send_frame failed ({})", send));
         return false;
     }
@@ -485,6 +556,7 @@ bool FFmpegEncoder::encodeFrame(AVCodecContext *ctx, AVFrame *frame, EncodedStre
             break;
         }
         if (ret < 0) {
+            m.errors.add();
             Logger::instance().warn(std::format("FFmpegEncoder: avcodec_receive_packet failed ({})", ret));
             return false;
         }
@@ -504,12 +576,16 @@ bool FFmpegEncoder::encodeFrame(AVCodecContext *ctx, AVFrame *frame, EncodedStre
         } else {
             encoded.dts = GLINT_NOPTS_VALUE;
         }
-        encoded.data.assign(pkt->data, pkt->data + pkt->size);
+        // Takes over the encoder's buffer; later stages only add references.
+        encoded.data = pkt->buf ? PacketBuffer::reference(pkt->buf, pkt->data, static_cast<size_t>(pkt->size))
+                                : PacketBuffer::copyOf(pkt->data, static_cast<size_t>(pkt->size));
 
         if (type == EncodedStreamType::Video && video_stream_info_.extradata.empty() && ctx->extradata && ctx->extradata_size > 0) {
             copyExtradata(ctx, video_stream_info_);
         }
 
+        m.packets.add();
+        m.bytes.add(static_cast<uint64_t>(pkt->size));
         out.emplace_back(std::move(encoded));
         av_packet_unref(pkt.get());
     }
@@ -593,10 +669,31 @@ bool FFmpegEncoder::encodeAudioSamples(AudioEncoderState &state,
 }
 
 
-bool FFmpegEncoder::pushVideoRGBA(const uint8_t *rgba, int w, int h, int stride, uint64_t pts_ms) {
-    if (!prepareVideoFrame(rgba, w, h, stride, pts_ms)) {
+bool FFmpegEncoder::pushVideo(const uint8_t *pixels, PixelFormat format, int w, int h, int stride, uint64_t pts_ms) {
+    if (!prepareVideoFrame(pixels, format, w, h, stride, pts_ms)) {
         return false;
     }
+    return sendVideoFrame();
+}
+
+bool FFmpegEncoder::repeatVideo(uint64_t pts_ms) {
+    if (!video_ctx_ || !video_frame_ || !video_picture_ready_) {
+        return false;
+    }
+    // If the codec still references the picture this copies it; either way
+    // the pixels stay as they were.
+    if (av_frame_make_writable(video_frame_.get()) < 0) {
+        return false;
+    }
+    setVideoFramePts(pts_ms);
+    metrics().video_repeats.add();
+    return sendVideoFrame();
+}
+
+bool FFmpegEncoder::sendVideoFrame() {
+    video_frame_->pict_type = force_keyframe_ ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+    force_keyframe_ = false;
+    metrics().video_frames.add();
     return encodeFrame(video_ctx_.get(), video_frame_.get(), EncodedStreamType::Video, pending_packets_);
 }
 
@@ -621,8 +718,46 @@ void FFmpegEncoder::flush(std::vector<EncodedPacket> &out) {
 }
 
 
+bool FFmpegEncoder::flushCodec(AVCodecContext *ctx) {
+#ifdef AV_CODEC_CAP_ENCODER_FLUSH
+    if (ctx->codec && (ctx->codec->capabilities & AV_CODEC_CAP_ENCODER_FLUSH)) {
+        avcodec_flush_buffers(ctx);
+        return true;
+    }
+#endif
+    return false;
+}
+
+bool FFmpegEncoder::reset() {
+    pending_packets_.clear();
+    last_video_pts_ = GLINT_NOPTS_VALUE;
+    force_keyframe_ = true;
+    // Hardware encoders can drop their state in place. Others would need the
+    // whole video context reopened, which is up to the caller.
+    if (video_ctx_ && !flushCodec(video_ctx_.get())) {
+        return false;
+    }
+
+    // Audio codecs are cheap to reopen when they cannot be flushed.
+    auto resetAudio = [this](AudioEncoderState &state, bool mic) {
+        if (!state.enabled || !state.ctx) {
+            return true;
+        }
+        if (!flushCodec(state.ctx.get())) {
+            const AudioSettings settings = state.settings;
+            return initAudio(settings.codec, settings.sample_rate, settings.channels, settings.bitrate_kbps, mic) &&
+                   openAudio(state);
+        }
+        av_audio_fifo_reset(state.fifo.get());
+        state.samples_sent = 0;
+        return swr_init(state.resampler.get()) >= 0;
+    };
+    return resetAudio(system_audio_, false) && resetAudio(mic_audio_, true);
+}
+
 void FFmpegEncoder::close() {
     video_frame_.reset();
+    video_picture_ready_ = false;
     video_ctx_.reset();
     scaler_.reset();
     auto cleanupAudio = [](AudioEncoderState &state) {
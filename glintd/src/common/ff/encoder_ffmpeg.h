@@ -13,6 +13,7 @@ extern "C" {
 #include <libavutil/audio_fifo.h>
 }
 
+#include "color_convert.h"
 #include "encoder.h"
 
 class FFmpegEncoder : public IEncoder {
@@ -23,10 +24,12 @@ public:
     bool initVideo(const std::string& codec, int w, int h, int fps, int br_kbps) override;
     bool initAudio(const std::string& codec, int sr, int ch, int br_kbps, bool mic) override;
     bool open() override;
-    bool pushVideoRGBA(const uint8_t* rgba, int w, int h, int stride, uint64_t pts_ms) override;
+    bool pushVideo(const uint8_t* pixels, PixelFormat format, int w, int h, int stride, uint64_t pts_ms) override;
+    bool repeatVideo(uint64_t pts_ms) override;
     bool pushAudioF32(const float* interleaved, int samples, int sr, int ch, uint64_t pts_ms, bool mic) override;
     bool pull(std::vector<EncodedPacket>& out) override;
     void flush(std::vector<EncodedPacket>& out) override;
+    bool reset() override;
     void close() override;
     EncoderStreamInfo videoStream() const override;
     EncoderStreamInfo audioStream(bool mic) const override;
@@ -74,6 +77,13 @@ private:
         SwsContext* ctx_{nullptr};
     };
 
+    struct AudioSettings {
+        std::string codec;
+        int sample_rate{0};
+        int channels{0};
+        int bitrate_kbps{0};
+    };
+
     struct AudioEncoderState {
         CodecContextPtr ctx{};
         SwrContextPtr resampler{};
@@ -84,10 +94,15 @@ private:
         int input_sample_rate{0};
         int64_t samples_sent{0};
         std::string codec_name;
+        AudioSettings settings{};
         bool enabled{false};
     };
 
-    bool prepareVideoFrame(const uint8_t* rgba, int w, int h, int stride, uint64_t pts_ms);
+    bool openAudio(AudioEncoderState& state);
+    static bool flushCodec(AVCodecContext* ctx);
+    bool prepareVideoFrame(const uint8_t* pixels, PixelFormat format, int w, int h, int stride, uint64_t pts_ms);
+    bool sendVideoFrame();
+    void setVideoFramePts(uint64_t pts_ms);
     bool encodeFrame(AVCodecContext* ctx, AVFrame* frame, EncodedStreamType type, std::vector<EncodedPacket>& out);
     bool encodeAudioSamples(AudioEncoderState& state, const float* interleaved, int samples, int sr, int ch,
                             uint64_t pts_ms, EncodedStreamType type, std::vector<EncodedPacket>& out);
@@ -96,12 +111,15 @@ private:
     CodecContextPtr video_ctx_{};
     FramePtr video_frame_{};
     SwsContextHandle scaler_{};
+    std::unique_ptr<ColorConverter> converter_{};
     int video_width_{0};
     int video_height_{0};
     int video_stride_{0};
     int video_fps_{0};
     std::string video_codec_;
     int64_t last_video_pts_{GLINT_NOPTS_VALUE};
+    bool force_keyframe_{false};
+    bool video_picture_ready_{false}; // video_frame_ holds a complete converted picture
 
     AudioEncoderState system_audio_;
     AudioEncoderState mic_audio_;
@@ -0,0 +1,195 @@
+﻿#include "file_replay_capture.h"
+
+#include <algorithm>
+#include <format>
+
+#include "../ffmpeg_common.h"
+#include "logger.h"
+
+FileReplayVideoCapture::FileReplayVideoCapture(FileReplayOptions options, std::shared_ptr<CaptureTimeline> timeline)
+    : options_(std::move(options)), timeline_(std::move(timeline)) {
+    options_.pool_size = std::max(2, options_.pool_size);
+}
+
+FileReplayVideoCapture::~FileReplayVideoCapture() {
+    stop();
+}
+
+bool FileReplayVideoCapture::start(VideoCallback cb) {
+    if (running_) return true;
+    if (!open()) {
+        close();
+        return false;
+    }
+    timeline_->restart();
+    running_ = true;
+    worker_ = std::thread([this, cb] { captureLoop(cb); });
+    return true;
+}
+
+void FileReplayVideoCapture::stop() {
+    if (!running_) return;
+    running_ = false;
+    timeline_->stop();
+    if (worker_.joinable()) worker_.join();
+    close();
+}
+
+bool FileReplayVideoCapture::open() {
+    ff_init();
+    const auto path = options_.path.string();
+    AVFormatContext* raw = nullptr;
+    int rc = avformat_open_input(&raw, path.c_str(), nullptr, nullptr);
+    if (rc < 0) {
+        Logger::instance().error(std::format("FileReplayVideoCapture: cannot open {}: {}", path, ff_errstr(rc)));
+        return false;
+    }
+    input_.reset(raw);
+    if ((rc = avformat_find_stream_info(input_.get(), nullptr)) < 0) {
+        Logger::instance().error(std::format("FileReplayVideoCapture: no stream info in {}: {}", path, ff_errstr(rc)));
+        return false;
+    }
+
+    const AVCodec* codec = nullptr;
+    stream_index_ = av_find_best_stream(input_.get(), AVMEDIA_TYPE_VIDEO, -1, -1, &codec, 0);
+    if (stream_index_ < 0 || !codec) {
+        Logger::instance().error(std::format("FileReplayVideoCapture: no decodable video stream in {}", path));
+        return false;
+    }
+    decoder_.reset(avcodec_alloc_context3(codec));
+    if (!decoder_ ||
+        avcodec_parameters_to_context(decoder_.get(), input_->streams[stream_index_]->codecpar) < 0 ||
+        avcodec_open2(decoder_.get(), codec, nullptr) < 0) {
+        Logger::instance().error(std::format("FileReplayVideoCapture: cannot open decoder for {}", path));
+        return false;
+    }
+    frame_.reset(av_frame_alloc());
+    packet_.reset(av_packet_alloc());
+    if (!frame_ || !packet_) {
+        return false;
+    }
+
+    width_ = decoder_->width;
+    height_ = decoder_->height;
+    if (width_ <= 0 || height_ <= 0) {
+        Logger::instance().error(std::format("FileReplayVideoCapture: {} has no frame size", path));
+        return false;
+    }
+    if (!pool_ || pool_->bufferSize() != static_cast<size_t>(width_) * 4 * height_) {
+        pool_ = FramePool::create(static_cast<size_t>(width_) * 4 * height_, static_cast<size_t>(options_.pool_size));
+    }
+    const AVRational frameRate = av_guess_frame_rate(input_.get(), input_->streams[stream_index_], nullptr);
+    frame_duration_ms_ = frameRate.num > 0 ? std::max<int64_t>(1, av_rescale(1000, frameRate.den, frameRate.num)) : 33;
+    first_ms_ = AV_NOPTS_VALUE;
+    loop_offset_ms_ = 0;
+    last_offset_ms_ = -1;
+    Logger::instance().info(std::format("FileReplayVideoCapture: replaying {} ({}x{}, {}{})", path, width_, height_,
+                                        timeline_->realtime() ? "real time" : "unthrottled",
+                                        options_.loop ? ", looping" : ""));
+    return true;
+}
+
+void FileReplayVideoCapture::close() {
+    scaler_.reset();
+    packet_.reset();
+    frame_.reset();
+    decoder_.reset();
+    input_.reset();
+    stream_index_ = -1;
+}
+
+bool FileReplayVideoCapture::decodeNext() {
+    for (;;) {
+        int rc = avcodec_receive_frame(decoder_.get(), frame_.get());
+        if (rc >= 0) {
+            return true;
+        }
+        if (rc == AVERROR_EOF) {
+            if (!options_.loop || av_seek_frame(input_.get(), stream_index_, 0, AVSEEK_FLAG_BACKWARD) < 0) {
+                return false;
+            }
+            avcodec_flush_buffers(decoder_.get());
+            loop_offset_ms_ = last_offset_ms_ + frame_duration_ms_;
+            first_ms_ = AV_NOPTS_VALUE;
+            continue;
+        }
+        if (rc != AVERROR(EAGAIN)) {
+            Logger::instance().warn(std::format("FileReplayVideoCapture: decode failed: {}", ff_errstr(rc)));
+            return false;
+        }
+
+        rc = av_read_frame(input_.get(), packet_.get());
+        if (rc == AVERROR_EOF) {
+            avcodec_send_packet(decoder_.get(), nullptr);
+            continue;
+        }
+        if (rc < 0) {
+            Logger::instance().warn(std::format("FileReplayVideoCapture: read failed: {}", ff_errstr(rc)));
+            return false;
+        }
+        if (packet_->stream_index == stream_index_) {
+            avcodec_send_packet(decoder_.get(), packet_.get());
+        }
+        av_packet_unref(packet_.get());
+    }
+}
+
+bool FileReplayVideoCapture::convert(VideoFrame& frame) {
+    // BGRA goes straight into the encoder's direct converter.
+    scaler_.reset(sws_getCachedContext(scaler_.release(), frame_->width, frame_->height,
+                                       static_cast<AVPixelFormat>(frame_->format), width_, height_,
+                                       AV_PIX_FMT_BGRA, SWS_BILINEAR, nullptr, nullptr, nullptr));
+    if (!scaler_) {
+        return false;
+    }
+    uint8_t* dst[4] = {frame.data(), nullptr, nullptr, nullptr};
+    int dstStride[4] = {frame.stride, 0, 0, 0};
+    return sws_scale(scaler_.get(), frame_->data, frame_->linesize, 0, frame_->height, dst, dstStride) > 0;
+}
+
+void FileReplayVideoCapture::captureLoop(const VideoCallback& cb) {
+    const AVRational msTb{1, 1000};
+    const AVStream* stream = input_->streams[stream_index_];
+
+    while (running_ && decodeNext()) {
+        const int64_t ts = frame_->best_effort_timestamp;
+        const int64_t ms = ts != AV_NOPTS_VALUE ? av_rescale_q(ts, stream->time_base, msTb) : 0;
+        if (first_ms_ == AV_NOPTS_VALUE) {
+            first_ms_ = ms;
+        }
+        // Timestamps keep increasing across loops and odd input timestamps.
+        const int64_t offsetMs = std::max(last_offset_ms_ + 1, loop_offset_ms_ + ms - first_ms_);
+        last_offset_ms_ = offsetMs;
+
+        FrameBuffer buffer = pool_->acquire();
+        while (!buffer && running_ && !timeline_->realtime()) {
+            std::this_thread::yield();
+            buffer = pool_->acquire();
+        }
+        if (!buffer) {
+            // Real time: downstream is behind, drop the frame like screen capture would.
+            timeline_->pace(offsetMs);
+            av_frame_unref(frame_.get());
+            continue;
+        }
+
+        VideoFrame frame;
+        frame.width = width_;
+        frame.height = height_;
+        frame.stride = width_ * 4;
+        frame.format = PixelFormat::BGRA;
+        frame.buffer = std::move(buffer);
+        const bool converted = convert(frame);
+        av_frame_unref(frame_.get());
+        if (!converted) {
+            Logger::instance().warn("FileReplayVideoCapture: pixel conversion failed");
+            continue;
+        }
+        timeline_->pace(offsetMs);
+        frame.pts_ms = timeline_->ptsAt(offsetMs);
+        cb(frame);
+    }
+    if (running_) {
+        Logger::instance().info(std::format("FileReplayVideoCapture: end of {}", options_.path.string()));
+    }
+}
@@ -0,0 +1,76 @@
+﻿#pragma once
+
+#include <atomic>
+#include <filesystem>
+#include <memory>
+#include <thread>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libswscale/swscale.h>
+}
+
+#include "../capture_base.h"
+#include "../capture_timeline.h"
+
+struct FileReplayOptions {
+    std::filesystem::path path;
+    bool loop{true};
+    int pool_size{8};
+};
+
+// Decodes the video stream of a media file and hands it on as captured
+// frames at the file's resolution, timed by the file's own timestamps on the
+// shared timeline. Pair with FFmpegAudioCapture on the same file for sound.
+class FileReplayVideoCapture : public IVideoCapture {
+public:
+    FileReplayVideoCapture(FileReplayOptions options, std::shared_ptr<CaptureTimeline> timeline);
+    ~FileReplayVideoCapture() override;
+
+    bool start(VideoCallback cb) override;
+    void stop() override;
+
+private:
+    struct InputDeleter {
+        void operator()(AVFormatContext* ctx) const noexcept { avformat_close_input(&ctx); }
+    };
+    struct CodecContextDeleter {
+        void operator()(AVCodecContext* ctx) const noexcept { avcodec_free_context(&ctx); }
+    };
+    struct FrameDeleter {
+        void operator()(AVFrame* frame) const noexcept { av_frame_free(&frame); }
+    };
+    struct PacketDeleter {
+        void operator()(AVPacket* pkt) const noexcept { av_packet_free(&pkt); }
+    };
+    struct ScalerDeleter {
+        void operator()(SwsContext* ctx) const noexcept { sws_freeContext(ctx); }
+    };
+
+    bool open();
+    void close();
+    // Next decoded frame; rewinds at the end when looping. False at the end
+    // of input or on error.
+    bool decodeNext();
+    bool convert(VideoFrame& frame);
+    void captureLoop(const VideoCallback& cb);
+
+    FileReplayOptions options_;
+    std::shared_ptr<CaptureTimeline> timeline_;
+    std::unique_ptr<AVFormatContext, InputDeleter> input_;
+    std::unique_ptr<AVCodecContext, CodecContextDeleter> decoder_;
+    std::unique_ptr<AVFrame, FrameDeleter> frame_;
+    std::unique_ptr<AVPacket, PacketDeleter> packet_;
+    std::unique_ptr<SwsContext, ScalerDeleter> scaler_;
+    std::shared_ptr<FramePool> pool_;
+    int stream_index_{-1};
+    int width_{0};
+    int height_{0};
+    int64_t first_ms_{AV_NOPTS_VALUE}; // of the current pass through the file
+    int64_t loop_offset_ms_{0};        // timeline position where the current pass started
+    int64_t last_offset_ms_{-1};       // timeline position of the last frame
+    int64_t frame_duration_ms_{33};
+    std::atomic<bool> running_{false};
+    std::thread worker_;
+};
@@ -16,10 +16,24 @@ extern "C" {
 }
 
 #include "logger.h"
+#include "metrics.h"
 
 namespace {
 constexpr AVRational kMsTimeBase{1, 1000};
 
+struct MuxerMetrics {
+    Counter& packets = MetricsRegistry::instance().counter("glint_mux_packets_total", "Packets written to segment files");
+    Counter& bytes = MetricsRegistry::instance().counter("glint_mux_bytes_total", "Payload bytes written to segment files");
+    Counter& errors = MetricsRegistry::instance().counter("glint_mux_write_errors_total", "Failed packet writes");
+    Histogram& write_us = MetricsRegistry::instance().histogram("glint_mux_write_us", "av_interleaved_write_frame, microseconds");
+    Histogram& close_us = MetricsRegistry::instance().histogram("glint_mux_close_us", "Trailer and flush when a file is closed, microseconds");
+};
+
+MuxerMetrics& metrics() {
+    static MuxerMetrics m;
+    return m;
+}
+
 #if LIBAVUTIL_VERSION_MAJOR >= 57
 bool setChannelsNoLayout(AVCodecParameters* params, int channels) {
     if (!params || channels <= 0) {
@@ -93,6 +107,31 @@ std::optional<MuxerError> MuxerAvFormat::lastError() const noexcept {
     return last_error_;
 }
 
+std::vector<KeyframeIndexEntry> MuxerAvFormat::keyframeIndex() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return keyframe_index_;
+}
+
+MuxerStats MuxerAvFormat::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+// avio_tell() is the buffered write position; pb->pos is where the last
+// flush left the file. Neither touches the file system.
+void MuxerAvFormat::updateByteCountsUnlocked() noexcept {
+    if (!ctx_ || !ctx_->pb) {
+        return;
+    }
+    const int64_t position = avio_tell(ctx_->pb);
+    if (position > 0) {
+        stats_.bytes_written = std::max(stats_.bytes_written, static_cast<uint64_t>(position));
+    }
+    if (ctx_->pb->pos > 0) {
+        stats_.flushed_bytes = std::max(stats_.flushed_bytes, static_cast<uint64_t>(ctx_->pb->pos));
+    }
+}
+
 bool MuxerAvFormat::checkSanity() const noexcept {
     std::scoped_lock<std::mutex> lock(mutex_);
     if (!ctx_) {
@@ -180,6 +219,8 @@ bool MuxerAvFormat::open(const MuxerConfig& cfg,
 
     std::scoped_lock<std::mutex> lock(mutex_);
     resetStateUnlocked();
+    keyframe_index_.clear();
+    stats_ = MuxerStats{};
     config_ = cfg;
     output_path_ = cfg.path;
 
@@ -459,7 +500,16 @@ bool MuxerAvFormat::ensureHeader(const EncodedPacket& packet, AVStream* stream)
         }
     }
 
-
+    // Lets session recovery place a file on the capture clock without a DB row.
+    int64_t startMs = packet.type == EncodedStreamType::Video ? packet.pts : GLINT_NOPTS_VALUE;
+    for (const auto& pending : pending_packets_) {
+        if (pending.type == EncodedStreamType::Video && (startMs == GLINT_NOPTS_VALUE || pending.pts < startMs)) {
+            startMs = pending.pts;
+        }
+    }
+    if (startMs != GLINT_NOPTS_VALUE) {
+        av_dict_set(&ctx_->metadata, kSegmentStartTag, std::to_string(startMs).c_str(), 0);
+    }
 
     int ret = avformat_write_header(ctx_.get(), nullptr);
     if (ret < 0) {
@@ -554,12 +604,15 @@ bool MuxerAvFormat::writePacketUnlocked(const EncodedPacket& packet, AVStream* s
         }
     }
 
-    PacketPtr pkt(av_packet_alloc());
-    if (!pkt) {
-        Logger::instance().error("MuxerAvFormat: failed to allocate AVPacket");
-        setError(MuxerError::OutOfMemory);
-        return false;
+    if (!write_packet_) {
+        write_packet_.reset(av_packet_alloc());
+        if (!write_packet_) {
+            Logger::instance().error("MuxerAvFormat: failed to allocate AVPacket");
+            setError(MuxerError::OutOfMemory);
+            return false;
+        }
     }
+    AVPacket* pkt = write_packet_.get();
 
     pkt->stream_index = stream->index;
     pkt->pts = pkt_pts;
@@ -569,17 +622,48 @@ bool MuxerAvFormat::writePacketUnlocked(const EncodedPacket& packet, AVStream* s
     if (packet.keyframe) {
         pkt->flags |= AV_PKT_FLAG_KEY;
     }
+    // With a buffer reference the muxer can keep the payload for
+    // interleaving without copying it; bare payloads are copied by libavformat.
+    if (packet.data.ref()) {
+        pkt->buf = av_buffer_ref(packet.data.ref());
+        if (!pkt->buf) {
+            setError(MuxerError::OutOfMemory);
+            return false;
+        }
+    }
     pkt->data = const_cast<uint8_t*>(packet.data.data());
     pkt->size = static_cast<int>(packet.data.size());
 
-    const int ret = av_interleaved_write_frame(ctx_.get(), pkt.get());
+    // Taken before the write: interleaving and cluster buffering only ever
+    // put the keyframe at or after this position.
+    if (packet.type == EncodedStreamType::Video && packet.keyframe && ctx_->pb) {
+        keyframe_index_.push_back(KeyframeIndexEntry{packet.pts, avio_tell(ctx_->pb)});
+    }
+
+    auto& m = metrics();
+    int ret = 0;
+    {
+        ScopedTimer timer(m.write_us);
+        ret = av_interleaved_write_frame(ctx_.get(), pkt);
+    }
+    // Leaves the packet blank again; a failed write may still hold our ref.
+    av_packet_unref(pkt);
     if (ret < 0) {
+        m.errors.add();
         logAvError(ret, "MuxerAvFormat: av_interleaved_write_frame");
         setError(MuxerError::PacketWriteFailed);
         return false;
     }
 
+    m.packets.add();
+    m.bytes.add(packet.data.size());
     ++state.packets_written;
+    switch (packet.type) {
+        case EncodedStreamType::Video: ++stats_.video_packets; break;
+        case EncodedStreamType::SystemAudio: ++stats_.system_audio_packets; break;
+        case EncodedStreamType::MicrophoneAudio: ++stats_.mic_audio_packets; break;
+    }
+    updateByteCountsUnlocked();
     return true;
 }
 
@@ -620,6 +704,7 @@ bool MuxerAvFormat::close() {
     bool ok = true;
 
     if (ctx_) {
+        ScopedTimer timer(metrics().close_us);
         if (header_written_) {
             int ret = av_write_trailer(ctx_.get());
             if (ret < 0) {
@@ -629,6 +714,10 @@ bool MuxerAvFormat::close() {
         }
         if (ctx_->pb) {
             avio_flush(ctx_->pb);
+            // The largest position seen is the file size, even though the
+            // trailer seeks back to patch the header.
+            updateByteCountsUnlocked();
+            stats_.flushed_bytes = stats_.bytes_written;
         }
     }
 
@@ -27,9 +27,14 @@ public:
     bool write(const EncodedPacket& packet) override;
     bool close() override;
 
-    [[nodiscard]] std::optional<MuxerError> lastError() const noexcept;
+    [[nodiscard]] std::optional<MuxerError> lastError() const noexcept override;
+    [[nodiscard]] std::vector<KeyframeIndexEntry> keyframeIndex() const override;
+    [[nodiscard]] MuxerStats stats() const override;
     [[nodiscard]] bool checkSanity() const noexcept;
 
+    // SPS/PPS NAL units of an Annex B keyframe, as codec extradata.
+    static std::vector<uint8_t> extractH264ExtradataFromAnnexB(const uint8_t* data, int size);
+
 private:
     struct StreamClock {
         int64_t base_ms{GLINT_NOPTS_VALUE};
@@ -68,10 +73,10 @@ private:
     static AVRational ensureValid(const AVRational& value, AVRational fallback) noexcept;
     static int streamIndex(EncodedStreamType type) noexcept;
     static void logAvError(int err, const std::string& context);
-    static std::vector<uint8_t> extractH264ExtradataFromAnnexB(const uint8_t* data, int size);
     static std::string determineContainer(const MuxerConfig& cfg, const std::filesystem::path& outputPath);
 
     void resetStateUnlocked();
+    void updateByteCountsUnlocked() noexcept;
     void setError(MuxerError error) noexcept;
 
     mutable std::mutex mutex_;
@@ -85,7 +90,10 @@ private:
     int system_stream_{-1};
     int mic_stream_{-1};
     std::deque<EncodedPacket> pending_packets_{};
+    PacketPtr write_packet_{}; // reused for every write
     std::array<StreamState, 3> stream_states_{};
+    std::vector<KeyframeIndexEntry> keyframe_index_{};
+    MuxerStats stats_{};
 
     std::vector<uint8_t> cached_video_extradata_;
 
@@ -0,0 +1,92 @@
+﻿#include "segment_probe.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <format>
+#include <memory>
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+namespace {
+struct InputDeleter {
+    void operator()(AVFormatContext* ctx) const noexcept { avformat_close_input(&ctx); }
+};
+
+struct PacketDeleter {
+    void operator()(AVPacket* pkt) const noexcept { av_packet_free(&pkt); }
+};
+
+std::string errorText(int err) {
+    char buf[256];
+    av_strerror(err, buf, sizeof(buf));
+    return buf;
+}
+}
+
+glint::Expected<SegmentProbe, std::string> probeSegment(const std::filesystem::path& path) {
+    AVFormatContext* raw = nullptr;
+    int rc = avformat_open_input(&raw, path.string().c_str(), nullptr, nullptr);
+    if (rc < 0) {
+        return glint::unexpected(std::format("cannot open {}: {}", path.string(), errorText(rc)));
+    }
+    std::unique_ptr<AVFormatContext, InputDeleter> input(raw);
+
+    const int videoIndex = av_find_best_stream(input.get(), AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    if (videoIndex < 0) {
+        return glint::unexpected(std::format("no video stream in {}", path.string()));
+    }
+    const AVRational videoTb = input->streams[videoIndex]->time_base;
+    const AVRational msTb{1, 1000};
+
+    std::unique_ptr<AVPacket, PacketDeleter> pkt(av_packet_alloc());
+    if (!pkt) {
+        return glint::unexpected(std::string("cannot allocate AVPacket"));
+    }
+
+    SegmentProbe probe;
+    probe.finalized = input->duration != AV_NOPTS_VALUE && input->duration > 0;
+    if (const AVDictionaryEntry* tag = av_dict_get(input->metadata, kSegmentStartTag, nullptr, 0)) {
+        char* end = nullptr;
+        const long long value = std::strtoll(tag->value, &end, 10);
+        if (end != tag->value && *end == '\0') {
+            probe.start_ms = value;
+        }
+    }
+    int64_t firstMs = AV_NOPTS_VALUE;
+    int64_t lastMs = 0;
+    // A file cut off mid-cluster ends in a read error; what came before it
+    // is still usable.
+    while (av_read_frame(input.get(), pkt.get()) >= 0) {
+        if (pkt->stream_index == videoIndex) {
+            const int64_t ts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+            if (ts != AV_NOPTS_VALUE) {
+                const int64_t ms = av_rescale_q(ts, videoTb, msTb);
+                if (firstMs == AV_NOPTS_VALUE) {
+                    firstMs = ms;
+                }
+                const int64_t endMs = ms + (pkt->duration > 0 ? av_rescale_q(pkt->duration, videoTb, msTb) : 0);
+                lastMs = std::max(lastMs, endMs);
+                if (pkt->flags & AV_PKT_FLAG_KEY) {
+                    probe.keyframes.push_back(KeyframeIndexEntry{ms, pkt->pos});
+                }
+                ++probe.video_packets;
+            }
+        }
+        av_packet_unref(pkt.get());
+    }
+    if (probe.video_packets == 0) {
+        return glint::unexpected(std::format("no video packets in {}", path.string()));
+    }
+
+    for (auto& keyframe : probe.keyframes) {
+        keyframe.pts_ms -= firstMs;
+    }
+    probe.duration_ms = std::max<int64_t>(0, lastMs - firstMs);
+    if (input->pb) {
+        const int64_t size = avio_size(input->pb);
+        probe.size_bytes = size > 0 ? static_cast<uint64_t>(size) : 0;
+    }
+    return probe;
+}
@@ -0,0 +1,26 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "expected.h"
+#include "muxer.h"
+
+// What a segment holds, read from packet headers only (no decoding and no
+// stream-info probing). Times are relative to the first video packet.
+struct SegmentProbe {
+    int64_t duration_ms{0};
+    uint64_t size_bytes{0};
+    uint64_t video_packets{0};
+    // Duration was in the header, i.e. the muxer wrote its trailer.
+    bool finalized{false};
+    // Capture-clock time of the first video packet (kSegmentStartTag), if
+    // the muxer recorded it.
+    std::optional<int64_t> start_ms;
+    std::vector<KeyframeIndexEntry> keyframes;
+};
+
+glint::Expected<SegmentProbe, std::string> probeSegment(const std::filesystem::path& path);
@@ -0,0 +1,140 @@
+﻿#include "frame_types.h"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <utility>
+
+namespace {
+std::atomic<uint64_t> next_sequence{1};
+}
+
+FrameBuffer::FrameBuffer(const FrameBuffer& other) noexcept
+    : slot_(other.slot_) {
+    if (slot_) {
+        slot_->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+FrameBuffer::FrameBuffer(FrameBuffer&& other) noexcept
+    : slot_(other.slot_) {
+    other.slot_ = nullptr;
+}
+
+FrameBuffer& FrameBuffer::operator=(const FrameBuffer& other) noexcept {
+    if (this != &other) {
+        if (other.slot_) {
+            other.slot_->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+        reset();
+        slot_ = other.slot_;
+    }
+    return *this;
+}
+
+FrameBuffer& FrameBuffer::operator=(FrameBuffer&& other) noexcept {
+    if (this != &other) {
+        reset();
+        slot_ = other.slot_;
+        other.slot_ = nullptr;
+    }
+    return *this;
+}
+
+FrameBuffer::~FrameBuffer() {
+    reset();
+}
+
+void FrameBuffer::reset() noexcept {
+    FrameSlot* slot = slot_;
+    slot_ = nullptr;
+    if (slot && slot->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        slot->pool->release(slot);
+    }
+}
+
+std::shared_ptr<FramePool> FramePool::create(std::size_t bufferBytes, std::size_t count) {
+    return std::shared_ptr<FramePool>(new FramePool(bufferBytes, count));
+}
+
+FramePool::FramePool(std::size_t bufferBytes, std::size_t count)
+    : buffer_bytes_(bufferBytes) {
+    slots_.reserve(count);
+    free_.reserve(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        auto slot = std::make_unique<FrameSlot>();
+        slot->data = static_cast<uint8_t*>(::operator new(bufferBytes, std::align_val_t{kFrameBufferAlignment}));
+        slot->capacity = bufferBytes;
+        // Touch every page up front so the capture thread never takes the first-use faults.
+        std::memset(slot->data, 0, bufferBytes);
+        free_.push_back(slot.get());
+        slots_.push_back(std::move(slot));
+    }
+}
+
+std::shared_ptr<FramePool> FramePool::adopt(uint8_t* memory, std::size_t bufferBytes, std::size_t count,
+                                            std::function<void()> release) {
+    return std::shared_ptr<FramePool>(new FramePool(memory, bufferBytes, count, std::move(release)));
+}
+
+FramePool::FramePool(uint8_t* memory, std::size_t bufferBytes, std::size_t count, std::function<void()> release)
+    : buffer_bytes_(bufferBytes), release_memory_(std::move(release)) {
+    slots_.reserve(count);
+    free_.reserve(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        auto slot = std::make_unique<FrameSlot>();
+        slot->data = memory + i * bufferBytes;
+        slot->capacity = bufferBytes;
+        free_.push_back(slot.get());
+        slots_.push_back(std::move(slot));
+    }
+}
+
+FramePool::~FramePool() {
+    if (release_memory_) {
+        release_memory_();
+        return;
+    }
+    for (auto& slot : slots_) {
+        ::operator delete(slot->data, std::align_val_t{kFrameBufferAlignment});
+        slot->data = nullptr;
+    }
+}
+
+FrameBuffer FramePool::acquire() {
+    FrameSlot* slot = nullptr;
+    {
+        std::scoped_lock lock(mutex_);
+        if (free_.empty()) {
+            ++exhausted_;
+            return {};
+        }
+        slot = free_.back();
+        free_.pop_back();
+        ++acquired_;
+        peak_in_use_ = std::max(peak_in_use_, slots_.size() - free_.size());
+    }
+    slot->refs.store(1, std::memory_order_relaxed);
+    slot->sequence = next_sequence.fetch_add(1, std::memory_order_relaxed);
+    slot->pool = shared_from_this();
+    return FrameBuffer(slot);
+}
+
+void FramePool::release(FrameSlot* slot) noexcept {
+    // The last handle may also hold the last reference to the pool, so the
+    // keep-alive must outlive the free-list update.
+    std::shared_ptr<FramePool> keepAlive = std::move(slot->pool);
+    std::scoped_lock lock(mutex_);
+    free_.push_back(slot);
+}
+
+FramePool::Stats FramePool::stats() const {
+    std::scoped_lock lock(mutex_);
+    Stats stats;
+    stats.acquired = acquired_;
+    stats.exhausted = exhausted_;
+    stats.in_use = slots_.size() - free_.size();
+    stats.peak_in_use = peak_in_use_;
+    stats.capacity = slots_.size();
+    return stats;
+}
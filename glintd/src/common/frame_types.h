@@ -1,14 +1,112 @@
 ﻿#pragma once
 
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <vector>
 
+class FramePool;
+
+inline constexpr std::size_t kFrameBufferAlignment = 64;
+
+struct FrameSlot {
+    uint8_t* data{nullptr};
+    std::size_t capacity{0};
+    std::atomic<uint32_t> refs{0};
+    uint64_t sequence{0}; // set on every acquire
+    std::shared_ptr<FramePool> pool; // keeps the pool alive while the slot is lent out
+};
+
+// Reference-counted handle to a pooled buffer. Copies share the same memory;
+// the buffer goes back to its pool when the last handle is released.
+class FrameBuffer {
+public:
+    FrameBuffer() = default;
+    FrameBuffer(const FrameBuffer& other) noexcept;
+    FrameBuffer(FrameBuffer&& other) noexcept;
+    FrameBuffer& operator=(const FrameBuffer& other) noexcept;
+    FrameBuffer& operator=(FrameBuffer&& other) noexcept;
+    ~FrameBuffer();
+
+    [[nodiscard]] uint8_t* data() const noexcept { return slot_ ? slot_->data : nullptr; }
+    [[nodiscard]] std::size_t capacity() const noexcept { return slot_ ? slot_->capacity : 0; }
+    // Process-wide id of the acquire this handle came from; a recycled buffer
+    // gets a new one, so equal ids mean the same, unmodified pixels. 0 if empty.
+    [[nodiscard]] uint64_t sequence() const noexcept { return slot_ ? slot_->sequence : 0; }
+    [[nodiscard]] explicit operator bool() const noexcept { return slot_ != nullptr; }
+    void reset() noexcept;
+
+private:
+    friend class FramePool;
+    explicit FrameBuffer(FrameSlot* slot) noexcept : slot_(slot) {}
+
+    FrameSlot* slot_{nullptr};
+};
+
+// Fixed set of preallocated, aligned frame buffers. acquire() never allocates;
+// it returns an empty handle when every buffer is in flight.
+class FramePool : public std::enable_shared_from_this<FramePool> {
+public:
+    struct Stats {
+        uint64_t acquired{0};
+        uint64_t exhausted{0};
+        std::size_t in_use{0};
+        std::size_t peak_in_use{0};
+        std::size_t capacity{0};
+    };
+
+    static std::shared_ptr<FramePool> create(std::size_t bufferBytes, std::size_t count);
+    // Carves |count| buffers out of caller-owned memory laid out back to back
+    // (e.g. a shared memory segment the X server writes into). |release| runs
+    // once the pool and every buffer it lent out are gone.
+    static std::shared_ptr<FramePool> adopt(uint8_t* memory, std::size_t bufferBytes, std::size_t count,
+                                            std::function<void()> release);
+    ~FramePool();
+
+    FramePool(const FramePool&) = delete;
+    FramePool& operator=(const FramePool&) = delete;
+
+    [[nodiscard]] FrameBuffer acquire();
+    [[nodiscard]] std::size_t bufferSize() const noexcept { return buffer_bytes_; }
+    [[nodiscard]] Stats stats() const;
+
+private:
+    friend class FrameBuffer;
+    FramePool(std::size_t bufferBytes, std::size_t count);
+    FramePool(uint8_t* memory, std::size_t bufferBytes, std::size_t count, std::function<void()> release);
+    void release(FrameSlot* slot) noexcept;
+
+    std::size_t buffer_bytes_{0};
+    std::function<void()> release_memory_; // adopted memory only
+    std::vector<std::unique_ptr<FrameSlot>> slots_;
+    std::vector<FrameSlot*> free_;
+    mutable std::mutex mutex_;
+    uint64_t acquired_{0};
+    uint64_t exhausted_{0};
+    std::size_t peak_in_use_{0};
+};
+
+// Byte order of a packed 32-bit pixel in memory. Sources hand frames on in
+// whatever order they capture in; the encoder converts from there.
+enum class PixelFormat : uint8_t {
+    BGRA, // DXGI desktop duplication, generated and replayed sources
+    BGRX, // X11 ZPixmap, depth 24/32 little endian; the fourth byte is undefined
+    RGBX  // X11 visuals with red in the low byte
+};
+
 struct VideoFrame {
     int width{};
     int height{};
-    int stride{};
+    int stride{}; // bytes between rows, at least width * 4
+    PixelFormat format{PixelFormat::BGRA};
     uint64_t pts_ms{};
-    std::vector<uint8_t> data; // RGBA
+    FrameBuffer buffer; // borrowed from the capture source's FramePool
+
+    [[nodiscard]] const uint8_t* data() const noexcept { return buffer.data(); }
+    [[nodiscard]] uint8_t* data() noexcept { return buffer.data(); }
 };
 
 struct AudioFrame {
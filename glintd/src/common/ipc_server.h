@@ -1,5 +1,6 @@
 ﻿#pragma once
 #include <functional>
+#include <memory>
 #include <string>
 #include <thread>
 #include <atomic>
@@ -7,6 +8,21 @@
 
 using IpcHandler = std::function<std::string(const std::string&)>;
 
+// Push channel a request can turn its connection into. The server drains it
+// whenever the notifier fires, until the client disconnects.
+class IpcStream {
+public:
+    virtual ~IpcStream() = default;
+    // Appends pending newline-terminated lines to |out|.
+    virtual void drain(std::string& out) = 0;
+    // May be invoked from any thread; an empty function detaches.
+    virtual void setNotifier(std::function<void()> notify) = 0;
+    virtual void close() = 0;
+};
+
+// Returns a stream when the request asks for one, nullptr otherwise.
+using IpcStreamOpener = std::function<std::shared_ptr<IpcStream>(const std::string&)>;
+
 class IpcServer {
 public:
     virtual ~IpcServer() = default;
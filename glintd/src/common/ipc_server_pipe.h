@@ -3,16 +3,68 @@
 #include <string>
 #include <thread>
 #include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <utility>
+#include <vector>
 
 class IpcServerPipe : public IpcServer {
 public:
+    struct Options {
+        std::size_t worker_threads{4};
+        std::size_t max_clients{64};
+        std::size_t max_request_bytes{64 * 1024};
+        std::chrono::seconds idle_timeout{300};
+    };
+
+    // Decides whether a request is cheap enough to answer on the I/O thread.
+    // Everything else runs on the worker pool. Without one, all requests go
+    // to the pool.
+    using InlinePredicate = std::function<bool(const std::string&)>;
+
     explicit IpcServerPipe(std::string endpoint) : endpoint_(std::move(endpoint)) {}
+    IpcServerPipe(std::string endpoint, Options options)
+        : endpoint_(std::move(endpoint)), options_(options) {}
     bool start(IpcHandler handler) override;
     void stop() override;
 
+    void setInlinePredicate(InlinePredicate predicate) { inline_ = std::move(predicate); }
+    // Consulted for every request; a stream turns the connection into a
+    // push channel and later input on it is ignored.
+    void setStreamOpener(IpcStreamOpener opener) { stream_opener_ = std::move(opener); }
+
 private:
     void run(IpcHandler handler);
     std::string endpoint_;
+    Options options_{};
+    InlinePredicate inline_{};
+    IpcStreamOpener stream_opener_{};
     std::thread worker_;
     std::atomic<bool> running_{false};
+
+#ifndef _WIN32
+    struct Job {
+        uint64_t connection{0};
+        std::string request;
+    };
+
+    void poolLoop(const IpcHandler& handler);
+    void wake();
+
+    int wake_fd_{-1};
+    std::vector<std::thread> pool_;
+    std::mutex pool_mutex_;
+    std::condition_variable pool_cv_;
+    std::deque<Job> jobs_;
+    bool pool_stop_{false};
+    // Finished pool responses, handed back to the I/O thread.
+    std::mutex done_mutex_;
+    std::vector<std::pair<uint64_t, std::string>> done_;
+    // Stream connections with new data since the last wake.
+    std::mutex notify_mutex_;
+    std::vector<uint64_t> notified_;
+#endif
 };
@@ -1,48 +1,281 @@
 ﻿#include "logger.h"
 
+#include <algorithm>
+#include <cctype>
+#include <chrono>
 #include <filesystem>
+#include <functional>
 #include <iomanip>
+#include <sstream>
+#include <unordered_map>
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+// Upper bound on how long a line waits when the wake-up was missed.
+constexpr auto kFlushInterval = std::chrono::milliseconds(50);
+constexpr std::size_t kMaxBatchBytes = 64 * 1024;
+// More than kRepeatBurst similar lines (same text once digits are ignored)
+// within kRepeatWindow are collapsed into one summary line.
+constexpr auto kRepeatWindow = std::chrono::seconds(1);
+constexpr uint32_t kRepeatBurst = 20;
+
+const char* levelName(LogLevel level) {
+    switch (level) {
+        case LogLevel::Debug: return "DEBUG";
+        case LogLevel::Info: return "INFO";
+        case LogLevel::Warn: return "WARN";
+        case LogLevel::Error: return "ERROR";
+        case LogLevel::Off: break;
+    }
+    return "LOG";
+}
+
+void appendLine(std::string& out, LogLevel level, std::string_view msg) {
+    out += '[';
+    out += levelName(level);
+    out += "] ";
+    out += msg;
+    out += '\n';
+}
+
+std::size_t similarityKey(LogLevel level, std::string_view msg) {
+    std::string shape;
+    shape.reserve(msg.size());
+    for (char ch : msg) {
+        if (!std::isdigit(static_cast<unsigned char>(ch))) {
+            shape += ch;
+        }
+    }
+    return std::hash<std::string>{}(shape) ^ static_cast<std::size_t>(level);
+}
+
+struct Burst {
+    Clock::time_point window_start{};
+    uint32_t count{0};
+    uint64_t suppressed{0};
+    LogLevel level{LogLevel::Info};
+    std::string sample;
+};
+}
 
 Logger& Logger::instance() {
     static Logger inst;
     return inst;
 }
 
-void Logger::log(const std::string& msg, const std::string& level) {
-    std::lock_guard<std::mutex> lock(mtx_);
-    std::string line = "[" + level + "] " + msg;
-    std::cout << line << std::endl;
-    if (file_stream_.is_open())
-        file_stream_ << line << std::endl;
+Logger::Logger() : ring_(std::make_unique<Slot[]>(kRingCapacity)) {
+    for (std::size_t i = 0; i < kRingCapacity; ++i) {
+        ring_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    running_ = true;
+    writer_ = std::thread(&Logger::writerLoop, this);
 }
 
+Logger::~Logger() {
+    {
+        std::scoped_lock lock(wake_mutex_);
+        stop_ = true;
+    }
+    wake_cv_.notify_one();
+    if (writer_.joinable()) {
+        writer_.join();
+    }
+}
 
-void Logger::info(const std::string& msg) {
-    log(msg, "INFO");
+std::optional<LogLevel> Logger::parseLevel(std::string_view name) {
+    std::string lower(name);
+    std::transform(lower.begin(), lower.end(), lower.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    if (lower == "debug" || lower == "trace") return LogLevel::Debug;
+    if (lower == "info") return LogLevel::Info;
+    if (lower == "warn" || lower == "warning") return LogLevel::Warn;
+    if (lower == "error") return LogLevel::Error;
+    if (lower == "off" || lower == "none") return LogLevel::Off;
+    return std::nullopt;
 }
 
-void Logger::warn(const std::string& msg) {
-    log(msg, "WARN");
+void Logger::log(LogLevel level, std::string&& msg) {
+    if (!running_.load(std::memory_order_acquire)) {
+        // Writer already gone (static destruction): write through.
+        std::string line;
+        appendLine(line, level, msg);
+        std::lock_guard<std::mutex> lock(mtx_);
+        std::cout << line << std::flush;
+        if (file_stream_.is_open()) file_stream_ << line << std::flush;
+        return;
+    }
+    if (!tryPush(level, std::move(msg))) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    if (writer_idle_.load(std::memory_order_acquire)) {
+        wake_cv_.notify_one();
+    }
 }
 
-void Logger::error(const std::string& msg) {
-    log(msg, "ERROR");
+// Bounded MPSC ring (Vyukov): a slot's sequence says whose turn it is.
+bool Logger::tryPush(LogLevel level, std::string&& msg) {
+    uint64_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    Slot* slot = nullptr;
+    for (;;) {
+        slot = &ring_[pos & (kRingCapacity - 1)];
+        const uint64_t seq = slot->sequence.load(std::memory_order_acquire);
+        const auto diff = static_cast<int64_t>(seq) - static_cast<int64_t>(pos);
+        if (diff == 0) {
+            if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false; // full
+        } else {
+            pos = enqueue_pos_.load(std::memory_order_relaxed);
+        }
+    }
+    slot->level = level;
+    slot->text = std::move(msg);
+    slot->sequence.store(pos + 1, std::memory_order_release);
+    return true;
 }
 
-void Logger::debug(const std::string &msg) {
-    log(msg, "DEBUG");
+bool Logger::ringHasData() const noexcept {
+    const Slot& slot = ring_[dequeue_pos_ & (kRingCapacity - 1)];
+    return slot.sequence.load(std::memory_order_acquire) == dequeue_pos_ + 1;
 }
 
-void Logger::to_file(const std::string& base_path) {
+void Logger::writerLoop() {
+    std::string batch;
+    std::string text;
+    std::unordered_map<std::size_t, Burst> bursts;
+    uint64_t reportedDrops = 0;
+
+    auto emitSuppressed = [&](Burst& burst) {
+        if (burst.suppressed > 0) {
+            appendLine(batch, burst.level,
+                       "(" + std::to_string(burst.suppressed) + " similar message(s) suppressed, last: " + burst.sample + ")");
+            burst.suppressed = 0;
+        }
+    };
+
+    for (;;) {
+        const auto now = Clock::now();
+        while (ringHasData()) {
+            Slot& slot = ring_[dequeue_pos_ & (kRingCapacity - 1)];
+            const LogLevel level = slot.level;
+            text.swap(slot.text);
+            slot.sequence.store(dequeue_pos_ + kRingCapacity, std::memory_order_release);
+            ++dequeue_pos_;
+
+            Burst& burst = bursts[similarityKey(level, text)];
+            if (now - burst.window_start >= kRepeatWindow) {
+                emitSuppressed(burst);
+                burst.window_start = now;
+                burst.count = 0;
+            }
+            if (++burst.count > kRepeatBurst) {
+                ++burst.suppressed;
+                burst.level = level;
+                burst.sample = text;
+                continue;
+            }
+            appendLine(batch, level, text);
+            if (batch.size() >= kMaxBatchBytes) {
+                writeBatch(batch);
+                batch.clear();
+            }
+        }
+
+        for (auto it = bursts.begin(); it != bursts.end();) {
+            if (now - it->second.window_start >= kRepeatWindow) {
+                emitSuppressed(it->second);
+                it = bursts.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        if (const uint64_t drops = dropped_.load(std::memory_order_relaxed); drops != reportedDrops) {
+            appendLine(batch, LogLevel::Warn,
+                       "Logger: " + std::to_string(drops - reportedDrops) + " line(s) dropped, ring full");
+            reportedDrops = drops;
+        }
+        if (!batch.empty()) {
+            writeBatch(batch);
+            batch.clear();
+        }
+
+        std::unique_lock lock(wake_mutex_);
+        written_pos_.store(dequeue_pos_, std::memory_order_release);
+        flushed_cv_.notify_all();
+        if (stop_ && !ringHasData()) {
+            break;
+        }
+        writer_idle_.store(true, std::memory_order_release);
+        wake_cv_.wait_for(lock, kFlushInterval, [this] { return stop_ || ringHasData(); });
+        writer_idle_.store(false, std::memory_order_relaxed);
+    }
+
+    for (auto& [key, burst] : bursts) {
+        emitSuppressed(burst);
+    }
+    if (!batch.empty()) {
+        writeBatch(batch);
+    }
+    running_.store(false, std::memory_order_release);
+}
+
+void Logger::writeBatch(const std::string& batch) {
     std::lock_guard<std::mutex> lock(mtx_);
+    std::cout.write(batch.data(), static_cast<std::streamsize>(batch.size()));
+    std::cout.flush();
+    if (file_stream_.is_open()) {
+        file_stream_.write(batch.data(), static_cast<std::streamsize>(batch.size()));
+        file_stream_.flush();
+        file_bytes_ += batch.size();
+        rotateIfNeeded();
+    }
+}
 
+void Logger::flush() {
+    const uint64_t target = enqueue_pos_.load(std::memory_order_acquire);
+    std::unique_lock lock(wake_mutex_);
+    wake_cv_.notify_one();
+    flushed_cv_.wait(lock, [&] {
+        return written_pos_.load(std::memory_order_acquire) >= target || !running_.load(std::memory_order_acquire);
+    });
+}
+
+void Logger::setRotation(uint64_t maxBytes, int maxFiles) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    rotate_bytes_ = maxBytes;
+    rotate_files_ = std::max(0, maxFiles);
+}
+
+void Logger::rotateIfNeeded() {
+    if (rotate_bytes_ == 0 || file_bytes_ < rotate_bytes_ || file_path_.empty()) {
+        return;
+    }
+    file_stream_.close();
+    std::error_code ec;
+    const std::string base = file_path_.string();
+    if (rotate_files_ > 0) {
+        std::filesystem::remove(base + "." + std::to_string(rotate_files_), ec);
+        for (int i = rotate_files_ - 1; i >= 1; --i) {
+            std::filesystem::rename(base + "." + std::to_string(i), base + "." + std::to_string(i + 1), ec);
+        }
+        std::filesystem::rename(file_path_, base + ".1", ec);
+    }
+    file_stream_.open(file_path_, std::ios::trunc);
+    file_bytes_ = 0;
+}
+
+void Logger::to_file(const std::string& base_path) {
     std::filesystem::path base_dir = std::filesystem::path(base_path).parent_path();
     if (base_dir.empty()) base_dir = ".";
     std::filesystem::path logs_dir = base_dir / "logs";
     std::error_code ec;
     std::filesystem::create_directories(logs_dir, ec);
     if (ec) {
-        std::cerr << "[ERROR] Failed to create logs directory: " << ec.message() << std::endl;
+        error("Failed to create logs directory: " + ec.message());
     }
 
     auto now = std::chrono::system_clock::now();
@@ -61,10 +294,20 @@ void Logger::to_file(const std::string& base_path) {
 
     auto full_path = logs_dir / dated_name;
 
-    file_stream_.open(full_path, std::ios::app);
-    if (!file_stream_.is_open()) {
-        std::cerr << "[ERROR] Cannot open log file: " << full_path << std::endl;
+    bool opened = false;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        file_stream_.open(full_path, std::ios::app);
+        opened = file_stream_.is_open();
+        if (opened) {
+            file_path_ = full_path;
+            file_bytes_ = std::filesystem::file_size(full_path, ec);
+            if (ec) file_bytes_ = 0;
+        }
+    }
+    if (!opened) {
+        error("Cannot open log file: " + full_path.string());
     } else {
-        std::cout << "[INFO] Logging to file: " << full_path << std::endl;
+        info("Logging to file: " + full_path.string());
     }
 }
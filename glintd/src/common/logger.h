@@ -1,30 +1,108 @@
 ﻿#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
 #include <fstream>
+#include <filesystem>
+#include <memory>
 #include <mutex>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
 #include <iostream>
 
+// Lowest level compiled in: 0 debug, 1 info, 2 warn, 3 error. Calls below it
+// fold away when guarded with Logger::enabled().
+#ifndef GLINT_LOG_MIN_LEVEL
+#define GLINT_LOG_MIN_LEVEL 0
+#endif
+
+enum class LogLevel : int {
+    Debug = 0,
+    Info = 1,
+    Warn = 2,
+    Error = 3,
+    Off = 4
+};
+
+// Callers only format and enqueue: lines go through a bounded lock-free ring
+// to a writer thread that batches console and file output, rotates the file
+// by size and collapses bursts of similar messages. When the ring is full
+// lines are dropped (and counted) rather than blocking the caller.
 class Logger {
 public:
+    static constexpr LogLevel kCompiledMinLevel = static_cast<LogLevel>(GLINT_LOG_MIN_LEVEL);
+    static constexpr std::size_t kRingCapacity = 8192; // power of two
+
     static Logger& instance();
 
-    void info(const std::string& msg);
+    // Wrap expensive formatting on hot paths in this check.
+    [[nodiscard]] bool enabled(LogLevel level) const noexcept {
+        return level >= kCompiledMinLevel && level >= level_.load(std::memory_order_relaxed);
+    }
+
+    void info(std::string msg) { if (enabled(LogLevel::Info)) log(LogLevel::Info, std::move(msg)); }
 
-    void warn(const std::string &msg);
+    void warn(std::string msg) { if (enabled(LogLevel::Warn)) log(LogLevel::Warn, std::move(msg)); }
 
-    void error(const std::string& msg);
+    void error(std::string msg) { if (enabled(LogLevel::Error)) log(LogLevel::Error, std::move(msg)); }
 
-    void debug(const std::string& msg);
+    void debug(std::string msg) { if (enabled(LogLevel::Debug)) log(LogLevel::Debug, std::move(msg)); }
 
     void to_file(const std::string& path);
 
+    void setLevel(LogLevel level) noexcept { level_.store(level, std::memory_order_relaxed); }
+    [[nodiscard]] LogLevel level() const noexcept { return level_.load(std::memory_order_relaxed); }
+    // "debug", "info", "warn"/"warning", "error", "off".
+    static std::optional<LogLevel> parseLevel(std::string_view name);
+
+    // The file is renamed to .1 (older ones shift up to .maxFiles) once it
+    // passes maxBytes. 0 disables rotation.
+    void setRotation(uint64_t maxBytes, int maxFiles);
+    // Blocks until everything logged before the call has been written.
+    void flush();
+    [[nodiscard]] uint64_t dropped() const noexcept { return dropped_.load(std::memory_order_relaxed); }
+
 private:
-    Logger() = default;
+    struct Slot {
+        std::atomic<uint64_t> sequence{0};
+        LogLevel level{LogLevel::Info};
+        std::string text;
+    };
+
+    Logger();
+    ~Logger();
     Logger(const Logger&) = delete;
     Logger& operator=(const Logger&) = delete;
 
-    void log(const std::string &msg, const std::string &level);
+    void log(LogLevel level, std::string&& msg);
+    bool tryPush(LogLevel level, std::string&& msg);
+    void writerLoop();
+    bool ringHasData() const noexcept;
+    void writeBatch(const std::string& batch);
+    void rotateIfNeeded();
+
+    std::unique_ptr<Slot[]> ring_;
+    std::atomic<uint64_t> enqueue_pos_{0};
+    uint64_t dequeue_pos_{0}; // writer thread only
+    std::atomic<uint64_t> dropped_{0};
+    std::atomic<LogLevel> level_{LogLevel::Debug};
+
+    std::mutex wake_mutex_;
+    std::condition_variable wake_cv_;
+    std::condition_variable flushed_cv_;
+    std::atomic<bool> running_{false};
+    std::atomic<bool> writer_idle_{false};
+    std::atomic<uint64_t> written_pos_{0};
+    bool stop_{false};
+    std::thread writer_;
 
+    std::mutex mtx_; // file state, and direct writes once the writer is gone
     std::ofstream file_stream_;
-    std::mutex mtx_;
+    std::filesystem::path file_path_;
+    uint64_t file_bytes_{0};
+    uint64_t rotate_bytes_{0};
+    int rotate_files_{0};
 };
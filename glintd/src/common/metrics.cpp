@@ -0,0 +1,168 @@
+﻿#include "metrics.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <format>
+
+uint64_t HistogramSnapshot::quantile(double q) const noexcept {
+    if (count == 0) {
+        return 0;
+    }
+    const auto rank = static_cast<uint64_t>(std::ceil(std::clamp(q, 0.0, 1.0) * static_cast<double>(count)));
+    uint64_t seen = 0;
+    for (std::size_t i = 0; i < buckets.size(); ++i) {
+        seen += buckets[i];
+        if (seen >= std::max<uint64_t>(rank, 1)) {
+            return std::min(Histogram::bucketUpperBound(i), max);
+        }
+    }
+    return max;
+}
+
+HistogramSnapshot HistogramSnapshot::since(const HistogramSnapshot& earlier) const {
+    HistogramSnapshot delta;
+    delta.count = count - std::min(count, earlier.count);
+    delta.sum = sum - std::min(sum, earlier.sum);
+    delta.buckets.resize(buckets.size());
+    for (std::size_t i = 0; i < buckets.size(); ++i) {
+        const uint64_t before = i < earlier.buckets.size() ? earlier.buckets[i] : 0;
+        delta.buckets[i] = buckets[i] - std::min(buckets[i], before);
+        if (delta.buckets[i] > 0) {
+            delta.max = std::min(Histogram::bucketUpperBound(i), max);
+        }
+    }
+    return delta;
+}
+
+std::size_t Histogram::bucketIndex(uint64_t value) noexcept {
+    if (value < kSubBuckets) {
+        return static_cast<std::size_t>(value);
+    }
+    const int msb = std::bit_width(value) - 1;
+    const int shift = msb - kSubBucketBits;
+    return static_cast<std::size_t>(msb - kSubBucketBits + 1) * kSubBuckets +
+           static_cast<std::size_t>((value >> shift) & (kSubBuckets - 1));
+}
+
+uint64_t Histogram::bucketLowerBound(std::size_t index) noexcept {
+    if (index < kSubBuckets) {
+        return index;
+    }
+    const std::size_t group = index / kSubBuckets;
+    const uint64_t sub = index % kSubBuckets;
+    return (kSubBuckets + sub) << (group - 1);
+}
+
+uint64_t Histogram::bucketUpperBound(std::size_t index) noexcept {
+    return index + 1 >= kBuckets ? UINT64_MAX : bucketLowerBound(index + 1) - 1;
+}
+
+void Histogram::record(uint64_t value) noexcept {
+    buckets_[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(value, std::memory_order_relaxed);
+    uint64_t prev = max_.load(std::memory_order_relaxed);
+    while (value > prev && !max_.compare_exchange_weak(prev, value, std::memory_order_relaxed)) {
+    }
+}
+
+HistogramSnapshot Histogram::snapshot() const {
+    // Not atomic as a whole; count is rebuilt from the buckets so that
+    // quantiles stay consistent with them.
+    HistogramSnapshot snap;
+    snap.buckets.resize(kBuckets);
+    for (std::size_t i = 0; i < kBuckets; ++i) {
+        snap.buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+        snap.count += snap.buckets[i];
+    }
+    snap.sum = sum_.load(std::memory_order_relaxed);
+    snap.max = max_.load(std::memory_order_relaxed);
+    return snap;
+}
+
+ScopedTimer::~ScopedTimer() {
+    const auto elapsed = std::chrono::steady_clock::now() - started_;
+    histogram_.record(static_cast<uint64_t>(
+        std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count())));
+}
+
+MetricsRegistry& MetricsRegistry::instance() {
+    static MetricsRegistry registry;
+    return registry;
+}
+
+template <typename T>
+T& MetricsRegistry::findOrAdd(std::deque<Entry<T>>& entries, const std::string& name, const std::string& help) {
+    for (auto& entry : entries) {
+        if (entry.name == name) {
+            return entry.metric;
+        }
+    }
+    auto& entry = entries.emplace_back();
+    entry.name = name;
+    entry.help = help;
+    return entry.metric;
+}
+
+Counter& MetricsRegistry::counter(const std::string& name, const std::string& help) {
+    std::scoped_lock lock(mutex_);
+    return findOrAdd(counters_, name, help);
+}
+
+Gauge& MetricsRegistry::gauge(const std::string& name, const std::string& help) {
+    std::scoped_lock lock(mutex_);
+    return findOrAdd(gauges_, name, help);
+}
+
+Histogram& MetricsRegistry::histogram(const std::string& name, const std::string& help) {
+    std::scoped_lock lock(mutex_);
+    return findOrAdd(histograms_, name, help);
+}
+
+MetricsSnapshot MetricsRegistry::snapshot() const {
+    MetricsSnapshot snap;
+    std::scoped_lock lock(mutex_);
+    for (const auto& entry : counters_) {
+        snap.counters.push_back({entry.name, entry.help, static_cast<int64_t>(entry.metric.value())});
+    }
+    for (const auto& entry : gauges_) {
+        snap.gauges.push_back({entry.name, entry.help, entry.metric.value()});
+    }
+    for (const auto& entry : histograms_) {
+        snap.histograms.push_back({entry.name, entry.help, entry.metric.snapshot()});
+    }
+    return snap;
+}
+
+std::string MetricsRegistry::exposition() const {
+    const auto snap = snapshot();
+    std::string out;
+    auto header = [&](const std::string& name, const std::string& help, const char* type) {
+        if (!help.empty()) {
+            out += std::format("# HELP {} {}\n", name, help);
+        }
+        out += std::format("# TYPE {} {}\n", name, type);
+    };
+    for (const auto& value : snap.counters) {
+        header(value.name, value.help, "counter");
+        out += std::format("{} {}\n", value.name, value.value);
+    }
+    for (const auto& value : snap.gauges) {
+        header(value.name, value.help, "gauge");
+        out += std::format("{} {}\n", value.name, value.value);
+    }
+    static constexpr std::array<const char*, 4> kQuantileLabels{"0.5", "0.9", "0.99", "0.999"};
+    static constexpr std::array<double, 4> kQuantiles{0.5, 0.9, 0.99, 0.999};
+    for (const auto& dist : snap.histograms) {
+        header(dist.name, dist.help, "summary");
+        for (std::size_t i = 0; i < kQuantiles.size(); ++i) {
+            out += std::format("{}{{quantile=\"{}\"}} {}\n", dist.name, kQuantileLabels[i],
+                               dist.histogram.quantile(kQuantiles[i]));
+        }
+        out += std::format("{}_sum {}\n", dist.name, dist.histogram.sum);
+        out += std::format("{}_count {}\n", dist.name, dist.histogram.count);
+        out += std::format("{}_max {}\n", dist.name, dist.histogram.max);
+    }
+    return out;
+}
@@ -0,0 +1,138 @@
+﻿#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Process-wide counters, gauges and latency histograms. Registration takes a
+// lock; recording is a handful of relaxed atomics, so hot paths look their
+// metrics up once and keep the reference.
+
+class Counter {
+public:
+    void add(uint64_t n = 1) noexcept { value_.fetch_add(n, std::memory_order_relaxed); }
+    [[nodiscard]] uint64_t value() const noexcept { return value_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> value_{0};
+};
+
+class Gauge {
+public:
+    void set(int64_t v) noexcept { value_.store(v, std::memory_order_relaxed); }
+    void add(int64_t n) noexcept { value_.fetch_add(n, std::memory_order_relaxed); }
+    [[nodiscard]] int64_t value() const noexcept { return value_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<int64_t> value_{0};
+};
+
+struct HistogramSnapshot {
+    uint64_t count{0};
+    uint64_t sum{0};
+    uint64_t max{0};
+    std::vector<uint64_t> buckets;
+
+    // Upper bound of the bucket holding quantile q (0..1); within 12.5%.
+    [[nodiscard]] uint64_t quantile(double q) const noexcept;
+    // Samples recorded after |earlier|, a snapshot of the same histogram.
+    // max is the upper bound of the highest bucket that grew, capped by the
+    // running max, so quantiles of the window keep the 12.5% bound.
+    [[nodiscard]] HistogramSnapshot since(const HistogramSnapshot& earlier) const;
+};
+
+// Log-linear buckets in the HDR style: every power of two is split into
+// kSubBuckets equal parts, so relative error is bounded for any magnitude
+// and recording never allocates.
+class Histogram {
+public:
+    static constexpr int kSubBucketBits = 3;
+    static constexpr std::size_t kSubBuckets = std::size_t{1} << kSubBucketBits;
+    static constexpr std::size_t kBuckets = (64 - kSubBucketBits + 1) * kSubBuckets;
+
+    void record(uint64_t value) noexcept;
+    [[nodiscard]] HistogramSnapshot snapshot() const;
+
+    [[nodiscard]] static std::size_t bucketIndex(uint64_t value) noexcept;
+    [[nodiscard]] static uint64_t bucketLowerBound(std::size_t index) noexcept;
+    [[nodiscard]] static uint64_t bucketUpperBound(std::size_t index) noexcept;
+
+private:
+    std::array<std::atomic<uint64_t>, kBuckets> buckets_{};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_{0};
+    std::atomic<uint64_t> max_{0};
+};
+
+// Records the elapsed microseconds into a histogram when it goes out of scope.
+class ScopedTimer {
+public:
+    explicit ScopedTimer(Histogram& histogram) noexcept
+        : histogram_(histogram), started_(std::chrono::steady_clock::now()) {}
+    ~ScopedTimer();
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    Histogram& histogram_;
+    std::chrono::steady_clock::time_point started_;
+};
+
+struct MetricsSnapshot {
+    struct Value {
+        std::string name;
+        std::string help;
+        int64_t value{0};
+    };
+    struct Distribution {
+        std::string name;
+        std::string help;
+        HistogramSnapshot histogram;
+    };
+
+    std::vector<Value> counters;
+    std::vector<Value> gauges;
+    std::vector<Distribution> histograms;
+};
+
+class MetricsRegistry {
+public:
+    static MetricsRegistry& instance();
+
+    // Returns the existing metric when |name| is already registered. The
+    // reference stays valid for the lifetime of the process.
+    Counter& counter(const std::string& name, const std::string& help = {});
+    Gauge& gauge(const std::string& name, const std::string& help = {});
+    Histogram& histogram(const std::string& name, const std::string& help = {});
+
+    [[nodiscard]] MetricsSnapshot snapshot() const;
+    // Prometheus text format; histograms are exposed as summaries.
+    [[nodiscard]] std::string exposition() const;
+
+private:
+    MetricsRegistry() = default;
+    MetricsRegistry(const MetricsRegistry&) = delete;
+    MetricsRegistry& operator=(const MetricsRegistry&) = delete;
+
+    template <typename T>
+    struct Entry {
+        std::string name;
+        std::string help;
+        T metric;
+    };
+
+    template <typename T>
+    static T& findOrAdd(std::deque<Entry<T>>& entries, const std::string& name, const std::string& help);
+
+    mutable std::mutex mutex_;
+    std::deque<Entry<Counter>> counters_;
+    std::deque<Entry<Gauge>> gauges_;
+    std::deque<Entry<Histogram>> histograms_;
+};
@@ -0,0 +1,26 @@
+﻿#pragma once
+#include <atomic>
+#include <string>
+#include <thread>
+
+// Serves MetricsRegistry::exposition() on a local socket for scrapers: each
+// connection receives one snapshot and is closed. Unix only.
+class MetricsEndpoint {
+public:
+    explicit MetricsEndpoint(std::string path) : path_(std::move(path)) {}
+    ~MetricsEndpoint() { stop(); }
+
+    MetricsEndpoint(const MetricsEndpoint&) = delete;
+    MetricsEndpoint& operator=(const MetricsEndpoint&) = delete;
+
+    bool start();
+    void stop();
+
+private:
+    void run(int listenFd);
+
+    std::string path_;
+    std::thread worker_;
+    std::atomic<bool> running_{false};
+    int wake_fd_{-1};
+};
@@ -7,6 +7,10 @@
 
 #include "encoder.h"
 
+// Format tag holding the capture-clock pts of a segment's first video
+// packet; packet times inside the file start at zero.
+inline constexpr const char* kSegmentStartTag = "glint_start_ms";
+
 struct MuxerConfig {
     std::string container = "matroska";
     std::filesystem::path path;
@@ -30,6 +34,25 @@ enum class MuxerError {
     OutOfMemory
 };
 
+// Video keyframe written to the current file. pts_ms is the source packet pts;
+// byte_offset is the file position when the packet was handed to the muxer,
+// which is at or before where its data lands.
+struct KeyframeIndexEntry {
+    int64_t pts_ms{0};
+    int64_t byte_offset{-1};
+};
+
+// Output of the last opened file, counted in memory so callers never have to
+// stat it. bytes_written is the logical output size (the final file size
+// once closed); flushed_bytes is what had reached the file at the last flush.
+struct MuxerStats {
+    uint64_t bytes_written{0};
+    uint64_t flushed_bytes{0};
+    uint64_t video_packets{0};
+    uint64_t system_audio_packets{0};
+    uint64_t mic_audio_packets{0};
+};
+
 class IMuxer {
 public:
     virtual ~IMuxer() = default;
@@ -41,4 +64,8 @@ public:
     virtual bool close() = 0;
 
     [[nodiscard]] virtual std::optional<MuxerError> lastError() const noexcept = 0;
+    // Keyframes of the last opened file; still valid after close().
+    [[nodiscard]] virtual std::vector<KeyframeIndexEntry> keyframeIndex() const { return {}; }
+    // Of the last opened file; still valid after close().
+    [[nodiscard]] virtual MuxerStats stats() const { return {}; }
 };
\ No newline at end of file
@@ -0,0 +1,77 @@
+﻿#include "packet_buffer.h"
+
+#include <cstring>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/buffer.h>
+}
+
+PacketBuffer::~PacketBuffer() {
+    reset();
+}
+
+PacketBuffer::PacketBuffer(const PacketBuffer& other)
+    : buf_(other.buf_ ? av_buffer_ref(other.buf_) : nullptr),
+      data_(buf_ ? other.data_ : nullptr),
+      size_(buf_ ? other.size_ : 0) {}
+
+PacketBuffer& PacketBuffer::operator=(const PacketBuffer& other) {
+    if (this != &other) {
+        PacketBuffer copy(other);
+        *this = std::move(copy);
+    }
+    return *this;
+}
+
+PacketBuffer::PacketBuffer(PacketBuffer&& other) noexcept
+    : buf_(std::exchange(other.buf_, nullptr)),
+      data_(std::exchange(other.data_, nullptr)),
+      size_(std::exchange(other.size_, 0)) {}
+
+PacketBuffer& PacketBuffer::operator=(PacketBuffer&& other) noexcept {
+    if (this != &other) {
+        reset();
+        buf_ = std::exchange(other.buf_, nullptr);
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+    }
+    return *this;
+}
+
+PacketBuffer PacketBuffer::reference(const AVBufferRef* buf, const uint8_t* data, std::size_t size) {
+    PacketBuffer out;
+    if (!buf || !data) {
+        return out;
+    }
+    out.buf_ = av_buffer_ref(buf);
+    if (out.buf_) {
+        out.data_ = data;
+        out.size_ = size;
+    }
+    return out;
+}
+
+PacketBuffer PacketBuffer::copyOf(const uint8_t* data, std::size_t size) {
+    PacketBuffer out;
+    // Demuxers and parsers may read past the end; keep FFmpeg's padding.
+    out.buf_ = av_buffer_alloc(size + AV_INPUT_BUFFER_PADDING_SIZE);
+    if (!out.buf_) {
+        return out;
+    }
+    if (size > 0) {
+        std::memcpy(out.buf_->data, data, size);
+    }
+    std::memset(out.buf_->data + size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+    out.data_ = out.buf_->data;
+    out.size_ = size;
+    return out;
+}
+
+void PacketBuffer::reset() noexcept {
+    if (buf_) {
+        av_buffer_unref(&buf_);
+    }
+    data_ = nullptr;
+    size_ = 0;
+}
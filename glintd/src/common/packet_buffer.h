@@ -0,0 +1,40 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+struct AVBufferRef;
+
+// Immutable, refcounted view of an encoded payload. Copies share the same
+// AVBufferRef, so the encoder, the replay ring, the muxer and exporters all
+// hand around one allocation instead of copying bytes.
+class PacketBuffer {
+public:
+    PacketBuffer() = default;
+    ~PacketBuffer();
+    PacketBuffer(const PacketBuffer& other);
+    PacketBuffer& operator=(const PacketBuffer& other);
+    PacketBuffer(PacketBuffer&& other) noexcept;
+    PacketBuffer& operator=(PacketBuffer&& other) noexcept;
+
+    // Takes a new reference on |buf|; [data, data + size) must lie inside it.
+    static PacketBuffer reference(const AVBufferRef* buf, const uint8_t* data, std::size_t size);
+    // Padded copy, for payloads that do not come from FFmpeg.
+    static PacketBuffer copyOf(const uint8_t* data, std::size_t size);
+
+    [[nodiscard]] const uint8_t* data() const noexcept { return data_; }
+    [[nodiscard]] std::size_t size() const noexcept { return size_; }
+    [[nodiscard]] bool empty() const noexcept { return size_ == 0; }
+    [[nodiscard]] const uint8_t* begin() const noexcept { return data_; }
+    [[nodiscard]] const uint8_t* end() const noexcept { return data_ + size_; }
+    // Borrowed; use av_buffer_ref() to keep it.
+    [[nodiscard]] AVBufferRef* ref() const noexcept { return buf_; }
+
+    void reset() noexcept;
+
+private:
+    AVBufferRef* buf_{nullptr};
+    const uint8_t* data_{nullptr};
+    std::size_t size_{0};
+};
@@ -0,0 +1,118 @@
+﻿#include "packet_ring.h"
+
+#include <algorithm>
+
+PacketRing::PacketRing() = default;
+
+PacketRing::PacketRing(const Limits& limits)
+    : limits_(limits) {}
+
+void PacketRing::setLimits(const Limits& limits) {
+    std::scoped_lock lock(mutex_);
+    limits_ = limits;
+    evictUnlocked();
+}
+
+void PacketRing::push(EncodedPacket packet) {
+    std::scoped_lock lock(mutex_);
+    const bool keyframe = packet.type == EncodedStreamType::Video && packet.keyframe;
+    if (keyframe) {
+        closeOpenGop();
+        open_ = std::make_unique<Gop>();
+        open_->start_ms = packet.pts;
+        open_->end_ms = packet.pts;
+    } else if (!open_) {
+        // Nothing decodable until the first keyframe.
+        return;
+    }
+
+    open_->end_ms = std::max(open_->end_ms, packet.pts);
+    open_->bytes += packet.data.size();
+    open_->packets.push_back(std::move(packet));
+
+    if (keyframe) {
+        evictUnlocked();
+    }
+}
+
+void PacketRing::clear() {
+    std::scoped_lock lock(mutex_);
+    closed_.clear();
+    open_.reset();
+    closed_bytes_ = 0;
+    closed_packets_ = 0;
+}
+
+PacketRing::Snapshot PacketRing::snapshot(int64_t window_ms) const {
+    std::scoped_lock lock(mutex_);
+    Snapshot snap;
+    const int64_t end = open_ ? open_->end_ms : (closed_.empty() ? 0 : closed_.back()->end_ms);
+    const int64_t from = window_ms > 0 ? end - window_ms : std::numeric_limits<int64_t>::min();
+
+    // Start at the last GOP that begins at or before |from| so the window is
+    // fully covered.
+    auto first = closed_.begin();
+    for (auto it = closed_.begin(); it != closed_.end(); ++it) {
+        if ((*it)->start_ms <= from) {
+            first = it;
+        }
+    }
+    const bool openCovers = open_ && open_->start_ms <= from;
+    if (!openCovers) {
+        for (auto it = first; it != closed_.end(); ++it) {
+            snap.gops.push_back(*it);
+            snap.bytes += (*it)->bytes;
+        }
+    }
+    if (open_ && !open_->packets.empty()) {
+        snap.gops.push_back(std::make_shared<const Gop>(*open_));
+        snap.bytes += open_->bytes;
+    }
+    if (!snap.gops.empty()) {
+        snap.start_ms = snap.gops.front()->start_ms;
+        snap.end_ms = snap.gops.back()->end_ms;
+    }
+    return snap;
+}
+
+PacketRing::Stats PacketRing::stats() const {
+    std::scoped_lock lock(mutex_);
+    Stats stats;
+    stats.gops = closed_.size() + (open_ ? 1 : 0);
+    stats.packets = closed_packets_ + (open_ ? open_->packets.size() : 0);
+    stats.bytes = closed_bytes_ + (open_ ? open_->bytes : 0);
+    if (!closed_.empty()) {
+        stats.start_ms = closed_.front()->start_ms;
+    } else if (open_) {
+        stats.start_ms = open_->start_ms;
+    }
+    stats.end_ms = open_ ? open_->end_ms : (closed_.empty() ? 0 : closed_.back()->end_ms);
+    stats.evicted_gops = evicted_gops_;
+    return stats;
+}
+
+void PacketRing::closeOpenGop() {
+    if (!open_) return;
+    closed_bytes_ += open_->bytes;
+    closed_packets_ += open_->packets.size();
+    closed_.push_back(std::shared_ptr<const Gop>(std::move(open_)));
+}
+
+void PacketRing::evictUnlocked() {
+    const int64_t end = open_ ? open_->end_ms : (closed_.empty() ? 0 : closed_.back()->end_ms);
+    const uint64_t openBytes = open_ ? open_->bytes : 0;
+    while (!closed_.empty()) {
+        const auto& oldest = closed_.front();
+        // Only drop a GOP once the rest still covers the time window.
+        const int64_t nextStart = closed_.size() > 1 ? closed_[1]->start_ms : (open_ ? open_->start_ms : end);
+        const bool overTime = limits_.max_duration_ms > 0 && end - nextStart >= limits_.max_duration_ms;
+        const bool overBytes = limits_.max_bytes > 0 && closed_bytes_ + openBytes > limits_.max_bytes;
+        if (!overTime && !overBytes) {
+            break;
+        }
+        closed_bytes_ -= oldest->bytes;
+        closed_packets_ -= oldest->packets.size();
+        closed_.pop_front();
+        ++evicted_gops_;
+    }
+}
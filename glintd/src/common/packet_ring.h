@@ -0,0 +1,70 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "encoder.h"
+
+// RAM-backed replay window of encoded packets, kept as whole GOPs so that
+// any snapshot starts on a video keyframe. Bounded by duration and bytes;
+// the oldest GOP is evicted first and the GOP being filled is never evicted.
+class PacketRing {
+public:
+    struct Limits {
+        int64_t max_duration_ms{30000}; // <= 0 disables the time bound
+        uint64_t max_bytes{256ull * 1024ull * 1024ull}; // 0 disables the byte bound
+    };
+
+    struct Gop {
+        int64_t start_ms{0}; // pts of the keyframe
+        int64_t end_ms{0};
+        uint64_t bytes{0};
+        std::vector<EncodedPacket> packets;
+    };
+
+    struct Snapshot {
+        std::vector<std::shared_ptr<const Gop>> gops;
+        int64_t start_ms{0};
+        int64_t end_ms{0};
+        uint64_t bytes{0};
+
+        [[nodiscard]] bool empty() const noexcept { return gops.empty(); }
+    };
+
+    struct Stats {
+        std::size_t gops{0};
+        std::size_t packets{0};
+        uint64_t bytes{0};
+        int64_t start_ms{0};
+        int64_t end_ms{0};
+        uint64_t evicted_gops{0};
+    };
+
+    PacketRing();
+    explicit PacketRing(const Limits& limits);
+
+    void setLimits(const Limits& limits);
+    void push(EncodedPacket packet);
+    void clear();
+
+    // GOPs covering at least the last |window_ms| (everything when <= 0).
+    // Closed GOPs are shared, the open one is copied.
+    [[nodiscard]] Snapshot snapshot(int64_t window_ms = 0) const;
+    [[nodiscard]] Stats stats() const;
+
+private:
+    void closeOpenGop();
+    void evictUnlocked();
+
+    Limits limits_{};
+    std::deque<std::shared_ptr<const Gop>> closed_;
+    std::unique_ptr<Gop> open_;
+    uint64_t closed_bytes_{0};
+    std::size_t closed_packets_{0};
+    uint64_t evicted_gops_{0};
+    mutable std::mutex mutex_;
+};
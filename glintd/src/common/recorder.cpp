@@ -8,18 +8,104 @@
 #include <iomanip>
 #include <numeric>
 #include <sstream>
+#include <utility>
 
+#include "event_bus.h"
 #include "logger.h"
+#include "segment_pins.h"
 
-Recorder::Recorder(std::unique_ptr<IEncoder> encoder, std::unique_ptr<IMuxer> muxer)
-    : encoder_(std::move(encoder)), muxer_(std::move(muxer)) {}
+namespace {
+constexpr uint64_t kStatsReportInterval = 600; // encoded video frames
+constexpr std::size_t kMuxBatchLimit = 64;
+constexpr auto kPipelineEventInterval = std::chrono::seconds(1);
+constexpr auto kOutputRateWindow = std::chrono::seconds(1);
+
+struct RecorderMetrics {
+    Counter& video_queued = MetricsRegistry::instance().counter("glint_recorder_video_frames_total", "Video frames accepted into the encoder queue");
+    Counter& video_dropped = MetricsRegistry::instance().counter("glint_recorder_video_dropped_total", "Video frames dropped before encoding");
+    Counter& audio_dropped = MetricsRegistry::instance().counter("glint_recorder_audio_dropped_total", "Audio frames dropped before encoding");
+    Counter& segments = MetricsRegistry::instance().counter("glint_recorder_segments_total", "Segments closed");
+    Histogram& rotation_us = MetricsRegistry::instance().histogram("glint_recorder_rotation_us", "Switching the mux thread to the next segment, microseconds");
+    Histogram& finalize_us = MetricsRegistry::instance().histogram("glint_recorder_segment_finalize_us", "Closing a finished segment and reporting it, microseconds");
+    Gauge& output_kbps = MetricsRegistry::instance().gauge("glint_recorder_output_kbps", "Muxer output rate over the last second, kbit/s");
+    Counter& inline_opens = MetricsRegistry::instance().counter("glint_recorder_rotation_inline_opens_total", "Rotations that opened the next segment on the mux thread");
+    Histogram& first_packet_us = MetricsRegistry::instance().histogram("glint_recorder_start_to_first_packet_us", "Recorder start to the first encoded video packet, microseconds");
+    Counter& cold_starts = MetricsRegistry::instance().counter("glint_recorder_encoder_cold_starts_total", "Sessions that had to open the encoder on start");
+};
+
+RecorderMetrics& metrics() {
+    static RecorderMetrics m;
+    return m;
+}
+
+// Counts a capture callback as inside a push until it returns, so stop() can
+// wait for it before the queues are rebuilt.
+class ProducerScope {
+public:
+    explicit ProducerScope(std::atomic<uint32_t>& active) : active_(active) { active_.fetch_add(1); }
+    ~ProducerScope() { active_.fetch_sub(1, std::memory_order_release); }
+    ProducerScope(const ProducerScope&) = delete;
+    ProducerScope& operator=(const ProducerScope&) = delete;
+
+private:
+    std::atomic<uint32_t>& active_;
+};
+
+bool sameEncoderSettings(const RecorderConfig& a, const RecorderConfig& b) {
+    return a.width == b.width && a.height == b.height && a.fps == b.fps &&
+           a.video_bitrate_kbps == b.video_bitrate_kbps && a.video_codec == b.video_codec &&
+           a.video_encoder == b.video_encoder && a.audio_sample_rate == b.audio_sample_rate &&
+           a.audio_channels == b.audio_channels && a.audio_bitrate_kbps == b.audio_bitrate_kbps &&
+           a.audio_codec == b.audio_codec && a.enable_system_audio == b.enable_system_audio &&
+           a.enable_microphone_audio == b.enable_microphone_audio;
+}
+}
+
+void Recorder::StageCounter::record(Clock::duration elapsed) noexcept {
+    const auto us = static_cast<uint64_t>(
+        std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count()));
+    count_.fetch_add(1, std::memory_order_relaxed);
+    total_us_.fetch_add(us, std::memory_order_relaxed);
+    uint64_t prev = max_us_.load(std::memory_order_relaxed);
+    while (us > prev && !max_us_.compare_exchange_weak(prev, us, std::memory_order_relaxed)) {
+    }
+    histogram_.record(us);
+}
+
+void Recorder::StageCounter::reset() noexcept {
+    count_.store(0, std::memory_order_relaxed);
+    total_us_.store(0, std::memory_order_relaxed);
+    max_us_.store(0, std::memory_order_relaxed);
+}
+
+PipelineStageStats Recorder::StageCounter::snapshot() const noexcept {
+    PipelineStageStats stats;
+    stats.count = count_.load(std::memory_order_relaxed);
+    stats.total_us = total_us_.load(std::memory_order_relaxed);
+    stats.max_us = max_us_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+Recorder::Recorder(std::unique_ptr<IEncoder> encoder, std::unique_ptr<IMuxer> muxer, MuxerFactory muxerFactory)
+    : encoder_(std::move(encoder)), muxer_(std::move(muxer)), muxer_factory_(std::move(muxerFactory)) {}
 
 Recorder::~Recorder() {
     stop();
 }
 
 bool Recorder::initialize(const RecorderConfig& config) {
+    std::scoped_lock control(control_mutex_);
     std::scoped_lock lock(mutex_);
+    if (running_) {
+        pending_config_ = config;
+        Logger::instance().info("Recorder: settings changed, applying them after this session");
+        return true;
+    }
+    return applyConfig(config);
+}
+
+// Caller holds control_mutex_ and mutex_, with no session running.
+bool Recorder::applyConfig(const RecorderConfig& config) {
     config_ = config;
     try {
         std::filesystem::create_directories(config_.buffer_directory);
@@ -38,6 +124,27 @@ bool Recorder::initialize(const RecorderConfig& config) {
         return false;
     }
 
+    std::scoped_lock encoderLock(encoder_mutex_);
+    if (initialized_ && sameEncoderSettings(encoder_config_, config_)) {
+        // Only non-encoder settings changed; the encoder stays as it is,
+        // apart from following keep_encoder_warm while idle.
+        if (!running_ && config_.keep_encoder_warm != encoder_open_) {
+            return config_.keep_encoder_warm ? (openEncoder(), true) : configureEncoder();
+        }
+        return true;
+    }
+    if (!configureEncoder()) {
+        return false;
+    }
+    initialized_ = true;
+    return true;
+}
+
+// Caller holds encoder_mutex_.
+bool Recorder::configureEncoder() {
+    encoder_->close();
+    encoder_open_ = false;
+    encoder_config_ = config_;
     if (!encoder_->initVideo(config_.video_codec, config_.width, config_.height,
                               config_.fps, config_.video_bitrate_kbps)) {
         Logger::instance().error("Recorder: failed to init video encoder");
@@ -57,7 +164,27 @@ bool Recorder::initialize(const RecorderConfig& config) {
         }
     }
 
-    initialized_ = true;
+    // Opening can take a while (hardware sessions, extradata probing); do it
+    // now rather than when the next session starts. A failure is retried then.
+    if (config_.keep_encoder_warm) {
+        openEncoder();
+    }
+    return true;
+}
+
+// Caller holds encoder_mutex_.
+bool Recorder::openEncoder() {
+    if (encoder_open_) {
+        return true;
+    }
+    const auto started = Clock::now();
+    if (!encoder_->open()) {
+        Logger::instance().error("Recorder: encoder open failed");
+        return false;
+    }
+    encoder_open_ = true;
+    Logger::instance().info(std::format("Recorder: encoder opened in {} ms",
+        std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - started).count()));
     return true;
 }
 
@@ -74,42 +201,141 @@ void Recorder::beginSession(int sessionId, const std::filesystem::path& sessionD
 }
 
 bool Recorder::start(bool enableRollingBuffer) {
-    std::scoped_lock lock(mutex_);
-    if (!initialized_) return false;
-    rolling_enabled_ = enableRollingBuffer;
-    if (!ensureEncoderOpen()) {
-        return false;
-    }
-    if (current_session_id_ < 0) {
-        Logger::instance().warn("Recorder: starting without session id, using default directory");
-        session_directory_ = config_.buffer_directory;
-        std::filesystem::create_directories(session_directory_);
+    std::scoped_lock control(control_mutex_);
+    if (running_) return true;
+    start_requested_ = Clock::now();
+    {
+        std::scoped_lock lock(mutex_);
+        if (!initialized_) return false;
+        rolling_enabled_ = enableRollingBuffer;
+        if (!ensureEncoderOpen()) {
+            return false;
+        }
+        if (current_session_id_ < 0) {
+            Logger::instance().warn("Recorder: starting without session id, using default directory");
+            session_directory_ = config_.buffer_directory;
+            std::filesystem::create_directories(session_directory_);
+        }
+
+        segment_index_ = 0;
+        completed_segments_.clear();
+        buffered_size_bytes_ = 0;
+
+        memory_mode_ = config_.memory_buffer && rolling_enabled_;
+        if (memory_mode_) {
+            PacketRing::Limits limits;
+            limits.max_duration_ms = config_.memory_buffer_duration.count();
+            limits.max_bytes = config_.rolling_size_limit_bytes;
+            ring_.setLimits(limits);
+            ring_.clear();
+            Logger::instance().info(std::format("Recorder: buffering last {}s in memory (limit {} bytes)",
+                                                limits.max_duration_ms / 1000, limits.max_bytes));
+        } else if (!openNewSegment()) {
+            return false;
+        }
+        async_segments_ = !memory_mode_ && muxer_factory_;
+        next_requested_ = false;
+
+        // stop() waited for the last producer and none gets past running_
+        // until it is set below, so the queues can be rebuilt with the
+        // current depths.
+        video_queue_ = std::make_unique<EvictingQueue<QueuedVideoFrame>>(std::max(1, config_.video_queue_depth));
+        system_audio_queue_ = std::make_unique<SpscQueue<QueuedAudioFrame>>(std::max(1, config_.audio_queue_depth));
+        mic_audio_queue_ = std::make_unique<SpscQueue<QueuedAudioFrame>>(std::max(1, config_.audio_queue_depth));
+        packet_queue_ = std::make_unique<SpscQueue<QueuedPacket>>(std::max(1, config_.packet_queue_depth));
+        drop_policy_ = config_.frame_drop_policy;
     }
 
-    segment_index_ = 0;
-    completed_segments_.clear();
-    buffered_size_bytes_ = 0;
+    video_frames_queued_ = 0;
+    video_frames_dropped_ = 0;
+    audio_frames_dropped_ = 0;
+    output_bytes_ = 0;
+    segment_bytes_ = 0;
+    output_video_packets_ = 0;
+    output_audio_packets_ = 0;
+    output_kbps_ = 0;
+    rate_window_start_ = Clock::now();
+    rate_window_bytes_ = 0;
+    awaiting_first_video_ = true;
+    frame_wait_.reset();
+    encode_time_.reset();
+    packet_wait_.reset();
+    mux_time_.reset();
 
+    encode_stop_ = false;
+    mux_stop_ = false;
+    if (async_segments_) {
+        segment_thread_ = std::thread(&Recorder::segmentLoop, this);
+    }
+    mux_thread_ = std::thread(&Recorder::muxLoop, this);
+    encode_thread_ = std::thread(&Recorder::encodeLoop, this);
     running_ = true;
-    return openNewSegment();
+    return true;
 }
 
 void Recorder::stop() {
-    std::scoped_lock lock(mutex_);
+    std::scoped_lock control(control_mutex_);
     if (!running_.exchange(false)) {
         return;
     }
+    // A capture callback that saw running_ set may still be pushing; the
+    // queues have to outlive it.
+    while (active_producers_.load() != 0) {
+        std::this_thread::yield();
+    }
 
     Logger::instance().info("Recorder: stopping...");
 
-    if (encoder_) {
-        std::vector<EncodedPacket> packets;
-        encoder_->flush(packets);
-        handlePackets(packets);
-        encoder_->close();
-    }
+    // The encoder thread drains what was already queued and flushes the
+    // encoder; the mux thread then writes out every remaining packet.
+    encode_stop_ = true;
+    encode_wake_.notify();
+    if (encode_thread_.joinable()) encode_thread_.join();
+
+    mux_stop_ = true;
+    mux_wake_.notify();
+    if (mux_thread_.joinable()) mux_thread_.join();
 
+    // Earlier segments are reported before the last one is closed below.
+    stopSegmentThread();
+
+    std::unique_lock lock(mutex_);
+    if (memory_mode_) {
+        // Archive the replay window as the session's only segment.
+        const auto snapshot = ring_.snapshot();
+        if (!snapshot.empty()) {
+            if (auto info = writeSnapshot(snapshot, buildSegmentPath(segment_index_++))) {
+                completed_segments_.push_back(*info);
+                buffered_size_bytes_ += info->size_bytes;
+                if (segment_closed_cb_) {
+                    segment_closed_cb_(completed_segments_.back());
+                }
+            }
+        }
+        ring_.clear();
+        memory_mode_ = false;
+    }
+    std::optional<RecorderConfig> pending = std::exchange(pending_config_, std::nullopt);
+    // New encoder settings rebuild it below anyway.
+    const bool rebuild = pending && !sameEncoderSettings(encoder_config_, *pending);
+    if (encoder_ && !rebuild) {
+        // The encoder thread already drained it. Warm encoders are reset for
+        // the next session; otherwise (or when that fails) it is rebuilt from
+        // the current settings, opened again only when keeping warm.
+        std::scoped_lock encoderLock(encoder_mutex_);
+        if (!config_.keep_encoder_warm || !encoder_->reset()) {
+            configureEncoder();
+        }
+    }
     closeCurrentSegment();
+    if (pending) {
+        applyConfig(*pending);
+    }
+    output_kbps_ = 0;
+    metrics().output_kbps.set(0);
+    logPipelineStats();
+    lock.unlock();
+    removePrunedFiles();
 }
 
 void Recorder::setRollingBufferEnabled(bool enabled) {
@@ -122,36 +348,264 @@ void Recorder::setSegmentClosedCallback(SegmentClosedCallback cb) {
     segment_closed_cb_ = std::move(cb);
 }
 
-void Recorder::setSegmentRemovedCallback(SegmentRemovedCallback cb) {
+void Recorder::setSegmentsRemovedCallback(SegmentsRemovedCallback cb) {
     std::scoped_lock lock(mutex_);
-    segment_removed_cb_ = std::move(cb);
+    segments_removed_cb_ = std::move(cb);
 }
 
 void Recorder::pushVideoFrame(const VideoFrame& frame) {
-    std::scoped_lock lock(mutex_);
-    if (!running_ || !encoder_ || !current_segment_) return;
+    ProducerScope scope(active_producers_);
+    if (!running_.load()) return;
 
-    if (!encoder_->pushVideoRGBA(frame.data.data(), frame.width, frame.height, frame.stride, frame.pts_ms)) {
-        Logger::instance().error("Recorder: failed to push video frame");
+    // The frame shares the capture pool's buffer; no pixel copy happens here.
+    QueuedVideoFrame item{frame, Clock::now()};
+    if (drop_policy_ == FrameDropPolicy::DropOldest) {
+        QueuedVideoFrame evicted;
+        if (video_queue_->pushEvicting(std::move(item), evicted)) {
+            video_frames_dropped_.fetch_add(1, std::memory_order_relaxed);
+            metrics().video_dropped.add();
+        }
+    } else if (!video_queue_->tryPush(std::move(item))) {
+        video_frames_dropped_.fetch_add(1, std::memory_order_relaxed);
+        metrics().video_dropped.add();
         return;
     }
-    std::vector<EncodedPacket> packets;
-    encoder_->pull(packets);
-    handlePackets(packets);
+    video_frames_queued_.fetch_add(1, std::memory_order_relaxed);
+    metrics().video_queued.add();
+    encode_wake_.notify();
 }
 
 void Recorder::pushAudioFrame(const AudioFrame& frame, bool isMic) {
-    std::scoped_lock lock(mutex_);
-    if (!running_ || !encoder_ || !current_segment_) return;
+    ProducerScope scope(active_producers_);
+    if (!running_.load()) return;
 
-    if (!encoder_->pushAudioF32(frame.interleaved.data(), frame.samples,
-                                frame.sample_rate, frame.channels, frame.pts_ms, isMic)) {
+    auto& queue = isMic ? *mic_audio_queue_ : *system_audio_queue_;
+    QueuedAudioFrame item{frame, Clock::now()};
+    if (!queue.tryPush(std::move(item))) {
+        const auto dropped = audio_frames_dropped_.fetch_add(1, std::memory_order_relaxed) + 1;
+        metrics().audio_dropped.add();
+        if ((dropped & (dropped - 1)) == 0) {
+            Logger::instance().warn(std::format("Recorder: audio queue full, {} frame(s) dropped", dropped));
+        }
         return;
     }
+    encode_wake_.notify();
+}
+
+RecorderPipelineStats Recorder::pipelineStats() const {
+    RecorderPipelineStats stats;
+    stats.video_frames_queued = video_frames_queued_.load(std::memory_order_relaxed);
+    stats.video_frames_dropped = video_frames_dropped_.load(std::memory_order_relaxed);
+    stats.audio_frames_dropped = audio_frames_dropped_.load(std::memory_order_relaxed);
+    if (running_) {
+        stats.video_queue_size = video_queue_->size();
+        stats.packet_queue_size = packet_queue_->size();
+    }
+    stats.frame_wait = frame_wait_.snapshot();
+    stats.encode = encode_time_.snapshot();
+    stats.packet_wait = packet_wait_.snapshot();
+    stats.mux = mux_time_.snapshot();
+    return stats;
+}
+
+RecorderOutputStats Recorder::outputStats() const {
+    RecorderOutputStats stats;
+    stats.bytes_written = output_bytes_.load(std::memory_order_relaxed);
+    stats.segment_bytes = segment_bytes_.load(std::memory_order_relaxed);
+    stats.video_packets = output_video_packets_.load(std::memory_order_relaxed);
+    stats.audio_packets = output_audio_packets_.load(std::memory_order_relaxed);
+    stats.bitrate_kbps = output_kbps_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void Recorder::encodeLoop() {
     std::vector<EncodedPacket> packets;
-    encoder_->pull(packets);
-    handlePackets(packets);
+    uint64_t encodedFrames = 0;
+    PipelineEventState lastEvent;
+    lastEvent.published = Clock::now();
+    for (;;) {
+        const uint32_t seen = encode_wake_.current();
+        bool worked = false;
+
+        // Audio frames are small and latency-sensitive; keep them ahead of video.
+        worked |= encodeQueuedAudio(*system_audio_queue_, false, packets);
+        worked |= encodeQueuedAudio(*mic_audio_queue_, true, packets);
+
+        QueuedVideoFrame item;
+        if (video_queue_->tryPop(item)) {
+            worked = true;
+            const auto dequeued = Clock::now();
+            frame_wait_.record(dequeued - item.enqueued);
+
+            {
+                const auto& frame = item.frame;
+                const uint64_t sequence = frame.buffer.sequence();
+                std::scoped_lock encoderLock(encoder_mutex_);
+                // Sources re-submit an unchanged picture as the same buffer;
+                // the encoder can skip converting it again.
+                const bool pushed =
+                    (sequence == last_video_sequence_ && encoder_->repeatVideo(frame.pts_ms)) ||
+                    encoder_->pushVideo(frame.data(), frame.format, frame.width, frame.height, frame.stride,
+                                        frame.pts_ms);
+                if (!pushed) {
+                    Logger::instance().error("Recorder: failed to push video frame");
+                    last_video_sequence_ = 0;
+                } else {
+                    last_video_sequence_ = sequence;
+                    encoder_->pull(packets);
+                }
+            }
+            encode_time_.record(Clock::now() - dequeued);
+            item.frame.buffer.reset(); // hand the buffer back to the capture pool early
+
+            if (++encodedFrames % kStatsReportInterval == 0) {
+                logPipelineStats();
+            }
+            if (dequeued - lastEvent.published >= kPipelineEventInterval && EventBus::instance().hasSubscribers()) {
+                publishPipelineEvents(lastEvent);
+                lastEvent.published = dequeued;
+            }
+        }
+
+        if (!packets.empty()) {
+            forwardPackets(packets);
+        }
+        if (worked) {
+            continue;
+        }
+        if (encode_stop_.load(std::memory_order_acquire)) {
+            break;
+        }
+        encode_wake_.wait(seen);
+    }
+
+    {
+        std::scoped_lock encoderLock(encoder_mutex_);
+        encoder_->flush(packets);
+    }
+    forwardPackets(packets);
+}
+
+bool Recorder::encodeQueuedAudio(SpscQueue<QueuedAudioFrame>& queue, bool isMic, std::vector<EncodedPacket>& packets) {
+    bool worked = false;
+    QueuedAudioFrame item;
+    while (queue.tryPop(item)) {
+        worked = true;
+        const auto& frame = item.frame;
+        std::scoped_lock encoderLock(encoder_mutex_);
+        if (encoder_->pushAudioF32(frame.interleaved.data(), frame.samples,
+                                   frame.sample_rate, frame.channels, frame.pts_ms, isMic)) {
+            encoder_->pull(packets);
+        }
+    }
+    return worked;
+}
+
+void Recorder::forwardPackets(std::vector<EncodedPacket>& packets) {
+    // Packets are never dropped: a gap would corrupt the stream. A full queue
+    // stalls this thread instead, which backs up into the frame queue.
+    for (auto& packet : packets) {
+        QueuedPacket item{std::move(packet), Clock::now()};
+        for (;;) {
+            const uint32_t seen = packet_space_.current();
+            if (packet_queue_->tryPush(std::move(item))) {
+                break;
+            }
+            packet_space_.wait(seen);
+        }
+        mux_wake_.notify();
+    }
+    packets.clear();
+}
+
+void Recorder::muxLoop() {
+    std::vector<EncodedPacket> batch;
+    batch.reserve(kMuxBatchLimit);
+    for (;;) {
+        const uint32_t seen = mux_wake_.current();
+        QueuedPacket item;
+        while (batch.size() < kMuxBatchLimit && packet_queue_->tryPop(item)) {
+            packet_wait_.record(Clock::now() - item.enqueued);
+            batch.push_back(std::move(item.packet));
+        }
+
+        if (!batch.empty()) {
+            packet_space_.notify();
+            const auto started = Clock::now();
+            if (awaiting_first_video_ && std::any_of(batch.begin(), batch.end(), [](const EncodedPacket& packet) {
+                    return packet.type == EncodedStreamType::Video;
+                })) {
+                awaiting_first_video_ = false;
+                const auto us = std::chrono::duration_cast<std::chrono::microseconds>(started - start_requested_).count();
+                metrics().first_packet_us.record(static_cast<uint64_t>(std::max<int64_t>(0, us)));
+                Logger::instance().info(std::format("Recorder: first video packet {} ms after start", us / 1000));
+            }
+            if (memory_mode_) {
+                for (auto& packet : batch) {
+                    ring_.push(std::move(packet));
+                }
+            } else {
+                {
+                    std::scoped_lock lock(mutex_);
+                    handlePackets(batch);
+                }
+                removePrunedFiles();
+            }
+            mux_time_.record(Clock::now() - started);
+            batch.clear();
+            continue;
+        }
+        if (mux_stop_.load(std::memory_order_acquire)) {
+            break;
+        }
+        mux_wake_.wait(seen);
+    }
+}
+
+void Recorder::logPipelineStats() const {
+    if (!Logger::instance().enabled(LogLevel::Debug)) {
+        return;
+    }
+    const auto stats = pipelineStats();
+    auto avg = [](const PipelineStageStats& s) { return s.count ? s.total_us / s.count : 0; };
+    Logger::instance().debug(std::format(
+        "Recorder: pipeline frames={} dropped={} audio_dropped={} | wait avg={}us max={}us | "
+        "encode avg={}us max={}us | packet wait avg={}us max={}us | mux avg={}us max={}us",
+        stats.video_frames_queued, stats.video_frames_dropped, stats.audio_frames_dropped,
+        avg(stats.frame_wait), stats.frame_wait.max_us, avg(stats.encode), stats.encode.max_us,
+        avg(stats.packet_wait), stats.packet_wait.max_us, avg(stats.mux), stats.mux.max_us));
+}
+// Encoder latency over the last interval, plus drops when there were any.
+void Recorder::publishPipelineEvents(PipelineEventState& last) const {
+    const auto stats = pipelineStats();
+    auto& bus = EventBus::instance();
+
+    const uint64_t videoDropped = stats.video_frames_dropped - std::min(stats.video_frames_dropped, last.video_frames_dropped);
+    const uint64_t audioDropped = stats.audio_frames_dropped - std::min(stats.audio_frames_dropped, last.audio_frames_dropped);
+    if (videoDropped > 0 || audioDropped > 0) {
+        bus.publish("frames_dropped", {{"video", videoDropped},
+                                       {"audio", audioDropped},
+                                       {"video_total", stats.video_frames_dropped},
+                                       {"audio_total", stats.audio_frames_dropped}});
+    }
+
+    auto windowAvg = [](const PipelineStageStats& now, const PipelineStageStats& before) -> uint64_t {
+        const uint64_t count = now.count - std::min(now.count, before.count);
+        return count ? (now.total_us - std::min(now.total_us, before.total_us)) / count : 0;
+    };
+    bus.publish("encoder_latency", {{"frames", stats.encode.count - std::min(stats.encode.count, last.encode.count)},
+                                    {"encode_avg_us", windowAvg(stats.encode, last.encode)},
+                                    {"encode_max_us", stats.encode.max_us},
+                                    {"queue_wait_avg_us", windowAvg(stats.frame_wait, last.frame_wait)},
+                                    {"video_queue", stats.video_queue_size},
+                                    {"packet_queue", stats.packet_queue_size}});
+
+    last.video_frames_dropped = stats.video_frames_dropped;
+    last.audio_frames_dropped = stats.audio_frames_dropped;
+    last.encode = stats.encode;
+    last.frame_wait = stats.frame_wait;
 }
+
 std::optional<SegmentInfo> Recorder::exportLastSegment(const std::filesystem::path& destination) {
     std::scoped_lock lock(mutex_);
     if (completed_segments_.empty()) {
@@ -168,47 +622,135 @@ std::optional<SegmentInfo> Recorder::exportLastSegment(const std::filesystem::pa
     }
 }
 
+std::optional<SegmentInfo> Recorder::saveReplay(const std::filesystem::path& destination,
+                                                std::chrono::milliseconds window) {
+    if (!memory_mode_) {
+        Logger::instance().warn("Recorder: saveReplay needs the memory buffer");
+        return std::nullopt;
+    }
+    const auto snapshot = ring_.snapshot(window.count());
+    if (snapshot.empty()) {
+        Logger::instance().warn("Recorder: memory buffer is empty");
+        return std::nullopt;
+    }
+    std::error_code ec;
+    std::filesystem::create_directories(destination.parent_path(), ec);
+    // The mux thread does not touch muxer_ in memory mode.
+    std::scoped_lock lock(mutex_);
+    return writeSnapshot(snapshot, destination);
+}
+
+std::optional<SegmentInfo> Recorder::writeSnapshot(const PacketRing::Snapshot& snapshot,
+                                                   const std::filesystem::path& path) {
+    MuxerConfig cfg;
+    cfg.container = config_.container;
+    cfg.two_audio_tracks = config_.enable_system_audio || config_.enable_microphone_audio;
+    cfg.path = path;
+
+    std::unique_lock encoderLock(encoder_mutex_);
+    auto videoInfo = encoder_->videoStream();
+    EncoderStreamInfo sysInfo = config_.enable_system_audio ? encoder_->audioStream(false) : EncoderStreamInfo{};
+    EncoderStreamInfo micInfo = config_.enable_microphone_audio ? encoder_->audioStream(true) : EncoderStreamInfo{};
+    encoderLock.unlock();
+    sysInfo.type = EncodedStreamType::SystemAudio;
+    if (!config_.enable_system_audio) {
+        sysInfo.codec_name.clear();
+    }
+    micInfo.type = EncodedStreamType::MicrophoneAudio;
+    if (!config_.enable_microphone_audio) {
+        micInfo.codec_name.clear();
+    }
+
+    if (!muxer_->open(cfg, videoInfo, sysInfo, micInfo)) {
+        Logger::instance().error(std::format("Recorder: cannot open {} for replay", path.string()));
+        return std::nullopt;
+    }
+
+    SegmentInfo info;
+    info.path = path;
+    info.start_ms = snapshot.start_ms;
+    info.end_ms = snapshot.end_ms;
+    for (const auto& gop : snapshot.gops) {
+        for (const auto& packet : gop->packets) {
+            // Audio captured just before the first keyframe has nothing to play against.
+            if (packet.pts < snapshot.start_ms) {
+                continue;
+            }
+            if (!muxer_->write(packet)) {
+                Logger::instance().warn(std::format("Recorder: replay packet write failed ({})", path.string()));
+            }
+        }
+        info.keyframe_ms = gop->start_ms;
+    }
+    muxer_->close();
+    info.keyframes = muxer_->keyframeIndex();
+    info.size_bytes = muxer_->stats().bytes_written;
+    if (info.size_bytes == 0) {
+        Logger::instance().error(std::format("Recorder: replay {} was not written", path.string()));
+        return std::nullopt;
+    }
+    Logger::instance().info(std::format("Recorder: wrote {} ms of buffered replay to {} ({} bytes)",
+                                        info.end_ms - info.start_ms, path.string(), info.size_bytes));
+    return info;
+}
+
 bool Recorder::ensureEncoderOpen() {
-    if (!encoder_->open()) {
-        Logger::instance().error("Recorder: encoder open failed");
-        return false;
+    std::scoped_lock encoderLock(encoder_mutex_);
+    if (!encoder_open_) {
+        metrics().cold_starts.add();
     }
-    return true;
+    return openEncoder();
 }
 
-bool Recorder::openNewSegment() {
+Recorder::ActiveSegment Recorder::nextSegmentSpec() {
     ActiveSegment seg{};
     seg.muxer_cfg.container = config_.container;
     seg.muxer_cfg.two_audio_tracks = config_.enable_system_audio || config_.enable_microphone_audio;
-    std::filesystem::path filePath = buildSegmentPath(segment_index_++);
+    seg.muxer_cfg.path = buildSegmentPath(segment_index_++);
+    seg.path = seg.muxer_cfg.path;
+    seg.system_audio = config_.enable_system_audio;
+    seg.mic_audio = config_.enable_microphone_audio;
+    return seg;
+}
+
+bool Recorder::openSegment(IMuxer& muxer, const ActiveSegment& seg) {
     std::error_code ec;
-    std::filesystem::create_directories(filePath.parent_path(), ec);
+    std::filesystem::create_directories(seg.path.parent_path(), ec);
     if (ec) {
         Logger::instance().error("Recorder: failed to create segment directory: " + ec.message());
     }
-    seg.muxer_cfg.path = filePath;
-    seg.start_pts = 0;
-    seg.last_pts = 0;
-    seg.last_keyframe_pts = 0;
-    seg.path = seg.muxer_cfg.path;
 
+    // The encoder thread may be filling in extradata concurrently.
+    std::unique_lock encoderLock(encoder_mutex_);
     auto videoInfo = encoder_->videoStream();
-    EncoderStreamInfo sysInfo = config_.enable_system_audio ? encoder_->audioStream(false) : EncoderStreamInfo{};
+    EncoderStreamInfo sysInfo = seg.system_audio ? encoder_->audioStream(false) : EncoderStreamInfo{};
+    EncoderStreamInfo micInfo = seg.mic_audio ? encoder_->audioStream(true) : EncoderStreamInfo{};
+    encoderLock.unlock();
+
     sysInfo.type = EncodedStreamType::SystemAudio;
-    if (!config_.enable_system_audio) {
+    if (!seg.system_audio) {
         sysInfo.codec_name.clear();
     }
-    EncoderStreamInfo micInfo = config_.enable_microphone_audio ? encoder_->audioStream(true) : EncoderStreamInfo{};
     micInfo.type = EncodedStreamType::MicrophoneAudio;
-    if (!config_.enable_microphone_audio) {
+    if (!seg.mic_audio) {
         micInfo.codec_name.clear();
     }
 
-    if (!muxer_->open(seg.muxer_cfg, videoInfo, sysInfo, micInfo)) {
-        Logger::instance().error("Recorder: muxer open failed");
+    if (!muxer.open(seg.muxer_cfg, videoInfo, sysInfo, micInfo)) {
+        Logger::instance().error(std::format("Recorder: muxer open failed for {}", seg.path.string()));
         return false;
     }
+    return true;
+}
+
+bool Recorder::openNewSegment() {
+    return openNewSegment(nextSegmentSpec());
+}
 
+bool Recorder::openNewSegment(ActiveSegment seg) {
+    if (!openSegment(*muxer_, seg)) {
+        return false;
+    }
     current_segment_ = seg;
     rotate_pending_ = false;
     return true;
@@ -217,42 +759,193 @@ bool Recorder::openNewSegment() {
 void Recorder::closeCurrentSegment() {
     if (!current_segment_) return;
     muxer_->close();
-    auto path = current_segment_->path;
-    uint64_t size = 0;
-    try {
-        size = std::filesystem::file_size(path);
-    } catch (...) {
-        size = 0;
-    }
+    recordClosedSegment(*current_segment_, muxer_->stats().bytes_written, muxer_->keyframeIndex());
+    current_segment_.reset();
+}
 
-    if (size > 0 || current_segment_->last_pts > current_segment_->start_pts) {
+void Recorder::recordClosedSegment(const ActiveSegment& seg, uint64_t size, std::vector<KeyframeIndexEntry> keyframes) {
+    if (size > 0 || seg.last_pts > seg.start_pts) {
         SegmentInfo info;
-        info.path = path;
-        info.start_ms = current_segment_->start_pts;
-        info.end_ms = current_segment_->last_pts;
-        info.keyframe_ms = current_segment_->last_keyframe_pts;
+        info.path = seg.path;
+        info.start_ms = seg.start_pts;
+        info.end_ms = seg.last_pts;
+        info.keyframe_ms = seg.last_keyframe_pts;
         info.size_bytes = size;
-        completed_segments_.push_back(info);
+        info.keyframes = std::move(keyframes);
         buffered_size_bytes_ += size;
+        // Prune first so the removals and the new chunk reach the callbacks
+        // as one rotation, and the new segment itself is never pruned.
+        if (rolling_enabled_) {
+            pruneRollingBuffer(info);
+        }
+        completed_segments_.push_back(std::move(info));
+        metrics().segments.add();
 
+        const auto& closed = completed_segments_.back();
         Logger::instance().info(std::format(
-            "Recorder: closed segment {} (size={} bytes, start={}ms, end={}ms, keyframe={}ms)",
-            info.path.string(), info.size_bytes, info.start_ms, info.end_ms, info.keyframe_ms
+            "Recorder: closed segment {} (size={} bytes, start={}ms, end={}ms, keyframe={}ms, keyframes={})",
+            closed.path.string(), closed.size_bytes, closed.start_ms, closed.end_ms, closed.keyframe_ms, closed.keyframes.size()
         ));
 
         if (segment_closed_cb_) {
             segment_closed_cb_(completed_segments_.back());
         }
-        if (rolling_enabled_) {
-            pruneRollingBuffer();
-        }
     }
     else {
         Logger::instance().warn(std::format(
-            "Recorder: segment {} discarded (empty)", path.string()
+            "Recorder: segment {} discarded (empty)", seg.path.string()
         ));
     }
+}
+
+// Mux thread, under mutex_. The finished segment always goes through the
+// segment thread so that it is reported after the ones before it, and the
+// next one is either the segment thread's or the index it was asked for, so
+// files are opened in index order.
+void Recorder::rotateSegment() {
+    if (!async_segments_) {
+        closeCurrentSegment();
+        openNewSegment();
+        return;
+    }
+
+    std::optional<SegmentHandoff> next;
+    std::optional<ActiveSegment> spec;
+    std::unique_ptr<IMuxer> spare;
+    {
+        std::unique_lock lock(segment_mutex_);
+        // An open already under way is waited for; opening a later index
+        // ahead of it would put the files out of order.
+        next_opened_cv_.wait(lock, [this] { return !opening_next_; });
+        next = std::move(next_segment_);
+        next_segment_.reset();
+        if (!next) {
+            if (!idle_muxers_.empty()) {
+                spare = std::move(idle_muxers_.back());
+                idle_muxers_.pop_back();
+            }
+            // Either the request was not picked up yet and is opened here,
+            // or the last attempt failed; the one after is asked for anew.
+            spec = std::move(next_request_);
+            next_request_.reset();
+            next_requested_ = false;
+        }
+        closing_segments_.push_back(SegmentHandoff{std::move(*current_segment_), std::move(muxer_)});
+    }
+    segment_cv_.notify_one();
     current_segment_.reset();
+
+    if (next) {
+        muxer_ = std::move(next->muxer);
+        current_segment_ = std::move(next->segment);
+        next_requested_ = false;
+        return;
+    }
+
+    metrics().inline_opens.add();
+    Logger::instance().warn("Recorder: next segment not ready, opening it on the mux thread");
+    muxer_ = spare ? std::move(spare) : muxer_factory_();
+    if (!muxer_ || !(spec ? openNewSegment(std::move(*spec)) : openNewSegment())) {
+        Logger::instance().error("Recorder: cannot open the next segment");
+    }
+}
+
+// Mux thread, under mutex_.
+void Recorder::requestNextSegment() {
+    next_requested_ = true;
+    {
+        std::scoped_lock lock(segment_mutex_);
+        next_request_ = nextSegmentSpec();
+    }
+    segment_cv_.notify_one();
+}
+
+void Recorder::segmentLoop() {
+    std::unique_lock lock(segment_mutex_);
+    for (;;) {
+        segment_cv_.wait(lock, [this] { return segment_stop_ || next_request_ || !closing_segments_.empty(); });
+        if (!closing_segments_.empty()) {
+            SegmentHandoff done = std::move(closing_segments_.front());
+            closing_segments_.pop_front();
+            lock.unlock();
+            finishSegment(done);
+            lock.lock();
+            idle_muxers_.push_back(std::move(done.muxer));
+            continue;
+        }
+        if (segment_stop_) {
+            return; // a pending request is dropped
+        }
+
+        ActiveSegment seg = std::move(*next_request_);
+        next_request_.reset();
+        std::unique_ptr<IMuxer> muxer;
+        if (!idle_muxers_.empty()) {
+            muxer = std::move(idle_muxers_.back());
+            idle_muxers_.pop_back();
+        }
+        opening_next_ = true;
+        lock.unlock();
+
+        if (!muxer) {
+            muxer = muxer_factory_();
+        }
+        const bool opened = muxer && openSegment(*muxer, seg);
+
+        lock.lock();
+        opening_next_ = false;
+        if (opened) {
+            next_segment_ = SegmentHandoff{std::move(seg), std::move(muxer)};
+        } else if (muxer) {
+            idle_muxers_.push_back(std::move(muxer));
+        }
+        next_opened_cv_.notify_all();
+    }
+}
+
+void Recorder::finishSegment(SegmentHandoff& done) {
+    uint64_t size = 0;
+    std::vector<KeyframeIndexEntry> keyframes;
+    {
+        ScopedTimer timer(metrics().finalize_us);
+        done.muxer->close();
+        size = done.muxer->stats().bytes_written;
+        keyframes = done.muxer->keyframeIndex();
+    }
+    {
+        std::scoped_lock lock(mutex_);
+        recordClosedSegment(done.segment, size, std::move(keyframes));
+    }
+    removePrunedFiles();
+}
+
+void Recorder::stopSegmentThread() {
+    if (!segment_thread_.joinable()) {
+        return;
+    }
+    {
+        std::scoped_lock lock(segment_mutex_);
+        segment_stop_ = true;
+    }
+    segment_cv_.notify_all();
+    segment_thread_.join();
+
+    std::scoped_lock lock(mutex_, segment_mutex_);
+    // Nothing was written to the prepared segment; drop its file.
+    if (next_segment_) {
+        next_segment_->muxer->close();
+        std::error_code ec;
+        std::filesystem::remove(next_segment_->segment.path, ec);
+        idle_muxers_.push_back(std::move(next_segment_->muxer));
+        next_segment_.reset();
+    }
+    next_request_.reset();
+    segment_stop_ = false;
+    async_segments_ = false;
+    if (!muxer_ && !idle_muxers_.empty()) {
+        muxer_ = std::move(idle_muxers_.back());
+        idle_muxers_.pop_back();
+    }
 }
 
 void Recorder::handlePackets(std::vector<EncodedPacket>& packets) {
@@ -261,8 +954,8 @@ void Recorder::handlePackets(std::vector<EncodedPacket>& packets) {
 
         if (rotate_pending_ && packet.type == EncodedStreamType::Video && packet.keyframe) {
             Logger::instance().info("Recorder: rotating segment on keyframe");
-            closeCurrentSegment();
-            openNewSegment();
+            ScopedTimer rotationTimer(metrics().rotation_us);
+            rotateSegment();
             rotate_pending_ = false;
             if (current_segment_) {
                 current_segment_->start_pts = packet.pts;
@@ -278,16 +971,50 @@ void Recorder::handlePackets(std::vector<EncodedPacket>& packets) {
             continue;
         }
 
-        if (current_segment_->start_pts == 0) {
+        // Chunk times are on the video clock; clip export relies on that.
+        if (current_segment_->start_pts == 0 && packet.type == EncodedStreamType::Video) {
             current_segment_->start_pts = packet.pts;
         }
+        recordOutput(packet);
         current_segment_->last_pts = std::max(current_segment_->last_pts, packet.pts);
         if (packet.type == EncodedStreamType::Video && packet.keyframe) {
             current_segment_->last_keyframe_pts = packet.pts;
         }
+        // Prepared once the encoder has produced video, so the next file
+        // gets the final extradata.
+        if (async_segments_ && !next_requested_ && packet.type == EncodedStreamType::Video) {
+            requestNextSegment();
+        }
 
         rotateIfNeeded(packet.pts, packet.keyframe);
     }
+    updateOutputRate();
+}
+
+void Recorder::recordOutput(const EncodedPacket& packet) {
+    const uint64_t bytes = muxer_->stats().bytes_written;
+    if (bytes > current_segment_->bytes_written) {
+        output_bytes_.fetch_add(bytes - current_segment_->bytes_written, std::memory_order_relaxed);
+        current_segment_->bytes_written = bytes;
+    }
+    segment_bytes_.store(current_segment_->bytes_written, std::memory_order_relaxed);
+    auto& packets = packet.type == EncodedStreamType::Video ? output_video_packets_ : output_audio_packets_;
+    packets.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Recorder::updateOutputRate() {
+    const auto now = Clock::now();
+    const auto elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(now - rate_window_start_).count();
+    if (elapsedMs < std::chrono::duration_cast<std::chrono::milliseconds>(kOutputRateWindow).count()) {
+        return;
+    }
+    const uint64_t bytes = output_bytes_.load(std::memory_order_relaxed);
+    // Bits per millisecond is kbit/s.
+    const uint64_t kbps = (bytes - rate_window_bytes_) * 8 / static_cast<uint64_t>(elapsedMs);
+    output_kbps_.store(kbps, std::memory_order_relaxed);
+    metrics().output_kbps.set(static_cast<int64_t>(kbps));
+    rate_window_bytes_ = bytes;
+    rate_window_start_ = now;
 }
 
 void Recorder::rotateIfNeeded(int64_t pts_ms, bool /*keyframe*/) {
@@ -296,12 +1023,8 @@ void Recorder::rotateIfNeeded(int64_t pts_ms, bool /*keyframe*/) {
     const auto duration = pts_ms - current_segment_->start_pts;
     const bool timeLimit = duration >= config_.segment_length.count();
 
-    std::error_code ec;
-    uint64_t size = 0;
-    if (std::filesystem::exists(current_segment_->path, ec))
-        size = std::filesystem::file_size(current_segment_->path, ec);
-
-    const bool sizeLimit = size >= config_.rolling_size_limit_bytes;
+    const bool sizeLimit = config_.rolling_size_limit_bytes > 0 &&
+                           current_segment_->bytes_written >= config_.rolling_size_limit_bytes;
 
     if ((timeLimit || sizeLimit) && !rotate_pending_) {
         rotate_pending_ = true;
@@ -315,18 +1038,46 @@ std::filesystem::path Recorder::buildSegmentPath(uint32_t index) const {
     return base / oss.str();
 }
 
-void Recorder::pruneRollingBuffer() {
-    while (!completed_segments_.empty() && buffered_size_bytes_ > config_.rolling_size_limit_bytes) {
-        auto seg = completed_segments_.front();
-        try {
-            std::filesystem::remove(seg.path);
-        } catch (...) {
-        }
-        if (segment_removed_cb_) {
-            segment_removed_cb_(seg);
+// |newest| is about to be appended and already counted in buffered_size_bytes_.
+// Only the front is ever looked at, so a rotation costs O(segments removed).
+// The files themselves go to pruned_files_ for removePrunedFiles().
+void Recorder::pruneRollingBuffer(const SegmentInfo& newest) {
+    const uint64_t byteLimit = config_.rolling_size_limit_bytes;
+    const int64_t window = config_.rolling_duration.count();
+    std::vector<SegmentInfo> removed;
+    while (!completed_segments_.empty()) {
+        const bool overBytes = byteLimit > 0 && buffered_size_bytes_ > byteLimit;
+        const int64_t nextStart = completed_segments_.size() > 1 ? completed_segments_[1].start_ms : newest.start_ms;
+        const bool covered = window > 0 && newest.end_ms - nextStart >= window;
+        if (!overBytes && !covered) {
+            break;
         }
+        SegmentInfo seg = std::move(completed_segments_.front());
+        completed_segments_.pop_front();
+        pruned_files_.push_back(seg.path);
         buffered_size_bytes_ = buffered_size_bytes_ > seg.size_bytes ? buffered_size_bytes_ - seg.size_bytes : 0;
-        completed_segments_.erase(completed_segments_.begin());
+        removed.push_back(std::move(seg));
+    }
+    if (!removed.empty() && segments_removed_cb_) {
+        segments_removed_cb_(removed);
+    }
+}
+
+// Deletes what pruneRollingBuffer() dropped; called after releasing mutex_ so
+// the mux thread and status queries don't wait on the filesystem.
+void Recorder::removePrunedFiles() {
+    std::vector<std::filesystem::path> files;
+    {
+        std::scoped_lock lock(mutex_);
+        files.swap(pruned_files_);
+    }
+    for (const auto& file : files) {
+        std::error_code ec;
+        // A file a clip export still reads goes once the export is done.
+        SegmentPins::instance().remove(file, ec);
+        if (ec) {
+            Logger::instance().warn(std::format("Recorder: failed to remove {}: {}", file.string(), ec.message()));
+        }
     }
 }
 
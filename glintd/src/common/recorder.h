@@ -2,17 +2,30 @@
 
 #include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <filesystem>
 #include <functional>
 #include <memory>
 #include <mutex>
 #include <optional>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "encoder.h"
 #include "frame_types.h"
+#include "metrics.h"
 #include "muxer.h"
+#include "packet_ring.h"
+#include "spsc_queue.h"
+
+// What happens to captured frames when the encoder thread falls behind.
+// Capture never blocks either way.
+enum class FrameDropPolicy {
+    DropNewest, // a full queue rejects the incoming frame
+    DropOldest  // a full queue evicts its oldest frame to take the incoming one
+};
 
 struct RecorderConfig {
     int width{1920};
@@ -37,7 +50,54 @@ struct RecorderConfig {
     std::string container{"matroska"};
 
     std::chrono::milliseconds segment_length{std::chrono::milliseconds(2000)};
+    // Rolling retention: the oldest segment goes once the rest still cover
+    // rolling_duration, or while the total exceeds rolling_size_limit_bytes.
+    // Zero disables either limit.
     uint64_t rolling_size_limit_bytes{100ull * 1024ull * 1024ull};
+    std::chrono::milliseconds rolling_duration{std::chrono::seconds(120)};
+
+    // Rolling mode only: keep the replay window in RAM instead of segment
+    // files. Bounded by memory_buffer_duration and rolling_size_limit_bytes.
+    bool memory_buffer{false};
+    std::chrono::milliseconds memory_buffer_duration{std::chrono::seconds(30)};
+
+    // Capture -> encoder -> muxer hand-off depths.
+    int video_queue_depth{4};
+    int audio_queue_depth{64};
+    int packet_queue_depth{512};
+    FrameDropPolicy frame_drop_policy{FrameDropPolicy::DropNewest};
+
+    // Keep the encoder open between sessions and only reset it, so a session
+    // starts without opening codecs. It is rebuilt only when the encoder
+    // settings above change. Holds a hardware encoder session while idle.
+    bool keep_encoder_warm{true};
+};
+
+struct PipelineStageStats {
+    uint64_t count{0};
+    uint64_t total_us{0};
+    uint64_t max_us{0};
+};
+
+struct RecorderPipelineStats {
+    uint64_t video_frames_queued{0};
+    uint64_t video_frames_dropped{0};
+    uint64_t audio_frames_dropped{0};
+    std::size_t video_queue_size{0};
+    std::size_t packet_queue_size{0};
+    PipelineStageStats frame_wait{};  // capture -> encoder dequeue
+    PipelineStageStats encode{};      // push + pull on the encoder
+    PipelineStageStats packet_wait{}; // encoder -> muxer dequeue
+    PipelineStageStats mux{};         // one batch of muxer writes, incl. rotation
+};
+
+// What the muxer has written this session, from its in-memory counters.
+struct RecorderOutputStats {
+    uint64_t bytes_written{0}; // all segments
+    uint64_t segment_bytes{0}; // the open segment
+    uint64_t video_packets{0};
+    uint64_t audio_packets{0};
+    uint64_t bitrate_kbps{0};  // over the last second or so
 };
 
 struct SegmentInfo {
@@ -47,16 +107,26 @@ struct SegmentInfo {
     int64_t keyframe_ms{0};
     uint64_t size_bytes{0};
     int64_t chunk_id{-1};
+    uint64_t chunk_ticket{0}; // DbWriter handle until chunk_id is known
+    std::vector<KeyframeIndexEntry> keyframes;
 };
 
 class Recorder {
 public:
     using SegmentClosedCallback = std::function<void(SegmentInfo&)>;
-    using SegmentRemovedCallback = std::function<void(const SegmentInfo&)>;
+    // Everything one rotation pruned, oldest first.
+    using SegmentsRemovedCallback = std::function<void(const std::vector<SegmentInfo>&)>;
+    using MuxerFactory = std::function<std::unique_ptr<IMuxer>()>;
 
-    Recorder(std::unique_ptr<IEncoder> encoder, std::unique_ptr<IMuxer> muxer);
+    // With a muxer factory the next segment is opened ahead of time and
+    // finished segments are closed on a background thread, so rotation only
+    // swaps muxers on the mux thread. Segment callbacks then run on that
+    // thread, still in segment order.
+    Recorder(std::unique_ptr<IEncoder> encoder, std::unique_ptr<IMuxer> muxer, MuxerFactory muxerFactory = {});
     ~Recorder();
 
+    // During a session the new settings are held back and take effect when
+    // it stops, so segments, streams and encoder always match.
     bool initialize(const RecorderConfig& config);
     void beginSession(int sessionId, const std::filesystem::path& sessionDirectory);
     bool start(bool enableRollingBuffer);
@@ -64,48 +134,190 @@ public:
 
     void setRollingBufferEnabled(bool enabled);
     void setSegmentClosedCallback(SegmentClosedCallback cb);
-    void setSegmentRemovedCallback(SegmentRemovedCallback cb);
+    void setSegmentsRemovedCallback(SegmentsRemovedCallback cb);
 
+    // Non-blocking hand-off to the encoder thread. Each source (video, system
+    // audio, microphone) must push from a single thread.
     void pushVideoFrame(const VideoFrame& frame);
     void pushAudioFrame(const AudioFrame& frame, bool isMic);
 
     std::optional<SegmentInfo> exportLastSegment(const std::filesystem::path& destination);
+    // Memory buffer only: writes the last |window| (whole buffer when zero)
+    // to |destination| without stopping the recording.
+    std::optional<SegmentInfo> saveReplay(const std::filesystem::path& destination,
+                                          std::chrono::milliseconds window = std::chrono::milliseconds::zero());
+    bool usingMemoryBuffer() const { return memory_mode_.load(); }
+    PacketRing::Stats memoryBufferStats() const { return ring_.stats(); }
+    RecorderPipelineStats pipelineStats() const;
+    RecorderOutputStats outputStats() const;
 
 private:
+    using Clock = std::chrono::steady_clock;
+
+    struct QueuedVideoFrame {
+        VideoFrame frame;
+        Clock::time_point enqueued{};
+    };
+
+    struct QueuedAudioFrame {
+        AudioFrame frame;
+        Clock::time_point enqueued{};
+    };
+
+    struct QueuedPacket {
+        EncodedPacket packet;
+        Clock::time_point enqueued{};
+    };
+
+    // Per-session totals for pipelineStats(); every sample also goes to a
+    // process-wide histogram.
+    class StageCounter {
+    public:
+        explicit StageCounter(Histogram& histogram) : histogram_(histogram) {}
+        void record(Clock::duration elapsed) noexcept;
+        void reset() noexcept;
+        [[nodiscard]] PipelineStageStats snapshot() const noexcept;
+
+    private:
+        std::atomic<uint64_t> count_{0};
+        std::atomic<uint64_t> total_us_{0};
+        std::atomic<uint64_t> max_us_{0};
+        Histogram& histogram_;
+    };
+
+    // What the last pipeline event covered; owned by the encoder thread.
+    struct PipelineEventState {
+        Clock::time_point published{};
+        uint64_t video_frames_dropped{0};
+        uint64_t audio_frames_dropped{0};
+        PipelineStageStats encode{};
+        PipelineStageStats frame_wait{};
+    };
+
     struct ActiveSegment {
         MuxerConfig muxer_cfg;
         int64_t start_pts{0};
         int64_t last_pts{0};
         int64_t last_keyframe_pts{0};
         std::filesystem::path path;
+        uint64_t bytes_written{0};
+        bool system_audio{false};
+        bool mic_audio{false};
+    };
+
+    // A segment with its own muxer, on its way to or from the segment thread.
+    struct SegmentHandoff {
+        ActiveSegment segment;
+        std::unique_ptr<IMuxer> muxer;
     };
 
+    bool applyConfig(const RecorderConfig& config);
+    bool configureEncoder();
+    bool openEncoder();
     bool ensureEncoderOpen();
+    ActiveSegment nextSegmentSpec();
+    bool openSegment(IMuxer& muxer, const ActiveSegment& seg);
     bool openNewSegment();
+    bool openNewSegment(ActiveSegment seg);
     void closeCurrentSegment();
+    void recordClosedSegment(const ActiveSegment& seg, uint64_t size, std::vector<KeyframeIndexEntry> keyframes);
+    void rotateSegment();
+    void requestNextSegment();
+    void segmentLoop();
+    void finishSegment(SegmentHandoff& done);
+    void stopSegmentThread();
     void handlePackets(std::vector<EncodedPacket>& packets);
     void rotateIfNeeded(int64_t pts_ms, bool keyframe);
+    void recordOutput(const EncodedPacket& packet);
+    void updateOutputRate();
     std::filesystem::path buildSegmentPath(uint32_t index) const;
-    void pruneRollingBuffer();
+    void pruneRollingBuffer(const SegmentInfo& newest);
+    void removePrunedFiles();
     void resetSessionState();
+    std::optional<SegmentInfo> writeSnapshot(const PacketRing::Snapshot& snapshot, const std::filesystem::path& path);
+
+    void encodeLoop();
+    void muxLoop();
+    bool encodeQueuedAudio(SpscQueue<QueuedAudioFrame>& queue, bool isMic, std::vector<EncodedPacket>& packets);
+    void forwardPackets(std::vector<EncodedPacket>& packets);
+    void logPipelineStats() const;
+    void publishPipelineEvents(PipelineEventState& last) const;
 
     std::unique_ptr<IEncoder> encoder_;
     std::unique_ptr<IMuxer> muxer_;
+    MuxerFactory muxer_factory_;
     RecorderConfig config_{};
+    RecorderConfig encoder_config_{}; // what encoder_ was last configured with
+    std::optional<RecorderConfig> pending_config_{}; // from initialize() mid-session, applied on stop
 
-    std::mutex mutex_;
+    std::mutex control_mutex_; // serialises start/stop
+    std::mutex encoder_mutex_; // encoder_ is driven by the encoder thread
+    mutable std::mutex mutex_; // segment state, config and callbacks; taken by the mux thread
     bool initialized_{false};
+    bool encoder_open_{false};  // guarded by encoder_mutex_
+    uint64_t last_video_sequence_{0}; // guarded by encoder_mutex_, buffer behind the encoder's last picture
     bool rolling_enabled_{true};
     std::optional<ActiveSegment> current_segment_{};
-    std::vector<SegmentInfo> completed_segments_{};
+    std::deque<SegmentInfo> completed_segments_{}; // oldest first
+    std::vector<std::filesystem::path> pruned_files_{}; // deleted once mutex_ is released
     uint32_t segment_index_{0};
     std::atomic<bool> running_{false};
     std::filesystem::path session_directory_{};
     int current_session_id_{-1};
     uint64_t buffered_size_bytes_{0};
     SegmentClosedCallback segment_closed_cb_{};
-    SegmentRemovedCallback segment_removed_cb_{};
+    SegmentsRemovedCallback segments_removed_cb_{};
     bool rotate_pending_ = false;
+    bool async_segments_{false}; // segment thread running for this session
+    bool next_requested_{false}; // mux thread: the next segment is being prepared
+
+    // Segment thread: opens the next segment and closes finished ones.
+    std::mutex segment_mutex_;
+    std::condition_variable segment_cv_;
+    std::condition_variable next_opened_cv_; // opening_next_ went false
+    std::deque<SegmentHandoff> closing_segments_;
+    std::optional<ActiveSegment> next_request_;
+    std::optional<SegmentHandoff> next_segment_;
+    std::vector<std::unique_ptr<IMuxer>> idle_muxers_;
+    bool opening_next_{false};
+    bool segment_stop_{false};
+    std::thread segment_thread_;
+
+    PacketRing ring_;
+    std::atomic<bool> memory_mode_{false};
 
+    std::unique_ptr<EvictingQueue<QueuedVideoFrame>> video_queue_;
+    std::unique_ptr<SpscQueue<QueuedAudioFrame>> system_audio_queue_;
+    std::unique_ptr<SpscQueue<QueuedAudioFrame>> mic_audio_queue_;
+    std::unique_ptr<SpscQueue<QueuedPacket>> packet_queue_;
+    FrameDropPolicy drop_policy_{FrameDropPolicy::DropNewest};
+    WakeSignal encode_wake_;
+    WakeSignal mux_wake_;
+    WakeSignal packet_space_;
+    std::atomic<uint32_t> active_producers_{0}; // capture callbacks inside push*Frame
+    std::atomic<bool> encode_stop_{false};
+    std::atomic<bool> mux_stop_{false};
+    std::thread encode_thread_;
+    std::thread mux_thread_;
 
+    std::atomic<uint64_t> video_frames_queued_{0};
+    std::atomic<uint64_t> video_frames_dropped_{0};
+    std::atomic<uint64_t> audio_frames_dropped_{0};
+    std::atomic<uint64_t> output_bytes_{0};
+    std::atomic<uint64_t> segment_bytes_{0};
+    std::atomic<uint64_t> output_video_packets_{0};
+    std::atomic<uint64_t> output_audio_packets_{0};
+    std::atomic<uint64_t> output_kbps_{0};
+    Clock::time_point rate_window_start_{}; // mux thread
+    Clock::time_point start_requested_{};
+    bool awaiting_first_video_{false}; // mux thread
+    uint64_t rate_window_bytes_{0};
+    StageCounter frame_wait_{MetricsRegistry::instance().histogram(
+        "glint_recorder_frame_wait_us", "Capture to encoder dequeue, microseconds")};
+    StageCounter encode_time_{MetricsRegistry::instance().histogram(
+        "glint_recorder_encode_us", "Encoder push and pull per video frame, microseconds")};
+    StageCounter packet_wait_{MetricsRegistry::instance().histogram(
+        "glint_recorder_packet_wait_us", "Encoder to muxer dequeue, microseconds")};
+    StageCounter mux_time_{MetricsRegistry::instance().histogram(
+        "glint_recorder_mux_us", "One batch of muxer writes, microseconds")};
 };
\ No newline at end of file
@@ -4,12 +4,15 @@
 #include <chrono>
 #include <cctype>
 #include <iomanip>
+#include <iterator>
 #include <sstream>
 #include <format>
 
 #include "buffer_merger.h"
 #include "db.h"
+#include "event_bus.h"
 #include "logger.h"
+#include "segment_pins.h"
 
 namespace {
 std::string sanitize(const std::string& value) {
@@ -37,12 +40,25 @@ int64_t now_ms() {
 ReplayBuffer::ReplayBuffer(Options options)
     : options_(std::move(options)), rolling_enabled_(options_.rolling_mode) {}
 
+ReplayBuffer::~ReplayBuffer() {
+    // Pending merges are finished rather than dropped: they hold the only
+    // copy of the session output.
+    {
+        std::scoped_lock lock(finalize_mutex_);
+        finalize_stop_ = true;
+    }
+    finalize_cv_.notify_all();
+    if (finalize_thread_.joinable()) {
+        finalize_thread_.join();
+    }
+}
+
 void ReplayBuffer::attachRecorder(Recorder* recorder) {
     std::scoped_lock lock(mutex_);
     recorder_ = recorder;
     if (recorder_) {
         recorder_->setSegmentClosedCallback([this](SegmentInfo& info) { onSegmentClosed(info); });
-        recorder_->setSegmentRemovedCallback([this](const SegmentInfo& info) { onSegmentRemoved(info); });
+        recorder_->setSegmentsRemovedCallback([this](const std::vector<SegmentInfo>& removed) { onSegmentsRemoved(removed); });
         recorder_->setRollingBufferEnabled(rolling_enabled_);
     }
 }
@@ -56,6 +72,15 @@ void ReplayBuffer::applyOptions(const Options& options) {
     }
 }
 
+SessionRecovery::Report ReplayBuffer::recover_sessions() {
+    std::unique_lock lock(mutex_);
+    const Options options = options_;
+    lock.unlock();
+    SessionRecovery recovery([this](int64_t sessionId) { return buildSessionDirectory(static_cast<int>(sessionId)); },
+                             options.segment_prefix, options.segment_extension);
+    return recovery.run();
+}
+
 bool ReplayBuffer::start_session(const std::string& game) {
     if (running_) return true;
     std::scoped_lock lock(mutex_);
@@ -79,27 +104,85 @@ bool ReplayBuffer::start_session(const std::string& game) {
         recorder_->beginSession(current_session_id_, session_directory_);
     }
     Logger::instance().info("ReplayBuffer: session started: " + game + " (#" + std::to_string(current_session_id_) + ")");
+    EventBus::instance().publish("session_started", {{"session_id", current_session_id_}, {"game", game}});
     return true;
 }
 
 void ReplayBuffer::stop_session() {
-    int sessionId = -1;
-    std::vector<SegmentInfo> segments;
-    std::filesystem::path sessionDir;
-    std::string game;
-    bool rollingAtStop = true;
+    FinalizeJob job;
     {
         std::scoped_lock lock(mutex_);
         if (!running_) return;
         running_ = false;
-        sessionId = current_session_id_;
-        segments = session_segments_;
-        sessionDir = session_directory_;
-        game = current_game_;
-        rollingAtStop = rolling_enabled_;
+        job.session_id = current_session_id_;
+        job.segments.assign(std::make_move_iterator(session_segments_.begin()),
+                            std::make_move_iterator(session_segments_.end()));
+        job.session_directory = session_directory_;
+        job.game = current_game_;
+        job.rolling = rolling_enabled_;
+        job.stopped_at = now_ms();
+
+        session_segments_.clear();
+        current_session_id_ = -1;
+        session_directory_.clear();
+        current_game_.clear();
     }
 
-    const int64_t stopped_at = now_ms();
+    EventBus::instance().publish("session_stopped", {{"session_id", job.session_id},
+                                                     {"game", job.game},
+                                                     {"segments", job.segments.size()}});
+
+    {
+        std::scoped_lock lock(finalize_mutex_);
+        finalize_jobs_.push_back(std::move(job));
+        if (!finalize_thread_.joinable()) {
+            finalize_thread_ = std::thread(&ReplayBuffer::finalizeLoop, this);
+        }
+    }
+    finalize_cv_.notify_all();
+}
+
+void ReplayBuffer::finalizeLoop() {
+    std::unique_lock lock(finalize_mutex_);
+    for (;;) {
+        finalize_cv_.wait(lock, [this] { return finalize_stop_ || !finalize_jobs_.empty(); });
+        if (finalize_jobs_.empty()) {
+            return; // stopping with nothing left
+        }
+        FinalizeJob job = std::move(finalize_jobs_.front());
+        finalize_jobs_.pop_front();
+        finalize_busy_ = true;
+        lock.unlock();
+
+        finalizeSession(job);
+
+        lock.lock();
+        finalize_busy_ = false;
+        finalize_cv_.notify_all();
+    }
+}
+
+void ReplayBuffer::waitForFinalize() {
+    std::unique_lock lock(finalize_mutex_);
+    finalize_cv_.wait(lock, [this] { return finalize_jobs_.empty() && !finalize_busy_; });
+}
+
+ReplayBuffer::MergeStatus ReplayBuffer::mergeStatus() const {
+    MergeStatus status;
+    std::scoped_lock lock(finalize_mutex_);
+    status.pending = finalize_jobs_.size();
+    status.session_id = merging_session_.load();
+    status.active = status.session_id >= 0;
+    status.progress = status.active ? merge_progress_.load() : 0.0;
+    return status;
+}
+
+void ReplayBuffer::finalizeSession(const FinalizeJob& job) {
+    const int sessionId = job.session_id;
+    const auto& segments = job.segments;
+    const auto& sessionDir = job.session_directory;
+    const bool rollingAtStop = job.rolling;
+    const int64_t stopped_at = job.stopped_at;
 
     std::vector<SegmentInfo> validSegments;
     validSegments.reserve(segments.size());
@@ -121,9 +204,29 @@ void ReplayBuffer::stop_session() {
     std::filesystem::path outputPath;
     bool merged = false;
     if (shouldMerge && sessionId >= 0) {
-        outputPath = buildOutputPath(game);
-        BufferMerger merger(options_.temp_directory);
+        {
+            std::scoped_lock lock(mutex_);
+            outputPath = buildOutputPath(job.game);
+        }
+        BufferMerger merger;
+        int lastDecile = -1;
+        merger.setProgressCallback([&](const RemuxProgress& progress) {
+            merge_progress_ = progress.fraction();
+            const int decile = static_cast<int>(progress.fraction() * 10.0);
+            if (decile != lastDecile) {
+                lastDecile = decile;
+                Logger::instance().debug(std::format("ReplayBuffer: merging session {}: {}% ({}/{} segments)",
+                                                     sessionId, decile * 10, progress.segment_index, progress.segment_count));
+                EventBus::instance().publish("merge_progress", {{"session_id", sessionId},
+                                                                {"percent", decile * 10},
+                                                                {"segment", progress.segment_index},
+                                                                {"segments", progress.segment_count}});
+            }
+        });
+        merge_progress_ = 0.0;
+        merging_session_ = sessionId;
         merged = merger.merge(sessionId, validSegments, outputPath);
+        merging_session_ = -1;
         if (merged) {
             Logger::instance().info(std::format("ReplayBuffer: merged session {} into {}", sessionId, outputPath.string()));
         } else {
@@ -134,6 +237,8 @@ void ReplayBuffer::stop_session() {
         Logger::instance().warn(std::format("ReplayBuffer: no segments recorded for session {}", sessionId));
     }
 
+    // Chunk rows of this session must be on disk before it is marked done.
+    db_writer_.flush();
     if (sessionId >= 0) {
         auto finalizeRes = DB::instance().finalizeSession(sessionId, stopped_at, merged ? outputPath.string() : std::string{});
         if (!finalizeRes) {
@@ -150,14 +255,16 @@ void ReplayBuffer::stop_session() {
     {
         std::scoped_lock lock(mutex_);
         last_output_path_ = merged ? outputPath : std::filesystem::path{};
-        session_segments_.clear();
-        current_session_id_ = -1;
-        session_directory_.clear();
-        current_game_.clear();
+    }
+    if (sessionId >= 0) {
+        EventBus::instance().publish("session_finalized", {{"session_id", sessionId},
+                                                           {"merged", merged},
+                                                           {"output", merged ? outputPath.string() : std::string{}}});
     }
 }
 
 bool ReplayBuffer::export_last_clip(const std::filesystem::path& path) {
+    waitForFinalize();
     std::scoped_lock lock(mutex_);
     if (last_output_path_.empty()) {
         Logger::instance().warn("ReplayBuffer: no clip available to export");
@@ -178,6 +285,68 @@ bool ReplayBuffer::export_last_clip(const std::string& path) {
     return export_last_clip(std::filesystem::path(path));
 }
 
+bool ReplayBuffer::save_replay(const std::filesystem::path& path, int seconds) {
+    Recorder* recorder = nullptr;
+    {
+        std::scoped_lock lock(mutex_);
+        recorder = recorder_;
+    }
+    if (!recorder || !recorder->usingMemoryBuffer()) {
+        Logger::instance().warn("ReplayBuffer: memory replay buffer is not active");
+        return false;
+    }
+    auto saved = recorder->saveReplay(path, std::chrono::seconds(std::max(0, seconds)));
+    if (!saved) {
+        return false;
+    }
+    std::scoped_lock lock(mutex_);
+    last_output_path_ = saved->path;
+    return true;
+}
+
+std::optional<ReplayBuffer::ClipTicket> ReplayBuffer::clip_that(int64_t pre_ms, int64_t post_ms,
+                                                                const std::filesystem::path& output) {
+    std::scoped_lock lock(mutex_);
+    if (!running_ || current_session_id_ < 0) {
+        Logger::instance().warn("ReplayBuffer: clip requested without an active session");
+        return std::nullopt;
+    }
+
+    const int64_t now = clipClockNowMs();
+    ClipRequest request;
+    request.session_id = current_session_id_;
+    request.from_ms = now - std::max<int64_t>(0, pre_ms);
+    request.to_ms = now + std::max<int64_t>(0, post_ms);
+    request.output = output.empty() ? buildOutputPath(current_game_ + " clip") : output;
+    if (recorder_ && recorder_->usingMemoryBuffer()) {
+        Recorder* recorder = recorder_;
+        request.from_memory = [recorder](const std::filesystem::path& path, std::chrono::milliseconds window) {
+            return recorder->saveReplay(path, window).has_value();
+        };
+    }
+
+    ClipTicket ticket;
+    ticket.path = request.output;
+    ticket.from_ms = request.from_ms;
+    ticket.to_ms = request.to_ms;
+    ticket.id = clips_.submit(std::move(request));
+    Logger::instance().info(std::format("ReplayBuffer: clip #{} queued ({} ms before, {} ms after) -> {}",
+                                        ticket.id, pre_ms, post_ms, ticket.path.string()));
+    return ticket;
+}
+
+std::optional<ClipStatus> ReplayBuffer::clip_status(uint64_t id) const {
+    return clips_.status(id);
+}
+
+std::optional<RecorderOutputStats> ReplayBuffer::output_stats() const {
+    std::scoped_lock lock(mutex_);
+    if (!recorder_ || !running_) {
+        return std::nullopt;
+    }
+    return recorder_->outputStats();
+}
+
 bool ReplayBuffer::is_running() const { return running_.load(); }
 
 void ReplayBuffer::setRollingBufferEnabled(bool enabled) {
@@ -193,49 +362,82 @@ void ReplayBuffer::setRollingBufferEnabled(bool enabled) {
 void ReplayBuffer::onSegmentClosed(SegmentInfo& info) {
     std::scoped_lock lock(mutex_);
     if (current_session_id_ < 0) return;
-    std::optional<int64_t> keyframe = info.keyframe_ms > 0 ? std::optional<int64_t>(info.keyframe_ms) : std::nullopt;
-    auto chunkRes = DB::instance().insertChunk(current_session_id_, info.path.string(), info.start_ms, info.end_ms, keyframe);
-    if (!chunkRes) {
-        info.chunk_id = -1;
-        Logger::instance().warn(std::format("ReplayBuffer: failed to record chunk {}: {}", info.path.string(), chunkRes.error()));
-    } else {
-        info.chunk_id = chunkRes.value();
+    // Runs on a recorder thread: hand the row to the writer instead of
+    // waiting for SQLite.
+    DbWriter::ChunkWrite chunk;
+    chunk.session_id = current_session_id_;
+    chunk.path = info.path.string();
+    chunk.start_ms = info.start_ms;
+    chunk.end_ms = info.end_ms;
+    chunk.keyframe_ms = info.keyframe_ms > 0 ? std::optional<int64_t>(info.keyframe_ms) : std::nullopt;
+    chunk.keyframes.reserve(info.keyframes.size());
+    for (const auto& entry : info.keyframes) {
+        chunk.keyframes.push_back(KeyframeRecord{entry.pts_ms, entry.byte_offset});
     }
+    info.chunk_ticket = db_writer_.insertChunk(std::move(chunk));
     session_segments_.push_back(info);
+    if (EventBus::instance().hasSubscribers()) {
+        EventBus::instance().publish("segment_closed", {{"session_id", current_session_id_},
+                                                        {"path", info.path.string()},
+                                                        {"start_ms", info.start_ms},
+                                                        {"end_ms", info.end_ms},
+                                                        {"bytes", info.size_bytes}});
+    }
 }
 
-void ReplayBuffer::onSegmentRemoved(const SegmentInfo& info) {
+void ReplayBuffer::onSegmentsRemoved(const std::vector<SegmentInfo>& removed) {
+    std::vector<DbWriter::Ticket> tickets;
+    tickets.reserve(removed.size());
     std::scoped_lock lock(mutex_);
-    auto it = std::find_if(session_segments_.begin(), session_segments_.end(),
-                           [&](const SegmentInfo& seg) { return seg.path == info.path; });
-    if (it != session_segments_.end()) {
-        if (it->chunk_id >= 0) {
-            if (auto res = DB::instance().removeChunk(it->chunk_id); !res) {
-                Logger::instance().warn(std::format("ReplayBuffer: failed to remove chunk {}: {}", it->chunk_id, res.error()));
+    const bool publish = EventBus::instance().hasSubscribers();
+    for (const auto& info : removed) {
+        // Pruning takes the oldest segments, so the match is at the front.
+        auto it = session_segments_.begin();
+        if (it == session_segments_.end() || it->path != info.path) {
+            it = std::find_if(session_segments_.begin(), session_segments_.end(),
+                              [&](const SegmentInfo& seg) { return seg.path == info.path; });
+            if (it == session_segments_.end()) {
+                continue;
             }
         }
-        session_segments_.erase(it);
+        tickets.push_back(it->chunk_ticket);
+        if (it == session_segments_.begin()) {
+            session_segments_.pop_front();
+        } else {
+            session_segments_.erase(it);
+        }
+        if (publish) {
+            EventBus::instance().publish("segment_removed", {{"session_id", current_session_id_},
+                                                             {"path", info.path.string()}});
+        }
     }
+    db_writer_.removeChunks(tickets);
 }
 
 void ReplayBuffer::cleanupChunks(const std::vector<SegmentInfo>& segments,
                                  const std::filesystem::path& directory,
                                  bool deleteFiles) {
+    std::vector<DbWriter::Ticket> tickets;
+    tickets.reserve(segments.size());
+    for (const auto& seg : segments) {
+        tickets.push_back(seg.chunk_ticket);
+    }
+    db_writer_.removeChunks(tickets);
+    bool pinned = false;
     for (const auto& seg : segments) {
-        if (seg.chunk_id >= 0) {
-            if (auto res = DB::instance().removeChunk(seg.chunk_id); !res) {
-                Logger::instance().warn(std::format("ReplayBuffer: failed to remove chunk {}: {}", seg.chunk_id, res.error()));
-            }
-        }
         if (deleteFiles) {
             std::error_code ec;
-            std::filesystem::remove(seg.path, ec);
+            if (!SegmentPins::instance().remove(seg.path, ec) && !ec) {
+                pinned = true; // a clip export still reads it
+            }
             if (ec) {
                 Logger::instance().warn(std::format("ReplayBuffer: failed to remove {}: {}", seg.path.string(), ec.message()));
             }
         }
     }
-    if (deleteFiles && !directory.empty()) {
+    if (pinned) {
+        Logger::instance().info(std::format("ReplayBuffer: keeping {} until its clip exports finish", directory.string()));
+    } else if (deleteFiles && !directory.empty()) {
         std::error_code ec;
         std::filesystem::remove_all(directory, ec);
         if (ec) {
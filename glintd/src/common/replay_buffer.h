@@ -1,13 +1,19 @@
 ﻿#pragma once
 
 #include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <filesystem>
 #include <mutex>
 #include <optional>
 #include <string>
+#include <thread>
 #include <vector>
 
+#include "clip_exporter.h"
+#include "db_writer.h"
 #include "recorder.h"
+#include "session_recovery.h"
 
 class ReplayBuffer {
 public:
@@ -23,22 +29,62 @@ public:
         std::string segment_extension{".mkv"};
     };
 
+    struct MergeStatus {
+        bool active{false};
+        int session_id{-1};
+        double progress{0.0};
+        std::size_t pending{0};
+    };
+
     explicit ReplayBuffer(Options options = Options{});
+    ~ReplayBuffer();
 
     void attachRecorder(Recorder* recorder);
     void applyOptions(const Options& options);
+    // Indexes what sessions interrupted by a crash left in segment_root and
+    // marks them stopped. Call before the first session starts.
+    SessionRecovery::Report recover_sessions();
 
     bool start_session(const std::string& game);
+    // Returns immediately; merging, DB finalisation and cleanup run on a
+    // background worker. export_last_clip() waits for that work.
     void stop_session();
     bool export_last_clip(const std::filesystem::path& path);
     bool export_last_clip(const std::string& path);
+    // Writes the in-memory replay window (last |seconds|, all when 0) to |path|.
+    bool save_replay(const std::filesystem::path& path, int seconds = 0);
+
+    struct ClipTicket {
+        uint64_t id{0};
+        std::filesystem::path path;
+        int64_t from_ms{0};
+        int64_t to_ms{0};
+    };
+    // Queues [now - pre, now + post] of the running session for export.
+    std::optional<ClipTicket> clip_that(int64_t pre_ms, int64_t post_ms, const std::filesystem::path& output = {});
+    std::optional<ClipStatus> clip_status(uint64_t id) const;
+    // Muxer output of the running session; nullopt when idle.
+    std::optional<RecorderOutputStats> output_stats() const;
     bool is_running() const;
 
     void setRollingBufferEnabled(bool enabled);
+    MergeStatus mergeStatus() const;
+    void waitForFinalize();
 
 private:
+    struct FinalizeJob {
+        int session_id{-1};
+        std::vector<SegmentInfo> segments;
+        std::filesystem::path session_directory;
+        std::string game;
+        bool rolling{true};
+        int64_t stopped_at{0};
+    };
+
+    void finalizeLoop();
+    void finalizeSession(const FinalizeJob& job);
     void onSegmentClosed(SegmentInfo& info);
-    void onSegmentRemoved(const SegmentInfo& info);
+    void onSegmentsRemoved(const std::vector<SegmentInfo>& removed);
     void cleanupChunks(const std::vector<SegmentInfo>& segments, const std::filesystem::path& directory, bool deleteFiles);
     std::filesystem::path buildSessionDirectory(int sessionId) const;
     std::filesystem::path buildOutputPath(const std::string& game) const;
@@ -51,6 +97,18 @@ private:
     int current_session_id_{-1};
     std::filesystem::path session_directory_{};
     std::filesystem::path last_output_path_{};
-    std::vector<SegmentInfo> session_segments_{};
+    std::deque<SegmentInfo> session_segments_{}; // oldest first
     mutable std::mutex mutex_;
+
+    std::deque<FinalizeJob> finalize_jobs_;
+    std::thread finalize_thread_;
+    mutable std::mutex finalize_mutex_;
+    std::condition_variable finalize_cv_;
+    bool finalize_busy_{false};
+    bool finalize_stop_{false};
+    std::atomic<int> merging_session_{-1};
+    std::atomic<double> merge_progress_{0.0};
+
+    ClipExporter clips_;
+    DbWriter db_writer_;
 };
\ No newline at end of file
@@ -0,0 +1,68 @@
+﻿#include "segment_pins.h"
+
+#include <format>
+
+#include "logger.h"
+
+SegmentPins::Pin& SegmentPins::Pin::operator=(Pin&& other) noexcept {
+    if (this != &other) {
+        reset();
+        paths_ = std::move(other.paths_);
+        other.paths_.clear();
+    }
+    return *this;
+}
+
+void SegmentPins::Pin::reset() {
+    if (!paths_.empty()) {
+        SegmentPins::instance().release(paths_);
+        paths_.clear();
+    }
+}
+
+SegmentPins& SegmentPins::instance() {
+    static SegmentPins pins;
+    return pins;
+}
+
+SegmentPins::Pin SegmentPins::pin(const std::vector<std::filesystem::path>& paths) {
+    std::vector<std::string> keys;
+    keys.reserve(paths.size());
+    std::scoped_lock lock(mutex_);
+    for (const auto& path : paths) {
+        keys.push_back(path.string());
+        ++pins_[keys.back()].refs;
+    }
+    return Pin(std::move(keys));
+}
+
+// The file is removed under mutex_ so that a pin taken right after the check
+// cannot find it gone afterwards.
+bool SegmentPins::remove(const std::filesystem::path& path, std::error_code& ec) {
+    ec.clear();
+    std::scoped_lock lock(mutex_);
+    if (auto it = pins_.find(path.string()); it != pins_.end()) {
+        it->second.doomed = true;
+        return false;
+    }
+    std::filesystem::remove(path, ec);
+    return !ec;
+}
+
+void SegmentPins::release(const std::vector<std::string>& paths) {
+    std::scoped_lock lock(mutex_);
+    for (const auto& key : paths) {
+        auto it = pins_.find(key);
+        if (it == pins_.end() || --it->second.refs > 0) {
+            continue;
+        }
+        if (it->second.doomed) {
+            std::error_code ec;
+            std::filesystem::remove(key, ec);
+            if (ec) {
+                Logger::instance().warn(std::format("SegmentPins: failed to remove {}: {}", key, ec.message()));
+            }
+        }
+        pins_.erase(it);
+    }
+}
@@ -0,0 +1,53 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+// Segment files an export is still reading. Whoever prunes segments removes
+// them through here, and a pinned file is only deleted once its last pin is
+// released.
+class SegmentPins {
+public:
+    // Holds its files pinned until destroyed.
+    class Pin {
+    public:
+        Pin() = default;
+        Pin(Pin&& other) noexcept : paths_(std::move(other.paths_)) { other.paths_.clear(); }
+        Pin& operator=(Pin&& other) noexcept;
+        ~Pin() { reset(); }
+
+        Pin(const Pin&) = delete;
+        Pin& operator=(const Pin&) = delete;
+
+        void reset();
+
+    private:
+        friend class SegmentPins;
+        explicit Pin(std::vector<std::string> paths) : paths_(std::move(paths)) {}
+
+        std::vector<std::string> paths_;
+    };
+
+    static SegmentPins& instance();
+
+    [[nodiscard]] Pin pin(const std::vector<std::filesystem::path>& paths);
+    // Deletes |path| now and returns true, or returns false when it is pinned
+    // (it goes once unpinned) or deleting failed (|ec| is set).
+    bool remove(const std::filesystem::path& path, std::error_code& ec);
+
+private:
+    struct Entry {
+        uint32_t refs{0};
+        bool doomed{false}; // removal was asked for while pinned
+    };
+
+    void release(const std::vector<std::string>& paths);
+
+    std::mutex mutex_;
+    std::unordered_map<std::string, Entry> pins_;
+};
@@ -0,0 +1,269 @@
+﻿#include "session_recovery.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <format>
+#include <map>
+#include <optional>
+#include <system_error>
+#include <thread>
+
+#include "clip_exporter.h"
+#include "ff/concat_remuxer.h"
+#include "logger.h"
+
+namespace {
+// Repairs are written here, inside the session directory, so a crash
+// mid-repair leaves nothing the segment scan would take for a segment.
+constexpr const char* kRepairDirectory = ".repair";
+
+int64_t wallClockMs(std::filesystem::file_time_type time) {
+    using namespace std::chrono;
+    // file_clock has no portable conversion in C++20 toolchains yet.
+    const auto sys = system_clock::now() + duration_cast<system_clock::duration>(
+        time - std::filesystem::file_time_type::clock::now());
+    return duration_cast<milliseconds>(sys.time_since_epoch()).count();
+}
+
+int64_t wallClockNowMs() {
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+}
+
+// Chunk times are on the capture clock (see clipClockNowMs); a wall-clock
+// time maps onto it by its distance from now.
+int64_t captureClockMs(int64_t wallMs) {
+    return clipClockNowMs() - (wallClockNowMs() - wallMs);
+}
+}
+
+SessionRecovery::SessionRecovery(SessionDirectory directory, std::string segmentPrefix,
+                                 std::string segmentExtension, unsigned threads)
+    : directory_(std::move(directory)),
+      prefix_(std::move(segmentPrefix)),
+      extension_(std::move(segmentExtension)),
+      threads_(threads ? threads : std::max(1u, std::thread::hardware_concurrency())) {}
+
+SessionRecovery::Report SessionRecovery::run() {
+    const auto started = std::chrono::steady_clock::now();
+    Report report;
+
+    std::vector<SessionScan> sessions;
+    for (auto& record : DB::instance().unfinishedSessions()) {
+        SessionScan scan;
+        scan.session = std::move(record);
+        sessions.push_back(std::move(scan));
+    }
+    if (sessions.empty()) {
+        return report;
+    }
+    report.sessions = sessions.size();
+
+    parallelFor(sessions.size(), [&](std::size_t i) { scan(sessions[i]); });
+
+    // Rows that survived the crash are trusted as written; only files the
+    // index never heard of need to be read.
+    std::vector<Orphan*> orphans;
+    for (auto& session : sessions) {
+        for (auto& orphan : session.orphans) {
+            orphans.push_back(&orphan);
+        }
+    }
+    parallelFor(orphans.size(), [&](std::size_t i) { probe(*orphans[i]); });
+
+    for (auto& session : sessions) {
+        reconcile(session, report);
+    }
+
+    report.elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - started).count();
+    Logger::instance().info(std::format(
+        "SessionRecovery: {} session(s), {} segment(s) kept, {} recovered ({} repaired), {} discarded, "
+        "{} stale row(s) removed in {} ms",
+        report.sessions, report.segments, report.recovered, report.repaired, report.discarded,
+        report.rows_removed, report.elapsed_ms));
+    return report;
+}
+
+void SessionRecovery::scan(SessionScan& session) const {
+    session.rows = DB::instance().chunksForSession(static_cast<int>(session.session.id));
+
+    std::error_code ec;
+    const auto dir = directory_(session.session.id);
+    for (std::filesystem::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+        const auto name = it->path().filename().string();
+        if (!it->is_regular_file(ec) || !name.starts_with(prefix_) || !name.ends_with(extension_)) {
+            continue;
+        }
+        session.files.push_back(it->path());
+        if (auto written = it->last_write_time(ec); !ec) {
+            session.last_write_ms = std::max(session.last_write_ms, wallClockMs(written));
+        }
+    }
+    std::sort(session.files.begin(), session.files.end());
+
+    std::map<std::string, const ChunkRecord*> byName;
+    for (const auto& row : session.rows) {
+        byName.emplace(std::filesystem::path(row.path).filename().string(), &row);
+    }
+    for (const auto& file : session.files) {
+        if (byName.erase(file.filename().string()) == 0) {
+            session.orphans.push_back(Orphan{file});
+        }
+    }
+    for (const auto& [name, row] : byName) {
+        session.missing.push_back(*row);
+    }
+}
+
+void SessionRecovery::probe(Orphan& orphan) const {
+    std::error_code ec;
+    if (auto written = std::filesystem::last_write_time(orphan.path, ec); !ec) {
+        orphan.last_write_ms = wallClockMs(written);
+    }
+    if (std::filesystem::file_size(orphan.path, ec) == 0 || ec) {
+        // Opened for the next rotation but never written to.
+        orphan.probe = glint::unexpected(std::string("empty file"));
+        return;
+    }
+    orphan.probe = probeSegment(orphan.path);
+    if (!orphan.probe || orphan.probe.value().finalized) {
+        return;
+    }
+
+    // No trailer: seeking and duration are unreliable, so rewrite the
+    // packets that did make it to disk into a properly closed file.
+    const auto repairDir = orphan.path.parent_path() / kRepairDirectory;
+    std::filesystem::create_directories(repairDir, ec);
+    const auto repaired = repairDir / orphan.path.filename();
+    ConcatRemuxer remuxer;
+    if (!remuxer.remux(std::vector<std::filesystem::path>{orphan.path}, repaired)) {
+        Logger::instance().warn(std::format("SessionRecovery: keeping unfinalised {}: {}",
+                                            orphan.path.string(), remuxer.lastError()));
+        return;
+    }
+    std::filesystem::rename(repaired, orphan.path, ec);
+    if (ec) {
+        std::filesystem::remove(repaired, ec);
+        return;
+    }
+    orphan.repaired = true;
+    if (auto reprobed = probeSegment(orphan.path)) {
+        // The remux does not carry the start tag over.
+        reprobed.value().start_ms = orphan.probe.value().start_ms;
+        orphan.probe = std::move(reprobed);
+    }
+}
+
+void SessionRecovery::reconcile(SessionScan& session, Report& report) const {
+    auto& db = DB::instance();
+    const int sessionId = static_cast<int>(session.session.id);
+
+    auto tx = db.transaction();
+    if (!tx) {
+        Logger::instance().error(std::format("SessionRecovery: session {}: {}", sessionId, tx.error()));
+        return;
+    }
+
+    for (const auto& row : session.missing) {
+        if (db.removeChunk(row.id)) {
+            ++report.rows_removed;
+        }
+    }
+
+    // Recovered chunks are placed on the capture clock by the start time the
+    // muxer tagged them with. Untagged ones continue from the chunk before
+    // them (segments are contiguous), or failing that end at their mtime.
+    std::map<std::string, const ChunkRecord*> rows;
+    for (const auto& row : session.rows) {
+        rows.emplace(std::filesystem::path(row.path).filename().string(), &row);
+    }
+    std::size_t nextOrphan = 0;
+    std::optional<int64_t> timelineMs;
+    for (const auto& file : session.files) {
+        if (auto it = rows.find(file.filename().string()); it != rows.end()) {
+            timelineMs = it->second->end_ms;
+            ++report.segments;
+            continue;
+        }
+        Orphan& orphan = session.orphans[nextOrphan++];
+        std::error_code ec;
+        if (!orphan.probe) {
+            Logger::instance().warn(std::format("SessionRecovery: discarding {}: {}",
+                                                orphan.path.string(), orphan.probe.error()));
+            std::filesystem::remove(orphan.path, ec);
+            ++report.discarded;
+            continue;
+        }
+
+        const SegmentProbe& probe = orphan.probe.value();
+        int64_t startMs = 0;
+        if (probe.start_ms) {
+            startMs = *probe.start_ms;
+        } else if (timelineMs) {
+            startMs = *timelineMs;
+        } else {
+            const int64_t endMs = orphan.last_write_ms > 0 ? captureClockMs(orphan.last_write_ms) : clipClockNowMs();
+            startMs = endMs - probe.duration_ms;
+        }
+        std::vector<KeyframeRecord> keyframes;
+        keyframes.reserve(probe.keyframes.size());
+        for (const auto& entry : probe.keyframes) {
+            keyframes.push_back(KeyframeRecord{startMs + entry.pts_ms, entry.byte_offset});
+        }
+        const std::optional<int64_t> keyframeMs = keyframes.empty()
+            ? std::nullopt
+            : std::optional<int64_t>(keyframes.back().pts_ms);
+        auto chunkId = db.insertChunk(sessionId, orphan.path.string(), startMs,
+                                      startMs + probe.duration_ms, keyframeMs);
+        if (!chunkId) {
+            Logger::instance().error(std::format("SessionRecovery: {}", chunkId.error()));
+            continue;
+        }
+        if (auto rc = db.insertKeyframes(chunkId.value(), keyframes); !rc) {
+            Logger::instance().warn(std::format("SessionRecovery: {}", rc.error()));
+        }
+        timelineMs = startMs + probe.duration_ms;
+        ++report.segments;
+        ++report.recovered;
+        if (orphan.repaired) {
+            ++report.repaired;
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::remove_all(directory_(session.session.id) / kRepairDirectory, ec);
+
+    const int64_t stoppedAt = session.last_write_ms > 0 ? session.last_write_ms : wallClockNowMs();
+    if (auto rc = db.finalizeSession(sessionId, stoppedAt, ""); !rc) {
+        Logger::instance().error(std::format("SessionRecovery: session {}: {}", sessionId, rc.error()));
+        return;
+    }
+    if (auto rc = tx.value().commit(); !rc) {
+        Logger::instance().error(std::format("SessionRecovery: session {}: {}", sessionId, rc.error()));
+    }
+}
+
+void SessionRecovery::parallelFor(std::size_t count, const std::function<void(std::size_t)>& fn) const {
+    const std::size_t workers = std::min<std::size_t>(threads_, count);
+    if (workers <= 1) {
+        for (std::size_t i = 0; i < count; ++i) {
+            fn(i);
+        }
+        return;
+    }
+    std::atomic<std::size_t> next{0};
+    std::vector<std::thread> pool;
+    pool.reserve(workers);
+    for (std::size_t w = 0; w < workers; ++w) {
+        pool.emplace_back([&] {
+            for (std::size_t i = next.fetch_add(1); i < count; i = next.fetch_add(1)) {
+                fn(i);
+            }
+        });
+    }
+    for (auto& thread : pool) {
+        thread.join();
+    }
+}
@@ -0,0 +1,61 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "db.h"
+#include "ff/segment_probe.h"
+
+// Startup pass over sessions that were never stopped because the daemon
+// died mid-recording. Brings their chunk rows back in line with the segment
+// files left on disk and marks the sessions stopped, so the footage stays
+// exportable after a restart.
+class SessionRecovery {
+public:
+    using SessionDirectory = std::function<std::filesystem::path(int64_t sessionId)>;
+
+    struct Report {
+        std::size_t sessions{0};
+        std::size_t segments{0};     // files indexed once recovery is done
+        std::size_t recovered{0};    // files that had no chunk row
+        std::size_t repaired{0};     // unfinalised files rewritten with a trailer
+        std::size_t discarded{0};    // empty or unreadable files removed
+        std::size_t rows_removed{0}; // chunk rows whose file was gone
+        int64_t elapsed_ms{0};
+    };
+
+    SessionRecovery(SessionDirectory directory, std::string segmentPrefix, std::string segmentExtension,
+                    unsigned threads = 0);
+
+    Report run();
+
+private:
+    struct Orphan {
+        std::filesystem::path path;
+        glint::Expected<SegmentProbe, std::string> probe{glint::unexpected(std::string("not probed"))};
+        bool repaired{false};
+        int64_t last_write_ms{0}; // wall clock, before any repair rewrote it
+    };
+
+    struct SessionScan {
+        SessionRecord session;
+        std::vector<ChunkRecord> rows;
+        std::vector<std::filesystem::path> files; // sorted, i.e. in recording order
+        std::vector<ChunkRecord> missing;         // rows without a file
+        std::vector<Orphan> orphans;              // files without a row
+        int64_t last_write_ms{0};
+    };
+
+    void scan(SessionScan& session) const;
+    void probe(Orphan& orphan) const;
+    void reconcile(SessionScan& session, Report& report) const;
+    void parallelFor(std::size_t count, const std::function<void(std::size_t)>& fn) const;
+
+    SessionDirectory directory_;
+    std::string prefix_;
+    std::string extension_;
+    unsigned threads_{0};
+};
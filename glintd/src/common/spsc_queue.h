@@ -0,0 +1,192 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <utility>
+
+// Bounded lock-free ring for exactly one producer thread and one consumer
+// thread. Capacity is rounded up to a power of two.
+template <typename T>
+class SpscQueue {
+public:
+    explicit SpscQueue(std::size_t capacity)
+        : capacity_(std::bit_ceil(std::max<std::size_t>(capacity, 2))),
+          mask_(capacity_ - 1),
+          slots_(std::make_unique<std::optional<T>[]>(capacity_)) {}
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    // Producer side. Leaves |value| untouched when the queue is full.
+    [[nodiscard]] bool tryPush(T&& value) {
+        const std::size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_cache_ == capacity_) {
+            head_cache_ = head_.load(std::memory_order_acquire);
+            if (tail - head_cache_ == capacity_) {
+                return false;
+            }
+        }
+        slots_[tail & mask_].emplace(std::move(value));
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side.
+    [[nodiscard]] bool tryPop(T& out) {
+        const std::size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_cache_) {
+            tail_cache_ = tail_.load(std::memory_order_acquire);
+            if (head == tail_cache_) {
+                return false;
+            }
+        }
+        auto& slot = slots_[head & mask_];
+        out = std::move(*slot);
+        slot.reset();
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Approximate when called concurrently with push/pop.
+    [[nodiscard]] std::size_t size() const noexcept {
+        return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+    }
+    [[nodiscard]] std::size_t capacity() const noexcept { return capacity_; }
+
+private:
+    static constexpr std::size_t kCacheLine = 64;
+
+    const std::size_t capacity_;
+    const std::size_t mask_;
+    std::unique_ptr<std::optional<T>[]> slots_;
+
+    alignas(kCacheLine) std::atomic<std::size_t> head_{0};
+    std::size_t tail_cache_{0}; // consumer's last view of tail_
+    alignas(kCacheLine) std::atomic<std::size_t> tail_{0};
+    std::size_t head_cache_{0}; // producer's last view of head_
+};
+
+// Bounded ring for one producer and one consumer where the producer may also
+// evict the oldest entry to make room, so a full queue keeps the newest ones.
+// Both ends can take from the head, so every slot carries a sequence number
+// (as in Vyukov's bounded queue) and the head is claimed with a CAS.
+template <typename T>
+class EvictingQueue {
+public:
+    explicit EvictingQueue(std::size_t capacity)
+        : capacity_(std::bit_ceil(std::max<std::size_t>(capacity, 2))),
+          mask_(capacity_ - 1),
+          cells_(std::make_unique<Cell[]>(capacity_)) {
+        for (std::size_t i = 0; i < capacity_; ++i) {
+            cells_[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    EvictingQueue(const EvictingQueue&) = delete;
+    EvictingQueue& operator=(const EvictingQueue&) = delete;
+
+    // Producer side. Leaves |value| untouched when the queue is full.
+    [[nodiscard]] bool tryPush(T&& value) {
+        const std::size_t tail = tail_.load(std::memory_order_relaxed);
+        Cell& cell = cells_[tail & mask_];
+        if (cell.seq.load(std::memory_order_acquire) != tail) {
+            return false;
+        }
+        cell.value.emplace(std::move(value));
+        cell.seq.store(tail + 1, std::memory_order_release);
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Producer side. Always enqueues |value|; when the queue is full the
+    // oldest entry is moved to |evicted| first and true is returned.
+    bool pushEvicting(T&& value, T& evicted) {
+        bool evictedAny = false;
+        while (!tryPush(std::move(value))) {
+            // Full, so the head is the slot this push needs.
+            const std::size_t head = tail_.load(std::memory_order_relaxed) - capacity_;
+            Cell& cell = cells_[head & mask_];
+            std::size_t expected = head;
+            if (cell.seq.load(std::memory_order_acquire) == head + 1 &&
+                head_.compare_exchange_strong(expected, head + 1, std::memory_order_relaxed)) {
+                evicted = std::move(*cell.value);
+                cell.value.reset();
+                cell.seq.store(head + capacity_, std::memory_order_release);
+                evictedAny = true;
+            } else {
+                // The consumer claimed it first; the slot frees up once its
+                // move is done.
+                std::this_thread::yield();
+            }
+        }
+        return evictedAny;
+    }
+
+    // Consumer side.
+    [[nodiscard]] bool tryPop(T& out) {
+        std::size_t head = head_.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells_[head & mask_];
+            const std::size_t seq = cell.seq.load(std::memory_order_acquire);
+            if (seq == head) {
+                return false; // empty
+            }
+            if (seq != head + 1) {
+                head = head_.load(std::memory_order_relaxed); // evicted meanwhile
+                continue;
+            }
+            if (head_.compare_exchange_weak(head, head + 1, std::memory_order_relaxed)) {
+                out = std::move(*cell.value);
+                cell.value.reset();
+                cell.seq.store(head + capacity_, std::memory_order_release);
+                return true;
+            }
+        }
+    }
+
+    // Approximate when called concurrently with push/pop.
+    [[nodiscard]] std::size_t size() const noexcept {
+        const std::size_t head = head_.load(std::memory_order_acquire);
+        const std::size_t tail = tail_.load(std::memory_order_acquire);
+        return tail > head ? tail - head : 0;
+    }
+    [[nodiscard]] std::size_t capacity() const noexcept { return capacity_; }
+
+private:
+    static constexpr std::size_t kCacheLine = 64;
+
+    struct Cell {
+        std::atomic<std::size_t> seq{0};
+        std::optional<T> value;
+    };
+
+    const std::size_t capacity_;
+    const std::size_t mask_;
+    std::unique_ptr<Cell[]> cells_;
+
+    alignas(kCacheLine) std::atomic<std::size_t> head_{0};
+    alignas(kCacheLine) std::atomic<std::size_t> tail_{0};
+};
+
+// Futex-style wake-up for queue consumers. A consumer reads current() before
+// polling its queues and, if they were empty, waits for the value to change.
+class WakeSignal {
+public:
+    [[nodiscard]] uint32_t current() const noexcept { return seq_.load(std::memory_order_acquire); }
+
+    void notify() noexcept {
+        seq_.fetch_add(1, std::memory_order_release);
+        seq_.notify_one();
+    }
+
+    void wait(uint32_t seen) const noexcept { seq_.wait(seen, std::memory_order_acquire); }
+
+private:
+    std::atomic<uint32_t> seq_{0};
+};
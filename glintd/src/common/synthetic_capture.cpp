@@ -0,0 +1,162 @@
+﻿#include "synthetic_capture.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <format>
+#include <numbers>
+#include <thread>
+
+#include "logger.h"
+
+namespace {
+constexpr int kScrollPixelsPerFrame = 8;
+constexpr int kAudioChunkMs = 10;
+constexpr float kToneAmplitude = 0.25f;
+}
+
+SyntheticVideoCapture::SyntheticVideoCapture(SyntheticVideoOptions options, std::shared_ptr<CaptureTimeline> timeline)
+    : options_(options), timeline_(std::move(timeline)) {
+    options_.width = std::max(16, options_.width);
+    options_.height = std::max(16, options_.height);
+    options_.fps = std::max(1, options_.fps);
+    options_.motion = std::clamp(options_.motion, 0.0, 1.0);
+    options_.pool_size = std::max(2, options_.pool_size);
+}
+
+SyntheticVideoCapture::~SyntheticVideoCapture() {
+    stop();
+}
+
+bool SyntheticVideoCapture::start(VideoCallback cb) {
+    if (running_) return true;
+    if (texture_.empty()) {
+        buildTexture();
+    }
+    if (!pool_) {
+        pool_ = FramePool::create(static_cast<size_t>(options_.width) * 4 * options_.height,
+                                  static_cast<size_t>(options_.pool_size));
+    }
+    Logger::instance().info(std::format("SyntheticVideoCapture: {}x{}@{} motion={:.2f} ({})",
+                                        options_.width, options_.height, options_.fps, options_.motion,
+                                        timeline_->realtime() ? "real time" : "unthrottled"));
+    timeline_->restart();
+    running_ = true;
+    worker_ = std::thread([this, cb] { captureLoop(cb); });
+    return true;
+}
+
+void SyntheticVideoCapture::stop() {
+    if (!running_) return;
+    running_ = false;
+    timeline_->stop();
+    if (worker_.joinable()) worker_.join();
+}
+
+void SyntheticVideoCapture::buildTexture() {
+    // Vertical colour bars (R, G, B) with per-pixel noise, so the encoder
+    // sees detail rather than flat areas it can skip.
+    static constexpr uint8_t kBars[8][3] = {{235, 235, 235}, {235, 235, 16}, {16, 235, 235}, {16, 235, 16},
+                                            {235, 16, 235}, {235, 16, 16}, {16, 16, 235}, {16, 16, 16}};
+    const int textureWidth = options_.width * 2;
+    texture_.resize(static_cast<size_t>(textureWidth) * 4 * options_.height);
+    uint32_t seed = 0x9e3779b9u;
+    for (int y = 0; y < options_.height; ++y) {
+        uint8_t* row = texture_.data() + static_cast<size_t>(y) * textureWidth * 4;
+        for (int x = 0; x < textureWidth; ++x) {
+            const auto& bar = kBars[(x % options_.width) * 8 / options_.width];
+            seed = seed * 1664525u + 1013904223u;
+            const int noise = static_cast<int>(seed >> 27) - 16;
+            for (int c = 0; c < 3; ++c) {
+                row[x * 4 + 2 - c] = static_cast<uint8_t>(std::clamp(bar[c] + noise, 0, 255));
+            }
+            row[x * 4 + 3] = 255;
+        }
+    }
+}
+
+void SyntheticVideoCapture::captureLoop(const VideoCallback& cb) {
+    const int textureStride = options_.width * 8;
+    const int rowBytes = options_.width * 4;
+    const int movingRows = static_cast<int>(std::lround(options_.motion * options_.height));
+    for (uint64_t index = 0; running_; ) {
+        FrameBuffer buffer = pool_->acquire();
+        if (!buffer) {
+            // Downstream still holds every frame. Real time drops the tick like
+            // screen capture does; unthrottled waits for a buffer instead.
+            if (timeline_->realtime()) {
+                ++index;
+                timeline_->pace(static_cast<int64_t>(index * 1000 / options_.fps));
+            } else {
+                std::this_thread::yield();
+            }
+            continue;
+        }
+
+        const int offset = static_cast<int>((index * kScrollPixelsPerFrame) % static_cast<uint64_t>(options_.width));
+        VideoFrame frame;
+        frame.width = options_.width;
+        frame.height = options_.height;
+        frame.stride = rowBytes;
+        frame.format = PixelFormat::BGRA;
+        frame.buffer = std::move(buffer);
+        for (int y = 0; y < options_.height; ++y) {
+            const uint8_t* src = texture_.data() + static_cast<size_t>(y) * textureStride +
+                                 (y < movingRows ? offset * 4 : 0);
+            std::memcpy(frame.data() + static_cast<size_t>(y) * rowBytes, src, rowBytes);
+        }
+
+        const auto offsetMs = static_cast<int64_t>(index * 1000 / options_.fps);
+        timeline_->pace(offsetMs);
+        frame.pts_ms = timeline_->ptsAt(offsetMs);
+        cb(frame);
+        ++index;
+    }
+}
+
+SyntheticAudioCapture::SyntheticAudioCapture(bool isMic, int sampleRate, int channels, double frequencyHz,
+                                             std::shared_ptr<CaptureTimeline> timeline)
+    : is_mic_(isMic),
+      sample_rate_(std::max(8000, sampleRate)),
+      channels_(std::max(1, channels)),
+      frequency_hz_(frequencyHz),
+      timeline_(std::move(timeline)) {}
+
+SyntheticAudioCapture::~SyntheticAudioCapture() {
+    stop();
+}
+
+bool SyntheticAudioCapture::start(AudioCallback cb) {
+    if (running_) return true;
+    running_ = true;
+    worker_ = std::thread([this, cb] { captureLoop(cb); });
+    return true;
+}
+
+void SyntheticAudioCapture::stop() {
+    if (!running_) return;
+    running_ = false;
+    if (worker_.joinable()) worker_.join();
+}
+
+void SyntheticAudioCapture::captureLoop(const AudioCallback& cb) {
+    const int chunk = sample_rate_ * kAudioChunkMs / 1000;
+    const double step = 2.0 * std::numbers::pi * frequency_hz_ / sample_rate_;
+    AudioFrame frame;
+    frame.sample_rate = sample_rate_;
+    frame.channels = channels_;
+    frame.samples = chunk;
+    frame.interleaved.resize(static_cast<size_t>(chunk) * channels_);
+    for (uint64_t sent = 0; running_; sent += static_cast<uint64_t>(chunk)) {
+        const auto offsetMs = static_cast<int64_t>(sent * 1000 / static_cast<uint64_t>(sample_rate_));
+        if (!timeline_->follow(offsetMs, running_)) {
+            break;
+        }
+        for (int i = 0; i < chunk; ++i) {
+            const auto sample = static_cast<float>(kToneAmplitude * std::sin(step * static_cast<double>(sent + i)));
+            std::fill_n(frame.interleaved.begin() + static_cast<std::ptrdiff_t>(i) * channels_, channels_, sample);
+        }
+        frame.pts_ms = timeline_->ptsAt(offsetMs);
+        cb(frame, is_mic_);
+    }
+}
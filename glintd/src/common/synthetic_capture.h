@@ -0,0 +1,63 @@
+﻿#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "capture_base.h"
+#include "capture_timeline.h"
+
+struct SyntheticVideoOptions {
+    int width{1920};
+    int height{1080};
+    int fps{60};
+    // Share of the picture (0..1) that scrolls every frame; the rest is a
+    // static pattern. Drives how hard the frames are to encode.
+    double motion{0.25};
+    int pool_size{8};
+};
+
+// Colour bars over a noise texture, as BGRA frames.
+class SyntheticVideoCapture : public IVideoCapture {
+public:
+    SyntheticVideoCapture(SyntheticVideoOptions options, std::shared_ptr<CaptureTimeline> timeline);
+    ~SyntheticVideoCapture() override;
+
+    bool start(VideoCallback cb) override;
+    void stop() override;
+
+private:
+    void buildTexture();
+    void captureLoop(const VideoCallback& cb);
+
+    SyntheticVideoOptions options_;
+    std::shared_ptr<CaptureTimeline> timeline_;
+    std::shared_ptr<FramePool> pool_;
+    std::vector<uint8_t> texture_; // two frames wide, rows scroll through it
+    std::atomic<bool> running_{false};
+    std::thread worker_;
+};
+
+// A sine tone in 10 ms chunks.
+class SyntheticAudioCapture : public IAudioCapture {
+public:
+    SyntheticAudioCapture(bool isMic, int sampleRate, int channels, double frequencyHz,
+                          std::shared_ptr<CaptureTimeline> timeline);
+    ~SyntheticAudioCapture() override;
+
+    bool start(AudioCallback cb) override;
+    void stop() override;
+
+private:
+    void captureLoop(const AudioCallback& cb);
+
+    bool is_mic_{false};
+    int sample_rate_{48000};
+    int channels_{2};
+    double frequency_hz_{440.0};
+    std::shared_ptr<CaptureTimeline> timeline_;
+    std::atomic<bool> running_{false};
+    std::thread worker_;
+};
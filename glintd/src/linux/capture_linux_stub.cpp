@@ -1,5 +1,6 @@
 ﻿#include "../common/capture_base.h"
 #include "../common/logger.h"
+#include "../common/metrics.h"
 #include "../common/ff/encoder_ffmpeg.h"
 #include "../common/ff/muxer_avformat.h"
 #include "../common/ff/audio_capture_ffmpeg.h"
@@ -7,6 +8,11 @@
 
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+#include <X11/extensions/Xdamage.h>
+#include <X11/extensions/Xfixes.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
 #include <pulse/simple.h>
 #include <pulse/error.h>
 
@@ -15,14 +21,18 @@
 #include <chrono>
 #include <cctype>
 #include <cstring>
+#include <format>
 #include <memory>
 #include <thread>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 namespace {
 class X11VideoCapture : public IVideoCapture {
 public:
-    explicit X11VideoCapture(int fps) : fps_(fps) {}
+    X11VideoCapture(int fps, bool useSharedMemory, bool useDamage, int poolSize)
+        : fps_(fps), use_shm_(useSharedMemory), use_damage_(useDamage), pool_size_(std::max(2, poolSize)) {}
     ~X11VideoCapture() override { stop(); }
 
     bool start(VideoCallback cb) override {
@@ -37,6 +47,20 @@ public:
         XGetWindowAttributes(display_, root_, &attrs);
         width_ = attrs.width;
         height_ = attrs.height;
+        if (use_damage_ && !initDamage()) {
+            Logger::instance().warn("X11VideoCapture: XDamage unavailable, grabbing every frame in full");
+        }
+        if (use_shm_ && !initSharedMemory()) {
+            Logger::instance().warn("X11VideoCapture: MIT-SHM unavailable, falling back to XGetImage");
+        }
+        if (!shm_attached_ && !initImagePool()) {
+            Logger::instance().error("X11VideoCapture: unsupported visual, need 32 bits per pixel");
+            releaseDamage();
+            XCloseDisplay(display_);
+            display_ = nullptr;
+            return false;
+        }
+        stats_ = CaptureStats{};
         running_ = true;
         worker_ = std::thread([this, cb] { captureLoop(cb); });
         return true;
@@ -46,6 +70,10 @@ public:
         if (!running_) return;
         running_ = false;
         if (worker_.joinable()) worker_.join();
+        releaseDamage();
+        releaseImages();
+        releaseSharedMemory();
+        pool_.reset();
         if (display_) {
             XCloseDisplay(display_);
             display_ = nullptr;
@@ -53,37 +81,368 @@ public:
     }
 
 private:
+    struct CaptureStats {
+        uint64_t frames{0};
+        uint64_t total_us{0};
+        uint64_t min_us{UINT64_MAX};
+        uint64_t max_us{0};
+        uint64_t pool_exhausted{0};
+        uint64_t partial{0};
+        uint64_t repeated{0};
+    };
+
+    enum class GrabKind {
+        Full,
+        Partial, // damaged rectangles over a copy of the previous frame
+        Repeat   // nothing changed, the previous frame goes out again
+    };
+
+    static constexpr uint64_t kStatsReportInterval = 600;
+    // Past either limit one full readback is cheaper than the pieces.
+    static constexpr std::size_t kMaxDamageRects = 64;
+    static constexpr double kMaxPartialShare = 0.5;
+    // Full grabs keep coming on static content, so anything XDamage failed to
+    // report is on screen within this long.
+    static constexpr auto kFullGrabInterval = std::chrono::seconds(2);
+
+    static int onShmAttachError(Display*, XErrorEvent*) {
+        shm_attach_failed_ = true;
+        return 0;
+    }
+
+    // The X server's own byte order is passed on as is; only 32-bit pixels
+    // with 8-bit channels are supported.
+    bool describeImage(const XImage* image) {
+        if (image->bits_per_pixel != 32) {
+            return false;
+        }
+        const bool lsb = image->byte_order == LSBFirst;
+        if (image->red_mask == (lsb ? 0xff0000ul : 0xff00ul) && image->blue_mask == (lsb ? 0xfful : 0xff000000ul)) {
+            format_ = PixelFormat::BGRX;
+        } else if (image->red_mask == (lsb ? 0xfful : 0xff000000ul) && image->blue_mask == (lsb ? 0xff0000ul : 0xff00ul)) {
+            format_ = PixelFormat::RGBX;
+        } else {
+            return false;
+        }
+        stride_ = image->bytes_per_line;
+        return true;
+    }
+
+    // Pooled frames live in one shared memory segment and the server writes
+    // each grab straight into one of them.
+    bool initSharedMemory() {
+        if (!XShmQueryExtension(display_)) {
+            return false;
+        }
+
+        const int screen = DefaultScreen(display_);
+        XImage* probe = XShmCreateImage(display_, DefaultVisual(display_, screen), DefaultDepth(display_, screen),
+                                        ZPixmap, nullptr, &shm_info_, width_, height_);
+        if (!probe) {
+            return false;
+        }
+        const bool supported = describeImage(probe);
+        XDestroyImage(probe);
+        if (!supported) {
+            return false;
+        }
+
+        // Damage mode reads rectangles through one extra, unpooled frame.
+        const size_t frameBytes = static_cast<size_t>(stride_) * height_;
+        const size_t frames = static_cast<size_t>(pool_size_) + (damage_ ? 1 : 0);
+        shm_info_.shmid = shmget(IPC_PRIVATE, frameBytes * frames, IPC_CREAT | 0600);
+        if (shm_info_.shmid < 0) {
+            return false;
+        }
+
+        shm_info_.shmaddr = static_cast<char*>(shmat(shm_info_.shmid, nullptr, 0));
+        if (shm_info_.shmaddr == reinterpret_cast<char*>(-1)) {
+            shmctl(shm_info_.shmid, IPC_RMID, nullptr);
+            return false;
+        }
+        shm_info_.readOnly = False;
+
+        // XShmAttach reports failure asynchronously (e.g. BadAccess on a remote display),
+        // so trap errors until the server has processed the request.
+        shm_attach_failed_ = false;
+        auto* previous = XSetErrorHandler(&X11VideoCapture::onShmAttachError);
+        const Bool attached = XShmAttach(display_, &shm_info_);
+        XSync(display_, False);
+        XSetErrorHandler(previous);
+
+        // The segment stays alive until both sides detach.
+        shmctl(shm_info_.shmid, IPC_RMID, nullptr);
+
+        if (!attached || shm_attach_failed_) {
+            shmdt(shm_info_.shmaddr);
+            return false;
+        }
+
+        // Frames still queued downstream keep the mapping alive past stop().
+        char* segment = shm_info_.shmaddr;
+        pool_ = FramePool::adopt(reinterpret_cast<uint8_t*>(segment), frameBytes, static_cast<size_t>(pool_size_),
+                                 [segment] { shmdt(segment); });
+        shm_scratch_ = damage_ ? reinterpret_cast<uint8_t*>(segment) + frameBytes * pool_size_ : nullptr;
+        shm_attached_ = true;
+        Logger::instance().info(std::format("X11VideoCapture: using MIT-SHM capture ({}x{})", width_, height_));
+        return true;
+    }
+
+    // XGetSubImage into image headers over ordinary pooled buffers.
+    bool initImagePool() {
+        const int screen = DefaultScreen(display_);
+        XImage* probe = XCreateImage(display_, DefaultVisual(display_, screen), DefaultDepth(display_, screen),
+                                     ZPixmap, 0, nullptr, width_, height_, 32, 0);
+        if (!probe) {
+            return false;
+        }
+        const bool supported = describeImage(probe);
+        XDestroyImage(probe);
+        if (!supported) {
+            return false;
+        }
+        pool_ = FramePool::create(static_cast<size_t>(stride_) * height_, static_cast<size_t>(pool_size_));
+        return true;
+    }
+
+    void releaseSharedMemory() {
+        if (!shm_attached_) return;
+        if (display_) {
+            XShmDetach(display_, &shm_info_);
+            XSync(display_, False);
+        }
+        shm_attached_ = false;
+        shm_scratch_ = nullptr;
+    }
+
+    bool initDamage() {
+        int eventBase = 0;
+        int errorBase = 0;
+        int damageMajor = 1;
+        int damageMinor = 1;
+        int fixesMajor = 2; // regions
+        int fixesMinor = 0;
+        if (!XDamageQueryExtension(display_, &eventBase, &errorBase) ||
+            !XDamageQueryVersion(display_, &damageMajor, &damageMinor) ||
+            !XFixesQueryExtension(display_, &eventBase, &errorBase) ||
+            !XFixesQueryVersion(display_, &fixesMajor, &fixesMinor) || fixesMajor < 2) {
+            return false;
+        }
+        // NonEmpty sends one event per tick at most; the region itself is
+        // fetched on each tick.
+        damage_ = XDamageCreate(display_, root_, XDamageReportNonEmpty);
+        damage_region_ = XFixesCreateRegion(display_, nullptr, 0);
+        full_grab_pending_ = true;
+        Logger::instance().info("X11VideoCapture: using XDamage, unchanged frames skip the readback");
+        return true;
+    }
+
+    void releaseDamage() {
+        last_frame_.reset();
+        damage_rects_.clear();
+        if (!display_) return;
+        if (damage_region_) XFixesDestroyRegion(display_, damage_region_);
+        if (damage_) XDamageDestroy(display_, damage_);
+        damage_region_ = 0;
+        damage_ = 0;
+    }
+
+    // Moves everything damaged since the last tick into damage_rects_.
+    void fetchDamage() {
+        // Only the region matters; drop the notify events so they don't pile up.
+        while (XPending(display_) > 0) {
+            XEvent event;
+            XNextEvent(display_, &event);
+        }
+        XDamageSubtract(display_, damage_, None, damage_region_);
+        int count = 0;
+        XRectangle* rects = XFixesFetchRegion(display_, damage_region_, &count);
+        damage_rects_.assign(rects, rects ? rects + count : rects);
+        if (rects) XFree(rects);
+    }
+
+    GrabKind nextGrabKind(std::chrono::steady_clock::time_point now) {
+        fetchDamage();
+        if (full_grab_pending_ || !last_frame_ || now >= next_full_grab_) {
+            return GrabKind::Full;
+        }
+        if (damage_rects_.empty()) {
+            return GrabKind::Repeat;
+        }
+        if (damage_rects_.size() > kMaxDamageRects) {
+            return GrabKind::Full;
+        }
+        // Region rectangles never overlap.
+        uint64_t damaged = 0;
+        for (const XRectangle& rect : damage_rects_) {
+            damaged += static_cast<uint64_t>(rect.width) * rect.height;
+        }
+        const auto screen = static_cast<double>(width_) * height_;
+        return static_cast<double>(damaged) > screen * kMaxPartialShare ? GrabKind::Full : GrabKind::Partial;
+    }
+
+    // The headers never own their pixels; the pool does.
+    void releaseImages() {
+        for (auto& [data, image] : images_) {
+            image->data = nullptr;
+            XDestroyImage(image);
+        }
+        images_.clear();
+    }
+
+    XImage* imageFor(uint8_t* data) {
+        if (auto it = images_.find(data); it != images_.end()) {
+            return it->second;
+        }
+        const int screen = DefaultScreen(display_);
+        Visual* visual = DefaultVisual(display_, screen);
+        const auto depth = static_cast<unsigned>(DefaultDepth(display_, screen));
+        XImage* image = shm_attached_
+            ? XShmCreateImage(display_, visual, depth, ZPixmap, reinterpret_cast<char*>(data), &shm_info_, width_, height_)
+            : XCreateImage(display_, visual, depth, ZPixmap, 0, reinterpret_cast<char*>(data), width_, height_, 32,
+                           stride_);
+        if (image) {
+            images_.emplace(data, image);
+        }
+        return image;
+    }
+
+    bool grabInto(XImage* image) {
+        if (shm_attached_) {
+            if (XShmGetImage(display_, root_, image, 0, 0, AllPlanes)) {
+                return true;
+            }
+            Logger::instance().warn("X11VideoCapture: XShmGetImage failed, falling back to XGetImage");
+            // Frames already handed on keep the old pool; new ones come from a plain one.
+            releaseImages();
+            releaseSharedMemory();
+            if (!initImagePool()) {
+                running_ = false;
+            }
+            return false;
+        }
+        return XGetSubImage(display_, root_, 0, 0, width_, height_, AllPlanes, ZPixmap, image, 0, 0) != nullptr;
+    }
+
+    // Starts from the previous frame and reads back only the damaged rectangles.
+    bool grabDamaged(uint8_t* pixels, XImage* image) {
+        std::memcpy(pixels, last_frame_.data(), static_cast<size_t>(stride_) * height_);
+        const int screen = DefaultScreen(display_);
+        for (const XRectangle& rect : damage_rects_) {
+            const int x0 = std::max(0, static_cast<int>(rect.x));
+            const int y0 = std::max(0, static_cast<int>(rect.y));
+            const int w = std::min(width_, rect.x + rect.width) - x0;
+            const int h = std::min(height_, rect.y + rect.height) - y0;
+            if (w <= 0 || h <= 0) continue;
+            if (!shm_attached_) {
+                if (!XGetSubImage(display_, root_, x0, y0, w, h, AllPlanes, ZPixmap, image, x0, y0)) {
+                    return false;
+                }
+                continue;
+            }
+            // XShmGetImage fills a whole image with its own row pitch, so the
+            // rectangle lands in the scratch frame and is copied over from there.
+            XImage* part = XShmCreateImage(display_, DefaultVisual(display_, screen), DefaultDepth(display_, screen),
+                                           ZPixmap, reinterpret_cast<char*>(shm_scratch_), &shm_info_, w, h);
+            const bool grabbed = part && XShmGetImage(display_, root_, part, x0, y0, AllPlanes);
+            if (grabbed) {
+                for (int row = 0; row < h; ++row) {
+                    std::memcpy(pixels + static_cast<size_t>(y0 + row) * stride_ + static_cast<size_t>(x0) * 4,
+                                part->data + static_cast<size_t>(row) * part->bytes_per_line,
+                                static_cast<size_t>(w) * 4);
+                }
+            }
+            if (part) {
+                part->data = nullptr;
+                XDestroyImage(part);
+            }
+            if (!grabbed) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void recordGrabTime(uint64_t micros) {
+        grab_metric_.record(micros);
+        frames_metric_.add();
+        ++stats_.frames;
+        stats_.total_us += micros;
+        stats_.min_us = std::min(stats_.min_us, micros);
+        stats_.max_us = std::max(stats_.max_us, micros);
+        if (stats_.frames >= kStatsReportInterval) {
+            if (Logger::instance().enabled(LogLevel::Debug)) {
+                const auto pool = pool_->stats();
+                Logger::instance().debug(std::format(
+                    "X11VideoCapture: grab ({}) avg={}us min={}us max={}us over {} frames ({} partial), {} repeated, pool {}/{} peak, {} dropped (exhausted)",
+                    shm_attached_ ? "shm" : "xgetimage", stats_.total_us / stats_.frames,
+                    stats_.min_us, stats_.max_us, stats_.frames, stats_.partial, stats_.repeated,
+                    pool.peak_in_use, pool.capacity, stats_.pool_exhausted));
+            }
+            stats_ = CaptureStats{};
+        }
+    }
+
+    void deliver(const VideoCallback& cb, FrameBuffer buffer) {
+        VideoFrame frame;
+        frame.width = width_;
+        frame.height = height_;
+        frame.stride = stride_;
+        frame.format = format_;
+        frame.buffer = std::move(buffer);
+        frame.pts_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                           std::chrono::steady_clock::now().time_since_epoch()).count();
+        cb(frame);
+    }
+
     void captureLoop(const VideoCallback& cb) {
         using namespace std::chrono;
         auto frame_interval = milliseconds(1000 / std::max(1, fps_));
         auto next_time = steady_clock::now();
         while (running_) {
-            auto* image = XGetImage(display_, root_, 0, 0, width_, height_, AllPlanes, ZPixmap);
-            if (!image) {
-                Logger::instance().warn("X11VideoCapture: XGetImage failed");
+            const auto grab_start = steady_clock::now();
+            const GrabKind kind = damage_ ? nextGrabKind(grab_start) : GrabKind::Full;
+            if (kind == GrabKind::Repeat) {
+                // The same buffer again lets the encoder skip the conversion too.
+                ++stats_.repeated;
+                repeated_metric_.add();
+                deliver(cb, last_frame_);
+                next_time += frame_interval;
+                std::this_thread::sleep_until(next_time);
+                continue;
+            }
+            FrameBuffer buffer = pool_->acquire();
+            if (!buffer) {
+                // Every pooled frame is still queued downstream; skip this tick instead of allocating.
+                ++stats_.pool_exhausted;
+                exhausted_metric_.add();
+                full_grab_pending_ = true; // this tick's damage is gone
+                next_time += frame_interval;
+                std::this_thread::sleep_until(next_time);
+                continue;
+            }
+            XImage* image = imageFor(buffer.data());
+            const bool grabbed = image && (kind == GrabKind::Partial ? grabDamaged(buffer.data(), image)
+                                                                     : grabInto(image));
+            if (!grabbed) {
+                Logger::instance().warn("X11VideoCapture: screen grab failed");
+                failures_metric_.add();
+                full_grab_pending_ = true;
                 std::this_thread::sleep_for(frame_interval);
                 continue;
             }
-            VideoFrame frame;
-            frame.width = width_;
-            frame.height = height_;
-            frame.stride = width_ * 4;
-            frame.data.resize(static_cast<size_t>(frame.stride) * frame.height);
-            const uint8_t* src = reinterpret_cast<const uint8_t*>(image->data);
-            for (int y = 0; y < height_; ++y) {
-                const uint8_t* row = src + y * image->bytes_per_line;
-                uint8_t* dst = frame.data.data() + static_cast<size_t>(y) * frame.stride;
-                for (int x = 0; x < width_; ++x) {
-                    const uint8_t* pixel = row + x * 4;
-                    dst[x * 4 + 0] = pixel[2];
-                    dst[x * 4 + 1] = pixel[1];
-                    dst[x * 4 + 2] = pixel[0];
-                    dst[x * 4 + 3] = 255;
-                }
+            recordGrabTime(static_cast<uint64_t>(duration_cast<microseconds>(steady_clock::now() - grab_start).count()));
+            if (kind == GrabKind::Partial) {
+                ++stats_.partial;
+                partial_metric_.add();
+            } else {
+                full_grab_pending_ = false;
+                next_full_grab_ = grab_start + kFullGrabInterval;
             }
-            XDestroyImage(image);
-            frame.pts_ms = duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
-            cb(frame);
+            if (damage_) {
+                last_frame_ = buffer;
+            }
+            deliver(cb, std::move(buffer));
             next_time += frame_interval;
             std::this_thread::sleep_until(next_time);
         }
@@ -94,8 +453,33 @@ private:
     int width_{0};
     int height_{0};
     int fps_{60};
+    bool use_shm_{true};
+    bool use_damage_{true};
+    int pool_size_{8};
+    int stride_{0};
+    PixelFormat format_{PixelFormat::BGRX};
+    std::shared_ptr<FramePool> pool_;
+    std::unordered_map<uint8_t*, XImage*> images_; // one header per pooled buffer, made on first use
+    XShmSegmentInfo shm_info_{};
+    bool shm_attached_{false};
+    uint8_t* shm_scratch_{nullptr}; // damage mode: the extra frame past the pooled ones
+    Damage damage_{0};
+    XserverRegion damage_region_{0};
+    std::vector<XRectangle> damage_rects_;
+    FrameBuffer last_frame_; // damage mode: the latest picture, base of the next partial grab
+    bool full_grab_pending_{true};
+    std::chrono::steady_clock::time_point next_full_grab_{};
+    CaptureStats stats_{};
+    Counter& frames_metric_ = MetricsRegistry::instance().counter("glint_capture_frames_total", "Frames grabbed from the X server");
+    Counter& exhausted_metric_ = MetricsRegistry::instance().counter("glint_capture_pool_exhausted_total", "Capture ticks skipped, every pooled frame in use");
+    Counter& failures_metric_ = MetricsRegistry::instance().counter("glint_capture_failures_total", "Failed screen grabs");
+    Counter& partial_metric_ = MetricsRegistry::instance().counter("glint_capture_partial_grabs_total", "Grabs that read back only damaged rectangles");
+    Counter& repeated_metric_ = MetricsRegistry::instance().counter("glint_capture_repeated_frames_total", "Unchanged frames re-submitted without a readback");
+    Histogram& grab_metric_ = MetricsRegistry::instance().histogram("glint_capture_grab_us", "Screen grab into a pooled frame, microseconds");
     std::atomic<bool> running_{false};
     std::thread worker_;
+
+    static inline std::atomic<bool> shm_attach_failed_{false};
 };
 
 class PulseAudioCapture : public IAudioCapture {
@@ -170,7 +554,8 @@ public:
 
 protected:
     std::unique_ptr<IVideoCapture> createVideoCapture(const CaptureInitOptions& options) override {
-        return std::make_unique<X11VideoCapture>(options.target_fps);
+        return std::make_unique<X11VideoCapture>(options.target_fps, options.use_shared_memory, options.use_damage,
+                                                 options.frame_pool_size);
     }
 
     std::unique_ptr<IAudioCapture> createSystemAudioCapture(const CaptureInitOptions& options) override {
@@ -1,46 +1,79 @@
 ﻿#include "../common/ipc_server_pipe.h"
 #include "../common/logger.h"
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/un.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <cerrno>
+#include <format>
 #include <string>
 #include <cstring>
+#include <unordered_map>
 #include <vector>
 
-static bool readLineFD(int fd, std::string& out) {
-    out.clear();
-    std::string acc;
-    char buf[256];
-    for (;;) {
-        ssize_t n = ::read(fd, buf, sizeof(buf));
-        if (n <= 0) return false;
-        acc.append(buf, buf + n);
-        auto p = acc.find('\n');
-        if (p != std::string::npos) {
-            out.assign(acc.data(), p);
-            return true;
-        }
-    }
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// epoll tags; connections are numbered from kFirstConnection so a late pool
+// response can never land on a reused fd.
+constexpr uint64_t kListenTag = 0;
+constexpr uint64_t kWakeTag = 1;
+constexpr uint64_t kFirstConnection = 2;
+constexpr int kMaxEvents = 64;
+constexpr int kTickMs = 1000;
+// A stream is not drained while this much is still unsent; its own bounded
+// queue then decides what to drop.
+constexpr std::size_t kStreamBacklogBytes = 256 * 1024;
+
+struct Connection {
+    int fd{-1};
+    std::string in;
+    std::string out;
+    bool busy{false};      // a pool job for this client is running
+    bool closing{false};   // close once |out| is flushed
+    bool read_shut{false}; // stream peer is done sending but still reads
+    bool peer_gone{false}; // hung up; buffered requests still run, replies are dropped
+    std::shared_ptr<IpcStream> stream;
+    uint32_t events{0};    // current epoll interest
+    Clock::time_point last_active{};
+};
+
+std::string safeCall(const IpcHandler& handler, const std::string& request) {
+    std::string rsp;
+    try { rsp = handler(request); }
+    catch (...) { rsp = "{\"ok\":false,\"error\":\"exception\"}"; }
+    if (rsp.empty() || rsp.back() != '\n') rsp.push_back('\n');
+    return rsp;
 }
 
-static bool writeLineFD(int fd, const std::string& s) {
-    std::string line = s;
-    line.push_back('\n');
-    const char* data = line.data();
-    size_t left = line.size();
-    while (left) {
-        ssize_t n = ::write(fd, data, left);
-        if (n <= 0) return false;
-        data += n;
-        left -= n;
-    }
-    return true;
+bool setNonBlocking(int fd) {
+    const int flags = ::fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
 }
 
+} // namespace
+
 bool IpcServerPipe::start(IpcHandler handler) {
     if (running_) return true;
+    wake_fd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd_ < 0) {
+        Logger::instance().error("IPC: eventfd() failed");
+        return false;
+    }
     running_ = true;
+    {
+        std::scoped_lock lock(pool_mutex_);
+        pool_stop_ = false;
+        jobs_.clear();
+    }
+    const std::size_t workers = options_.worker_threads > 0 ? options_.worker_threads : 1;
+    for (std::size_t i = 0; i < workers; ++i) {
+        pool_.emplace_back(&IpcServerPipe::poolLoop, this, handler);
+    }
     worker_ = std::thread(&IpcServerPipe::run, this, handler);
     return true;
 }
@@ -48,8 +81,54 @@ bool IpcServerPipe::start(IpcHandler handler) {
 void IpcServerPipe::stop() {
     if (!running_) return;
     running_ = false;
+    wake();
 
     if (worker_.joinable()) worker_.join();
+
+    {
+        std::scoped_lock lock(pool_mutex_);
+        pool_stop_ = true;
+        jobs_.clear();
+    }
+    pool_cv_.notify_all();
+    for (auto& t : pool_) {
+        if (t.joinable()) t.join();
+    }
+    pool_.clear();
+    {
+        std::scoped_lock lock(done_mutex_);
+        done_.clear();
+    }
+    {
+        std::scoped_lock lock(notify_mutex_);
+        notified_.clear();
+    }
+    ::close(wake_fd_);
+    wake_fd_ = -1;
+}
+
+void IpcServerPipe::wake() {
+    const uint64_t one = 1;
+    [[maybe_unused]] const ssize_t n = ::write(wake_fd_, &one, sizeof(one));
+}
+
+void IpcServerPipe::poolLoop(const IpcHandler& handler) {
+    for (;;) {
+        Job job;
+        {
+            std::unique_lock lock(pool_mutex_);
+            pool_cv_.wait(lock, [this] { return pool_stop_ || !jobs_.empty(); });
+            if (pool_stop_) return;
+            job = std::move(jobs_.front());
+            jobs_.pop_front();
+        }
+        std::string rsp = safeCall(handler, job.request);
+        {
+            std::scoped_lock lock(done_mutex_);
+            done_.emplace_back(job.connection, std::move(rsp));
+        }
+        wake();
+    }
 }
 
 void IpcServerPipe::run(IpcHandler handler) {
@@ -58,7 +137,7 @@ void IpcServerPipe::run(IpcHandler handler) {
         ("/run/user/" + std::to_string(getuid()) + "/glintd.sock") : endpoint_;
 
     ::unlink(path.c_str());
-    int sfd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    int sfd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
     if (sfd < 0) { log.error("socket() failed"); return; }
 
     sockaddr_un addr{};
@@ -70,32 +149,288 @@ void IpcServerPipe::run(IpcHandler handler) {
     }
     ::chmod(path.c_str(), 0600);
 
-    if (::listen(sfd, 1) < 0) {
+    if (::listen(sfd, SOMAXCONN) < 0) {
         log.error("listen() failed"); ::close(sfd); return;
     }
+
+    int epfd = ::epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0) {
+        log.error("epoll_create1() failed"); ::close(sfd); return;
+    }
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.u64 = kListenTag;
+    ::epoll_ctl(epfd, EPOLL_CTL_ADD, sfd, &ev);
+    ev.data.u64 = kWakeTag;
+    ::epoll_ctl(epfd, EPOLL_CTL_ADD, wake_fd_, &ev);
     log.info(std::string("IPC: listening on ") + path);
 
+    std::unordered_map<uint64_t, Connection> conns;
+    uint64_t nextId = kFirstConnection;
+
+    auto closeConn = [&](uint64_t id) {
+        auto it = conns.find(id);
+        if (it == conns.end()) return;
+        if (it->second.stream) {
+            it->second.stream->setNotifier(nullptr);
+            it->second.stream->close();
+        }
+        if (!it->second.peer_gone) ::epoll_ctl(epfd, EPOLL_CTL_DEL, it->second.fd, nullptr);
+        ::close(it->second.fd);
+        conns.erase(it);
+        log.info("IPC: client disconnected");
+    };
+
+    // Nothing more can be sent, but a request already handed to the pool
+    // still completes; the connection closes once none is left. The fd
+    // leaves epoll so the hangup does not keep firing meanwhile.
+    // Returns false when the connection was closed.
+    auto dropPeer = [&](uint64_t id, Connection& c) {
+        if (!c.peer_gone) {
+            ::epoll_ctl(epfd, EPOLL_CTL_DEL, c.fd, nullptr);
+            c.peer_gone = true;
+            c.events = 0;
+        }
+        c.out.clear();
+        if (c.busy) return true;
+        closeConn(id);
+        return false;
+    };
+
+    // Returns false when the connection had to be closed.
+    auto flushOut = [&](uint64_t id, Connection& c) {
+        if (c.peer_gone) return dropPeer(id, c);
+        while (!c.out.empty()) {
+            const ssize_t n = ::send(c.fd, c.out.data(), c.out.size(), MSG_NOSIGNAL);
+            if (n > 0) {
+                c.out.erase(0, static_cast<std::size_t>(n));
+                continue;
+            }
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            if (n < 0 && errno == EINTR) continue;
+            return dropPeer(id, c);
+        }
+        if (c.out.empty() && c.closing && !c.busy) {
+            closeConn(id);
+            return false;
+        }
+        // Stop reading once closing, or a half-closed peer keeps firing.
+        const bool reading = !c.closing && !c.read_shut;
+        const uint32_t want = (reading ? static_cast<uint32_t>(EPOLLIN | EPOLLRDHUP) : 0u) |
+                              (c.out.empty() ? 0u : static_cast<uint32_t>(EPOLLOUT));
+        if (want != c.events) {
+            epoll_event mod{};
+            mod.events = want;
+            mod.data.u64 = id;
+            ::epoll_ctl(epfd, EPOLL_CTL_MOD, c.fd, &mod);
+            c.events = want;
+        }
+        return true;
+    };
+
+    // Moves pending stream lines into |out| while the client keeps up.
+    auto pumpStream = [&](uint64_t id, Connection& c) {
+        if (!flushOut(id, c)) return false;
+        if (!c.stream || c.out.size() >= kStreamBacklogBytes) return true;
+        const std::size_t before = c.out.size();
+        c.stream->drain(c.out);
+        return c.out.size() == before || flushOut(id, c);
+    };
+
+    // One request in flight per client keeps its responses in order.
+    auto dispatch = [&](uint64_t id, Connection& c) {
+        while (!c.busy && !c.stream) {
+            const auto p = c.in.find('\n');
+            if (p == std::string::npos) break;
+            std::string req = c.in.substr(0, p);
+            c.in.erase(0, p + 1);
+            if (stream_opener_) {
+                if (auto stream = stream_opener_(req)) {
+                    c.stream = std::move(stream);
+                    c.in.clear();
+                    // A subscriber may shut its write side right after
+                    // asking; it still wants the events.
+                    if (c.closing) {
+                        c.closing = false;
+                        c.read_shut = true;
+                    }
+                    c.stream->setNotifier([this, id] {
+                        {
+                            std::scoped_lock lock(notify_mutex_);
+                            notified_.push_back(id);
+                        }
+                        wake();
+                    });
+                    log.info("IPC: client subscribed to events");
+                    return pumpStream(id, c);
+                }
+            }
+            if (inline_ && inline_(req)) {
+                c.out += safeCall(handler, req);
+                continue;
+            }
+            c.busy = true;
+            {
+                std::scoped_lock lock(pool_mutex_);
+                jobs_.push_back(Job{id, std::move(req)});
+            }
+            pool_cv_.notify_one();
+        }
+        return flushOut(id, c);
+    };
+
+    auto acceptAll = [&] {
+        for (;;) {
+            int cfd = ::accept4(sfd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (cfd < 0) {
+                if (errno == EINTR) continue;
+                return;
+            }
+            if (conns.size() >= options_.max_clients) {
+                static const char kBusy[] = "{\"ok\":false,\"error\":\"too many clients\"}\n";
+                [[maybe_unused]] const ssize_t n = ::send(cfd, kBusy, sizeof(kBusy) - 1, MSG_NOSIGNAL);
+                ::close(cfd);
+                log.warn("IPC: client rejected, connection limit reached");
+                continue;
+            }
+            const uint64_t id = nextId++;
+            Connection c;
+            c.fd = cfd;
+            c.last_active = Clock::now();
+            c.events = EPOLLIN | EPOLLRDHUP;
+            epoll_event cev{};
+            cev.events = c.events;
+            cev.data.u64 = id;
+            if (::epoll_ctl(epfd, EPOLL_CTL_ADD, cfd, &cev) < 0) {
+                ::close(cfd);
+                continue;
+            }
+            conns.emplace(id, std::move(c));
+            log.info("IPC: client connected");
+        }
+    };
+
+    auto readIn = [&](uint64_t id, Connection& c) {
+        char buf[4096];
+        for (;;) {
+            const ssize_t n = ::recv(c.fd, buf, sizeof(buf), 0);
+            if (n > 0) {
+                c.in.append(buf, static_cast<std::size_t>(n));
+                c.last_active = Clock::now();
+                if (!c.stream && c.in.size() > options_.max_request_bytes && c.in.find('\n') == std::string::npos) {
+                    log.warn("IPC: request too large, dropping client");
+                    c.in.clear();
+                    c.out += "{\"ok\":false,\"error\":\"request too large\"}\n";
+                    c.closing = true;
+                    break;
+                }
+                continue;
+            }
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            if (n < 0 && errno == EINTR) continue;
+            // EOF or error: answer what is already buffered, then close.
+            // Streams only stop reading; a full close shows up as EPOLLHUP.
+            if (c.stream) {
+                c.read_shut = true;
+            } else {
+                c.closing = true;
+            }
+            break;
+        }
+        if (c.stream) {
+            c.in.clear();
+            flushOut(id, c);
+            return;
+        }
+        if (!dispatch(id, c)) return;
+        if (c.closing && !c.busy && c.out.empty()) closeConn(id);
+    };
+
+    std::vector<epoll_event> events(kMaxEvents);
+    auto lastSweep = Clock::now();
     while (running_) {
-        int cfd = ::accept(sfd, nullptr, nullptr);
-                if (cfd < 0) {
-            if (!running_) break;
-            continue;
+        const int n = ::epoll_wait(epfd, events.data(), kMaxEvents, kTickMs);
+        if (n < 0 && errno != EINTR) {
+            log.error("epoll_wait() failed");
+            break;
         }
-        log.info("IPC: client connected");
-
-        while (running_) {
-            std::string req;
-            if (!readLineFD(cfd, req)) break;
-            std::string rsp;
-            try { rsp = handler(req); }
-            catch (...) { rsp = "{\"ok\":false,\"error\":\"exception\"}"; }
-            if (!writeLineFD(cfd, rsp)) break;
+        for (int i = 0; i < n; ++i) {
+            const uint64_t tag = events[i].data.u64;
+            if (tag == kListenTag) {
+                acceptAll();
+                continue;
+            }
+            if (tag == kWakeTag) {
+                uint64_t counter = 0;
+                [[maybe_unused]] const ssize_t r = ::read(wake_fd_, &counter, sizeof(counter));
+                std::vector<std::pair<uint64_t, std::string>> done;
+                {
+                    std::scoped_lock lock(done_mutex_);
+                    done.swap(done_);
+                }
+                for (auto& [id, rsp] : done) {
+                    auto it = conns.find(id);
+                    if (it == conns.end()) continue; // client went away meanwhile
+                    Connection& c = it->second;
+                    c.busy = false;
+                    c.out += rsp;
+                    c.last_active = Clock::now();
+                    if (dispatch(id, c) && c.closing && !c.busy && c.out.empty()) closeConn(id);
+                }
+                std::vector<uint64_t> notified;
+                {
+                    std::scoped_lock lock(notify_mutex_);
+                    notified.swap(notified_);
+                }
+                for (const uint64_t id : notified) {
+                    auto it = conns.find(id);
+                    if (it != conns.end() && it->second.stream) pumpStream(id, it->second);
+                }
+                continue;
+            }
+            auto it = conns.find(tag);
+            if (it == conns.end()) continue;
+            Connection& c = it->second;
+            const uint32_t revents = events[i].events;
+            if (revents & EPOLLERR) {
+                closeConn(tag);
+                continue;
+            }
+            if (revents & EPOLLOUT) {
+                if (!pumpStream(tag, c)) continue;
+            }
+            // A client that writes and closes usually hangs up in the same
+            // event as its data arrives; read to EOF and run what it sent.
+            if (revents & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) {
+                readIn(tag, c);
+            }
+            if (revents & EPOLLHUP) {
+                if (auto left = conns.find(tag); left != conns.end()) dropPeer(tag, left->second);
+            }
         }
 
-        ::close(cfd);
-        log.info("IPC: client disconnected");
+        const auto now = Clock::now();
+        if (now - lastSweep >= std::chrono::milliseconds(kTickMs)) {
+            lastSweep = now;
+            std::vector<uint64_t> idle;
+            for (const auto& [id, c] : conns) {
+                if (!c.busy && !c.stream && now - c.last_active > options_.idle_timeout) idle.push_back(id);
+            }
+            for (const uint64_t id : idle) {
+                log.info("IPC: closing idle client");
+                closeConn(id);
+            }
+        }
     }
 
+    for (auto& [id, c] : conns) {
+        if (c.stream) {
+            c.stream->setNotifier(nullptr);
+            c.stream->close();
+        }
+        ::close(c.fd);
+    }
+    ::close(epfd);
     ::close(sfd);
     ::unlink(path.c_str());
     log.info("IPC: server stopped");
@@ -0,0 +1,91 @@
+﻿#include "../common/metrics_endpoint.h"
+#include "../common/logger.h"
+#include "../common/metrics.h"
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <poll.h>
+#include <cerrno>
+#include <cstdio>
+#include <format>
+
+namespace {
+// A scraper that stops reading must not stall the endpoint.
+constexpr timeval kSendTimeout{1, 0};
+}
+
+bool MetricsEndpoint::start() {
+    if (running_) return true;
+
+    ::unlink(path_.c_str());
+    int sfd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sfd < 0) {
+        Logger::instance().error("Metrics: socket() failed");
+        return false;
+    }
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    std::snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path_.c_str());
+    if (::bind(sfd, (sockaddr*)&addr, sizeof(addr)) < 0 || ::listen(sfd, 16) < 0) {
+        Logger::instance().error(std::format("Metrics: cannot listen on {}", path_));
+        ::close(sfd);
+        return false;
+    }
+    ::chmod(path_.c_str(), 0600);
+
+    wake_fd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd_ < 0) {
+        Logger::instance().error("Metrics: eventfd() failed");
+        ::close(sfd);
+        return false;
+    }
+    running_ = true;
+    worker_ = std::thread(&MetricsEndpoint::run, this, sfd);
+    Logger::instance().info(std::format("Metrics: exposition on {}", path_));
+    return true;
+}
+
+void MetricsEndpoint::stop() {
+    if (!running_) return;
+    running_ = false;
+    const uint64_t one = 1;
+    [[maybe_unused]] const ssize_t n = ::write(wake_fd_, &one, sizeof(one));
+    if (worker_.joinable()) worker_.join();
+    ::close(wake_fd_);
+    wake_fd_ = -1;
+}
+
+void MetricsEndpoint::run(int listenFd) {
+    pollfd fds[2]{{listenFd, POLLIN, 0}, {wake_fd_, POLLIN, 0}};
+    while (running_) {
+        const int n = ::poll(fds, 2, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            Logger::instance().error("Metrics: poll() failed");
+            break;
+        }
+        if (fds[1].revents) break;
+        if (!(fds[0].revents & POLLIN)) continue;
+
+        const int cfd = ::accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (cfd < 0) continue;
+        ::setsockopt(cfd, SOL_SOCKET, SO_SNDTIMEO, &kSendTimeout, sizeof(kSendTimeout));
+        const std::string body = MetricsRegistry::instance().exposition();
+        std::size_t sent = 0;
+        while (sent < body.size()) {
+            const ssize_t w = ::send(cfd, body.data() + sent, body.size() - sent, MSG_NOSIGNAL);
+            if (w > 0) {
+                sent += static_cast<std::size_t>(w);
+            } else if (w < 0 && errno == EINTR) {
+                continue;
+            } else {
+                break;
+            }
+        }
+        ::close(cfd);
+    }
+    ::close(listenFd);
+    ::unlink(path_.c_str());
+}
@@ -6,6 +6,7 @@
 #include "common/ipc_server_stdin.h"
 #include "common/detector.h"
 #include "common/ipc_server_pipe.h"
+#include "common/metrics_endpoint.h"
 
 #include <algorithm>
 #include <chrono>
@@ -44,16 +45,19 @@ int main(int argc, char** argv) {
     AppConfig appConfig = load_config(configPath);
 
     std::string socket_path;
+    std::string metrics_socket_path;
     bool force_reset = false;
 
     for (int i = 1; i < argc; ++i) {
         std::string arg = argv[i];
         if (arg == "--socket" && i + 1 < argc)
             socket_path = argv[++i];
+        else if (arg == "--metrics-socket" && i + 1 < argc)
+            metrics_socket_path = argv[++i];
         else if (arg == "--reset")
             force_reset = true;
         else if (arg == "--help" || arg == "-h") {
-            std::cout << "Usage: glintd [--socket <path>] [--reset]\n";
+            std::cout << "Usage: glintd [--socket <path>] [--metrics-socket <path>] [--reset]\n";
             return 0;
         }
     }
@@ -64,8 +68,20 @@ int main(int argc, char** argv) {
 #else
     if (socket_path.empty())
         socket_path = glintd::consts::default_socket_path();
+    if (metrics_socket_path.empty())
+        metrics_socket_path = glintd::consts::default_metrics_socket_path();
 #endif
 
+    auto applyLogSettings = [&](const GeneralSettings& general) {
+        if (auto level = Logger::parseLevel(general.log_level)) {
+            log.setLevel(*level);
+        } else {
+            log.warn("Unknown log_level '" + general.log_level + "', keeping the current level");
+        }
+        log.setRotation(general.log_max_bytes, general.log_max_files);
+    };
+    applyLogSettings(appConfig.general);
+
     if (appConfig.general.file_logging) {
         auto logDir = appConfig.general.log_path.parent_path();
         if (!logDir.empty()) {
@@ -85,6 +101,7 @@ int main(int argc, char** argv) {
     ReplayBuffer replay;
 
     auto applyConfig = [&](const AppConfig& cfg) {
+        applyLogSettings(cfg.general);
         const ProfileConfig& profile = cfg.activeProfile();
         RecorderConfig recorderCfg;
         recorderCfg.width = profile.video.width;
@@ -105,8 +122,26 @@ int main(int argc, char** argv) {
         recorderCfg.segment_extension = profile.buffer.segment_extension;
         recorderCfg.container = profile.buffer.container;
         recorderCfg.rolling_size_limit_bytes = profile.buffer.size_limit_bytes;
-
-        capture->setRecorderConfig(recorderCfg);
+        recorderCfg.rolling_duration = std::chrono::seconds(std::max(0, profile.buffer.retention_seconds));
+        recorderCfg.memory_buffer = profile.buffer.storage == "memory";
+        recorderCfg.memory_buffer_duration = std::chrono::seconds(profile.buffer.memory_seconds);
+        recorderCfg.video_queue_depth = profile.video.frame_queue_depth;
+        recorderCfg.keep_encoder_warm = profile.video.keep_encoder_warm;
+        recorderCfg.frame_drop_policy = profile.video.frame_drop_policy == "drop_oldest"
+                                            ? FrameDropPolicy::DropOldest
+                                            : FrameDropPolicy::DropNewest;
+
+        CaptureInitOptions captureOpts = capture->captureOptions();
+        captureOpts.use_shared_memory = profile.video.use_shared_memory;
+        captureOpts.use_damage = profile.video.use_damage;
+        captureOpts.source = profile.video.source == "synthetic" ? CaptureSource::Synthetic
+                           : profile.video.source == "file"      ? CaptureSource::File
+                                                                 : CaptureSource::Screen;
+        captureOpts.source_file = profile.video.source_file;
+        captureOpts.synthetic_motion = profile.video.synthetic_motion;
+        captureOpts.source_realtime = profile.video.source_realtime;
+        captureOpts.recorder = recorderCfg;
+        capture->setCaptureOptions(captureOpts);
 
         ReplayBuffer::Options bufferOptions;
         bufferOptions.buffer_enabled = profile.buffer.enabled;
@@ -126,6 +161,7 @@ int main(int argc, char** argv) {
     };
 
     applyConfig(appConfig);
+    replay.recover_sessions();
 
     MarkerManager markers;
     Detector detector;
@@ -159,10 +195,16 @@ int main(int argc, char** argv) {
     );
 
     auto handler = [&](const std::string& line) -> std::string {
-        return glintd::rpc::handle_command(line);
+        return glintd::rpc::handle_command(line, glintd::rpc::Context{&replay});
     };
 
+    ipc.setInlinePredicate(glintd::rpc::is_inline_command);
+    ipc.setStreamOpener(glintd::rpc::open_stream);
     ipc.start(handler);
+#ifndef _WIN32
+    MetricsEndpoint metricsEndpoint(metrics_socket_path);
+    metricsEndpoint.start();
+#endif
 
     log.info("Glint Daemon started with PID " + std::to_string(::getpid()));
     log.info("IPC server is running on " + socket_path);
@@ -1,8 +1,14 @@
 ﻿#include "handlers.h"
 #include "common/logger.h"
 #include "common/constants.h"
+#include "common/replay_buffer.h"
+#include "common/event_bus.h"
+#include "common/metrics.h"
 #include <nlohmann/json.hpp>
-#include <fstream>
+#include <algorithm>
+#include <filesystem>
+#include <format>
+#include <vector>
 
 #include "db.h"
 #include "sqlite3.h"
@@ -11,7 +17,102 @@ using nlohmann::json;
 
 namespace glintd::rpc {
 
-    std::string handle_command(const std::string& line) {
+    namespace {
+        const char* clip_state_name(ClipState state) {
+            switch (state) {
+                case ClipState::Pending: return "pending";
+                case ClipState::Done: return "done";
+                case ClipState::Failed: return "failed";
+            }
+            return "unknown";
+        }
+
+        json stats() {
+            const auto snap = MetricsRegistry::instance().snapshot();
+            json counters = json::object();
+            for (const auto& value : snap.counters) counters[value.name] = value.value;
+            json gauges = json::object();
+            for (const auto& value : snap.gauges) gauges[value.name] = value.value;
+            json histograms = json::object();
+            for (const auto& dist : snap.histograms) {
+                const auto& h = dist.histogram;
+                histograms[dist.name] = {
+                    {"count", h.count},
+                    {"avg", h.count ? h.sum / h.count : 0},
+                    {"p50", h.quantile(0.5)},
+                    {"p90", h.quantile(0.9)},
+                    {"p99", h.quantile(0.99)},
+                    {"p999", h.quantile(0.999)},
+                    {"max", h.max}
+                };
+            }
+            return {{"ok", true}, {"counters", counters}, {"gauges", gauges}, {"histograms", histograms}};
+        }
+
+        json clip_that(const json& cmd, const Context& ctx) {
+            if (!ctx.replay) {
+                return {{"ok", false}, {"error", "replay buffer unavailable"}};
+            }
+            // pre/post are seconds around the moment of the request.
+            const double pre = cmd.value("pre", 30.0);
+            const double post = cmd.value("post", 0.0);
+            const std::string out = cmd.value("out", std::string{});
+            auto ticket = ctx.replay->clip_that(static_cast<int64_t>(pre * 1000.0),
+                                                static_cast<int64_t>(post * 1000.0), out);
+            if (!ticket) {
+                return {{"ok", false}, {"error", "no active session"}};
+            }
+            return {
+                {"ok", true},
+                {"job", ticket->id},
+                {"path", ticket->path.string()},
+                {"from_ms", ticket->from_ms},
+                {"to_ms", ticket->to_ms},
+                {"ready_in_ms", static_cast<int64_t>(post * 1000.0)}
+            };
+        }
+    }
+
+    bool is_inline_command(const std::string& line) {
+        const auto cmd = json::parse(line, nullptr, false);
+        if (cmd.is_discarded() || !cmd.is_object()) {
+            return true; // answered with an error right away
+        }
+        const auto it = cmd.find("cmd");
+        const std::string name = it != cmd.end() && it->is_string() ? it->get<std::string>() : std::string{};
+        return name == "status" || name == "version" || name == "clip_status" || name == "stats" ||
+               name == "start" || name == "stop" || name == "marker";
+    }
+
+    std::shared_ptr<IpcStream> open_stream(const std::string& line) {
+        // Cheap reject before parsing every request a second time.
+        if (line.find("subscribe") == std::string::npos) {
+            return nullptr;
+        }
+        const auto cmd = json::parse(line, nullptr, false);
+        if (cmd.is_discarded() || !cmd.is_object() || cmd.value("cmd", json()) != "subscribe") {
+            return nullptr;
+        }
+        std::vector<std::string> types;
+        if (auto it = cmd.find("events"); it != cmd.end() && it->is_array()) {
+            for (const auto& type : *it) {
+                if (type.is_string()) types.push_back(type.get<std::string>());
+            }
+        }
+        std::size_t capacity = EventBus::kDefaultCapacity;
+        if (auto it = cmd.find("queue"); it != cmd.end() && it->is_number_unsigned()) {
+            capacity = std::clamp<std::size_t>(it->get<std::size_t>(), 1, 4096);
+        }
+
+        auto subscription = EventBus::instance().subscribe(types, capacity);
+        const json ack = {{"ok", true}, {"subscribed", types.empty() ? json::array({"*"}) : json(types)},
+                          {"queue", capacity}};
+        subscription->push(ack.dump());
+        Logger::instance().info(std::format("RPC: event subscription ({} types, queue {})", types.size(), capacity));
+        return subscription;
+    }
+
+    std::string handle_command(const std::string& line, const Context& ctx) {
         auto& log = Logger::instance();
 
         try {
@@ -27,6 +128,15 @@ namespace glintd::rpc {
 
             if (name == "status") {
                 resp = {{"ok", true}, {"msg", "daemon alive"}};
+                if (auto output = ctx.replay ? ctx.replay->output_stats() : std::nullopt) {
+                    resp["recording"] = {
+                        {"bytes_written", output->bytes_written},
+                        {"segment_bytes", output->segment_bytes},
+                        {"video_packets", output->video_packets},
+                        {"audio_packets", output->audio_packets},
+                        {"bitrate_kbps", output->bitrate_kbps}
+                    };
+                }
             }
             else if (name == "start") {
                 log.info("Starting recording...");
@@ -42,16 +152,52 @@ namespace glintd::rpc {
                 log.info("Creating marker: pre=" + std::to_string(pre) + " post=" + std::to_string(post));
                 resp = {{"ok", true}, {"msg", "marker created"}, {"pre", pre}, {"post", post}};
             }
+            else if (name == "stats") {
+                resp = stats();
+            }
+            else if (name == "clip_that") {
+                resp = clip_that(cmd, ctx);
+            }
+            else if (name == "clip_status") {
+                const uint64_t job = cmd.value("job", uint64_t{0});
+                auto status = ctx.replay ? ctx.replay->clip_status(job) : std::nullopt;
+                if (!status) {
+                    resp = {{"ok", false}, {"error", "unknown clip job"}};
+                } else {
+                    resp = {
+                        {"ok", status->state != ClipState::Failed},
+                        {"job", job},
+                        {"state", clip_state_name(status->state)},
+                        {"path", status->request.output.string()}
+                    };
+                    if (status->state == ClipState::Done) {
+                        resp["start_ms"] = status->result.start_ms;
+                        resp["end_ms"] = status->result.end_ms;
+                        resp["segments"] = status->result.segments;
+                        resp["elapsed_ms"] = status->result.elapsed_ms;
+                    } else if (status->state == ClipState::Failed) {
+                        resp["error"] = status->error;
+                    }
+                }
+            }
             else if (name == "export") {
                 std::string mode = cmd.value("mode", "last");
                 log.info("Export requested, mode=" + mode);
 
-                // пример: создать фиктивный файл экспорта
-                std::ofstream out("export_" + mode + "_clip.txt");
-                out << "Fake exported clip data";
-                out.close();
-
-                resp = {{"ok", true}, {"msg", "export done"}, {"mode", mode}};
+                if (mode == "clip") {
+                    resp = clip_that(cmd, ctx);
+                } else if (!ctx.replay) {
+                    resp = {{"ok", false}, {"error", "replay buffer unavailable"}};
+                } else {
+                    const std::string out = cmd.value("out", std::string(consts::EXPORT_LAST_CLIP));
+                    const bool ok = ctx.replay->export_last_clip(std::filesystem::path(out));
+                    resp = {{"ok", ok}, {"mode", mode}, {"path", out}};
+                    if (!ok) resp["error"] = "no clip available";
+                }
+            }
+            else if (name == "subscribe") {
+                // Only reached when the transport cannot stream.
+                resp = {{"ok", false}, {"error", "subscribe is not supported on this transport"}};
             }
             else if (name == "version") {
                 resp = {
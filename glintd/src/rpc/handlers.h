@@ -1,6 +1,21 @@
 ﻿#pragma once
+#include <memory>
 #include <string>
 
+#include "common/ipc_server.h"
+
+class ReplayBuffer;
+
 namespace glintd::rpc {
-    std::string handle_command(const std::string& line);
+    struct Context {
+        ReplayBuffer* replay{nullptr};
+    };
+
+    std::string handle_command(const std::string& line, const Context& ctx = {});
+    // Commands that only read in-memory state; the IPC server answers these
+    // on its I/O thread instead of queueing them behind exports.
+    bool is_inline_command(const std::string& line);
+    // {"cmd":"subscribe","events":[...]}: returns the event stream the
+    // connection switches to, nullptr for every other command.
+    std::shared_ptr<IpcStream> open_stream(const std::string& line);
 }
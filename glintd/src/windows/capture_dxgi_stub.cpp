@@ -26,8 +26,8 @@ using Microsoft::WRL::ComPtr;
 namespace {
 class DxgiVideoCapture : public IVideoCapture {
 public:
-    DxgiVideoCapture(int targetFps, bool withCursor)
-        : fps_(targetFps), capture_cursor_(withCursor) {}
+    DxgiVideoCapture(int targetFps, bool withCursor, int poolSize)
+        : fps_(targetFps), capture_cursor_(withCursor), pool_size_(std::max(2, poolSize)) {}
     ~DxgiVideoCapture() override { stop(); }
 
     bool start(VideoCallback cb) override {
@@ -48,6 +48,7 @@ public:
         duplication_.Reset();
         context_.Reset();
         device_.Reset();
+        pool_.reset();
     }
 
 private:
@@ -144,12 +145,25 @@ private:
         frame.width = static_cast<int>(desc.Width);
         frame.height = static_cast<int>(desc.Height);
         frame.stride = frame.width * 4;
-        frame.data.resize(static_cast<size_t>(frame.stride) * frame.height);
+        frame.format = PixelFormat::BGRA;
+
+        const size_t frameBytes = static_cast<size_t>(frame.stride) * frame.height;
+        if (!pool_ || pool_->bufferSize() < frameBytes) {
+            pool_ = FramePool::create(frameBytes, static_cast<size_t>(pool_size_));
+        }
+        frame.buffer = pool_->acquire();
+        if (!frame.buffer) {
+            context_->Unmap(staging.Get(), 0);
+            duplication_->ReleaseFrame();
+            next += interval;
+            std::this_thread::sleep_until(next);
+            continue;
+        }
 
         const uint8_t* src = static_cast<const uint8_t*>(mapped.pData);
         for (int y = 0; y < frame.height; ++y) {
             const uint8_t* row = src + y * mapped.RowPitch;
-            uint8_t* dst = frame.data.data() + y * frame.stride;
+            uint8_t* dst = frame.data() + y * frame.stride;
             memcpy(dst, row, frame.stride);
         }
 
@@ -174,6 +188,8 @@ private:
     ComPtr<ID3D11DeviceContext> context_;
     ComPtr<IDXGIOutput1> output1_;
     ComPtr<IDXGIOutputDuplication> duplication_;
+    int pool_size_{8};
+    std::shared_ptr<FramePool> pool_;
     int width_{0};
     int height_{0};
 };
@@ -298,7 +314,8 @@ public:
 
 protected:
     std::unique_ptr<IVideoCapture> createVideoCapture(const CaptureInitOptions& options) override {
-        return std::make_unique<DxgiVideoCapture>(options.target_fps, options.capture_cursor);
+        return std::make_unique<DxgiVideoCapture>(options.target_fps, options.capture_cursor,
+                                                  options.frame_pool_size);
     }
 
     std::unique_ptr<IAudioCapture> createSystemAudioCapture(const CaptureInitOptions& options) override {
@@ -0,0 +1,183 @@
+﻿// Video frame queue behaviour under a stalled encoder.
+//   evicting_queue - pushEvicting on a full queue drops the oldest entries,
+//                    including against a concurrent consumer
+//   drop_policy    - with the encoder stuck on one frame, drop_oldest hands it
+//                    the newest frames and drop_newest the earliest ones
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <format>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "recorder.h"
+#include "spsc_queue.h"
+#include "test_util.h"
+
+namespace {
+
+using namespace std::chrono_literals;
+using namespace glintd::test;
+
+std::string join(const std::vector<uint64_t>& values) {
+    std::string out;
+    for (const auto v : values) out += std::format("{} ", v);
+    return out;
+}
+
+void evictingQueue() {
+    EvictingQueue<int> queue(4);
+    for (int i = 1; i <= 4; ++i) check(queue.tryPush(int{i}), "push into free slot");
+    check(!queue.tryPush(5), "tryPush into a full queue");
+
+    int evicted = 0;
+    check(queue.pushEvicting(5, evicted) && evicted == 1, "first eviction takes 1");
+    check(queue.pushEvicting(6, evicted) && evicted == 2, "second eviction takes 2");
+
+    std::vector<uint64_t> popped;
+    for (int v = 0; queue.tryPop(v);) popped.push_back(static_cast<uint64_t>(v));
+    check(popped == std::vector<uint64_t>{3, 4, 5, 6}, "evicting_queue: popped " + join(popped));
+
+    // Every value comes out exactly once, either popped or evicted, and the
+    // popped ones stay in order.
+    constexpr int kValues = 200000;
+    EvictingQueue<int> shared(8);
+    std::atomic<bool> done{false};
+    std::vector<int> consumed;
+    std::thread consumer([&] {
+        int v = 0;
+        while (!done.load() || shared.size() != 0) {
+            if (shared.tryPop(v)) consumed.push_back(v);
+        }
+    });
+    std::vector<int> dropped;
+    for (int i = 0; i < kValues; ++i) {
+        int out = -1;
+        if (shared.pushEvicting(int{i}, out)) dropped.push_back(out);
+    }
+    done.store(true);
+    consumer.join();
+    for (int v = 0; shared.tryPop(v);) consumed.push_back(v);
+
+    bool ordered = true;
+    for (std::size_t i = 1; i < consumed.size(); ++i) ordered = ordered && consumed[i - 1] < consumed[i];
+    check(ordered, "evicting_queue: consumer saw values out of order");
+    check(consumed.size() + dropped.size() == kValues,
+          std::format("evicting_queue: {} popped + {} evicted != {}", consumed.size(), dropped.size(), kValues));
+}
+
+// Records the pts of every frame it encodes and holds the first one until
+// released, so frames pile up behind it.
+class StalledEncoder final : public IEncoder {
+public:
+    bool initVideo(const std::string&, int, int, int, int) override { return true; }
+    bool initAudio(const std::string&, int, int, int, bool) override { return true; }
+    bool open() override { return true; }
+    bool pushVideo(const uint8_t*, PixelFormat, int, int, int, uint64_t pts_ms) override {
+        std::unique_lock lock(mutex_);
+        encoded_.push_back(pts_ms);
+        stalled_ = true;
+        cv_.notify_all();
+        cv_.wait(lock, [&] { return released_; });
+        return true;
+    }
+    bool repeatVideo(uint64_t) override { return false; }
+    bool pushAudioF32(const float*, int, int, int, uint64_t, bool) override { return true; }
+    bool pull(std::vector<EncodedPacket>&) override { return true; }
+    void flush(std::vector<EncodedPacket>&) override {}
+    bool reset() override { return true; }
+    void close() override {}
+    EncoderStreamInfo videoStream() const override { return {}; }
+    EncoderStreamInfo audioStream(bool) const override { return {}; }
+
+    void waitStalled() {
+        std::unique_lock lock(mutex_);
+        cv_.wait(lock, [&] { return stalled_; });
+    }
+    void release() {
+        std::scoped_lock lock(mutex_);
+        released_ = true;
+        cv_.notify_all();
+    }
+    std::vector<uint64_t> encoded(std::size_t atLeast) {
+        std::unique_lock lock(mutex_);
+        cv_.wait_for(lock, 2s, [&] { return encoded_.size() >= atLeast; });
+        return encoded_;
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::vector<uint64_t> encoded_;
+    bool stalled_{false};
+    bool released_{false};
+};
+
+class NullMuxer final : public IMuxer {
+public:
+    bool open(const MuxerConfig&, const EncoderStreamInfo&, const EncoderStreamInfo&,
+              const EncoderStreamInfo&) override {
+        return true;
+    }
+    bool write(const EncodedPacket&) override { return true; }
+    bool close() override { return true; }
+    std::optional<MuxerError> lastError() const noexcept override { return std::nullopt; }
+    std::vector<KeyframeIndexEntry> keyframeIndex() const override { return {}; }
+    MuxerStats stats() const override { return {}; }
+};
+
+std::vector<uint64_t> runStalled(const std::filesystem::path& dir, FrameDropPolicy policy) {
+    auto encoder = std::make_unique<StalledEncoder>();
+    auto* stalled = encoder.get();
+    Recorder recorder(std::move(encoder), std::make_unique<NullMuxer>());
+
+    RecorderConfig config;
+    config.buffer_directory = dir / "buffer";
+    config.recordings_directory = dir / "recordings";
+    config.enable_system_audio = false;
+    config.enable_microphone_audio = false;
+    config.video_queue_depth = 4;
+    config.frame_drop_policy = policy;
+    check(recorder.initialize(config), "initialize");
+    check(recorder.start(false), "start");
+
+    auto pool = FramePool::create(64, 16);
+    auto push = [&](uint64_t pts) {
+        VideoFrame frame;
+        frame.width = 4;
+        frame.height = 4;
+        frame.stride = 16;
+        frame.pts_ms = pts;
+        frame.buffer = pool->acquire();
+        recorder.pushVideoFrame(frame);
+    };
+    push(1);
+    stalled->waitStalled();
+    for (uint64_t pts = 2; pts <= 10; ++pts) push(pts);
+    stalled->release();
+
+    const auto encoded = stalled->encoded(5);
+    recorder.stop();
+    return encoded;
+}
+
+void dropPolicy(const std::filesystem::path& dir) {
+    const auto oldest = runStalled(dir, FrameDropPolicy::DropOldest);
+    check(oldest == std::vector<uint64_t>{1, 7, 8, 9, 10}, "drop_oldest: encoded " + join(oldest));
+
+    const auto newest = runStalled(dir, FrameDropPolicy::DropNewest);
+    check(newest == std::vector<uint64_t>{1, 2, 3, 4, 5}, "drop_newest: encoded " + join(newest));
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    return runTests(argc, argv, "frame_queue", [](const std::filesystem::path& dir) {
+        evictingQueue();
+        dropPolicy(dir);
+    });
+}
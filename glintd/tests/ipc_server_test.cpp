@@ -0,0 +1,111 @@
+﻿// IpcServerPipe against real Unix socket clients.
+//   write_then_close - fire-and-forget clients (hotkey scripts) send requests
+//                      and close at once; every request must still run
+//   half_close       - the client shuts its write side and still reads every
+//                      reply, in order
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <format>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "ipc_server_pipe.h"
+#include "test_util.h"
+
+namespace {
+
+using namespace std::chrono_literals;
+using namespace glintd::test;
+
+int connectTo(const std::string& path) {
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    std::snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path.c_str());
+    for (int attempt = 0; attempt < 100; ++attempt) {
+        if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0) return fd;
+        std::this_thread::sleep_for(10ms);
+    }
+    ::close(fd);
+    return -1;
+}
+
+bool sendAll(int fd, const std::string& data) {
+    std::size_t sent = 0;
+    while (sent < data.size()) {
+        const ssize_t n = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        sent += static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+void writeThenClose(const std::filesystem::path& dir) {
+    constexpr int kClients = 50;
+    constexpr int kRequestsPerClient = 3;
+    std::atomic<int> handled{0};
+    IpcServerPipe server((dir / "write_then_close.sock").string());
+    server.start([&](const std::string&) {
+        // Slow enough that later lines are still queued when the hangup arrives.
+        std::this_thread::sleep_for(1ms);
+        handled.fetch_add(1);
+        return std::string("{\"ok\":true}");
+    });
+
+    for (int i = 0; i < kClients; ++i) {
+        const int fd = connectTo((dir / "write_then_close.sock").string());
+        check(fd >= 0, "connect");
+        if (fd < 0) break;
+        std::string requests;
+        for (int r = 0; r < kRequestsPerClient; ++r) requests += "{\"cmd\":\"clip_that\"}\n";
+        check(sendAll(fd, requests), "send");
+        ::close(fd);
+    }
+
+    const bool all = waitFor([&] { return handled.load() == kClients * kRequestsPerClient; }, 5000ms);
+    check(all, std::format("write_then_close: handled {} of {} requests", handled.load(),
+                           kClients * kRequestsPerClient));
+    server.stop();
+}
+
+void halfClose(const std::filesystem::path& dir) {
+    constexpr int kRequests = 5;
+    IpcServerPipe server((dir / "half_close.sock").string());
+    server.start([](const std::string& request) { return request; });
+
+    const int fd = connectTo((dir / "half_close.sock").string());
+    check(fd >= 0, "connect");
+    if (fd < 0) return;
+    std::string requests;
+    for (int r = 0; r < kRequests; ++r) requests += std::format("{{\"seq\":{}}}\n", r);
+    check(sendAll(fd, requests), "send");
+    ::shutdown(fd, SHUT_WR);
+
+    std::string replies;
+    char buf[1024];
+    for (;;) {
+        const ssize_t n = ::recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0) break;
+        replies.append(buf, static_cast<std::size_t>(n));
+    }
+    ::close(fd);
+    check(replies == requests, "half_close: replies missing or out of order: " + replies);
+    server.stop();
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    return runTests(argc, argv, "ipc_server", [](const std::filesystem::path& dir) {
+        writeThenClose(dir);
+        halfClose(dir);
+    });
+}
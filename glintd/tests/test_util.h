@@ -0,0 +1,51 @@
+﻿#pragma once
+
+// Scaffolding shared by the glintd test executables. A test file holds only
+// its cases and hands them to runTests from main:
+//
+//   usage: glintd_<name>_test [work_dir]
+
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <thread>
+
+namespace glintd::test {
+
+inline int failures = 0;
+
+inline void check(bool ok, const std::string& what) {
+    if (!ok) {
+        std::cerr << "FAIL: " << what << "\n";
+        ++failures;
+    }
+}
+
+template <typename Pred>
+bool waitFor(Pred pred, std::chrono::milliseconds timeout) {
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (!pred()) {
+        if (std::chrono::steady_clock::now() >= deadline) return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return true;
+}
+
+// Runs |cases| in argv[1], or <temp>/glintd_<name>_test, and removes that
+// directory afterwards. Returns the process exit code.
+inline int runTests(int argc, char** argv, std::string_view name,
+                    const std::function<void(const std::filesystem::path&)>& cases) {
+    const std::filesystem::path dir =
+        argc > 1 ? std::filesystem::path(argv[1])
+                 : std::filesystem::temp_directory_path() / ("glintd_" + std::string(name) + "_test");
+    std::filesystem::create_directories(dir);
+    cases(dir);
+    std::filesystem::remove_all(dir);
+    if (failures == 0) std::cout << "ok\n";
+    return failures == 0 ? 0 : 1;
+}
+
+} // namespace glintd::test